@@ -0,0 +1,121 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <cstring>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "ace/Basic_Types.h"
+#include "ace/Event_Handler.h"
+
+#include "delegate.hpp"
+
+namespace mna {
+
+  /**
+   * @brief Counters maintained by the recvmmsg/sendmmsg batch, frames/calls is the average
+   *        batch size achieved in each direction.
+   * */
+  struct mmsg_stats_t {
+    /* Number of recvmmsg calls which returned at least one frame. */
+    uint64_t m_rx_calls;
+    /* Frames received and dispatched upstream. */
+    uint64_t m_rx_frames;
+    /* Number of sendmmsg calls. */
+    uint64_t m_tx_calls;
+    /* Frames handed to kernel by sendmmsg. */
+    uint64_t m_tx_frames;
+    /* Frames dropped because sendmmsg did not accept them. */
+    uint64_t m_tx_drops;
+    /* Largest number of frames received by one recvmmsg. */
+    uint32_t m_max_rx_batch;
+  };
+
+  /**
+   * @brief Drains up to N frames per reactor wakeup with one recvmmsg into preallocated
+   *        buffers, responses produced while the batch is processed are encoded directly into
+   *        preallocated transmit buffers and sent with one sendmmsg.
+   * */
+  class mmsg_batch {
+    public:
+      using frame_delegate_t = delegate<int32_t (const uint8_t*, uint32_t)>;
+
+      mmsg_batch()
+      {
+        m_count = 0;
+        m_frame_size = 0;
+        m_tx_pending = 0;
+        std::memset(&m_stats, 0, sizeof(m_stats));
+      }
+
+      mmsg_batch(const mmsg_batch& ) = default;
+      mmsg_batch(mmsg_batch&& ) = default;
+      ~mmsg_batch() = default;
+
+      /*
+       * @brief Preallocates buffers and message headers for both directions.
+       * @param maximum number of frames per recvmmsg/sendmmsg.
+       * @param size of one frame buffer in bytes.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup(uint32_t count, uint32_t frameSize);
+
+      /*
+       * @brief Receives up to batch size frames without blocking and dispatches them upstream.
+       * @param handle of socket.
+       * @param delegate to which each frame is dispatched.
+       * @return number of frames received else < 0 upon error.
+       * */
+      int32_t recv(ACE_HANDLE handle, frame_delegate_t upstream);
+
+      /*
+       * @brief Returns the next transmit buffer of the batch, caller encodes frame in place.
+       * @param capacity of the buffer is updated.
+       * @return pointer to buffer else nullptr when batch is full.
+       * */
+      uint8_t* acquire(uint32_t& capacity);
+
+      /*
+       * @brief Queues a frame to be sent with next flush, a frame not encoded in place is
+       *        copied into the next transmit buffer.
+       * @param pointer to ethernet frame.
+       * @param length of ethernet frame.
+       * @return 0 upon success else < 0 when batch is full.
+       * */
+      int32_t queue(const uint8_t* frame, uint32_t len);
+
+      /*
+       * @brief Sends every queued frame with one sendmmsg.
+       * @param handle of socket.
+       * @return number of frames sent.
+       * */
+      uint32_t flush(ACE_HANDLE handle);
+
+      bool is_enabled() const
+      {
+        return(m_count > 1);
+      }
+
+      const mmsg_stats_t& stats() const
+      {
+        return(m_stats);
+      }
+
+    private:
+      uint32_t m_count;
+      uint32_t m_frame_size;
+      /* Number of transmit buffers queued since last flush. */
+      uint32_t m_tx_pending;
+      std::vector<uint8_t> m_rx_buf;
+      std::vector<struct iovec> m_rx_iov;
+      std::vector<struct mmsghdr> m_rx_msg;
+      std::vector<uint8_t> m_tx_buf;
+      std::vector<struct iovec> m_tx_iov;
+      std::vector<struct mmsghdr> m_tx_msg;
+      mmsg_stats_t m_stats;
+  };
+
+}
+
+#endif /*__BATCH_H__*/
@@ -0,0 +1,262 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ace/Basic_Types.h"
+#include "ace/Event_Handler.h"
+
+namespace mna {
+
+  /**
+   * @brief Source of ethernet frames other than a live interface.
+   * */
+  class capture_source {
+    public:
+      virtual ~capture_source() = default;
+
+      /*
+       * @brief Opens the source.
+       * @param path of the source.
+       * @return 0 upon success else < 0.
+       * */
+      virtual int32_t open(const std::string& path) = 0;
+
+      /*
+       * @brief Returns the next ethernet frame, it stays valid until the source is closed.
+       * @param frame is updated.
+       * @param length of frame is updated.
+       * @param capture time in ns since epoch is updated.
+       * @return 1 when a frame is returned, 0 at end of source else < 0 upon error.
+       * */
+      virtual int32_t next(const uint8_t*& frame, uint32_t& len, uint64_t& stamp) = 0;
+
+      virtual void close() = 0;
+  };
+
+  /**
+   * @brief Reads pcap, in micro or nanosecond resolution and either byte order, and pcapng with
+   *        enhanced and simple packet blocks. The file is mapped and frames are returned in place.
+   *        Frames of a link type other than ethernet are skipped.
+   * */
+  class pcap_source : public capture_source {
+    public:
+      pcap_source()
+      {
+        m_base = nullptr;
+        m_len = 0;
+        m_offset = 0;
+        m_ng = false;
+        m_swap = false;
+        m_nsec = false;
+        m_linktype = 0;
+      }
+
+      pcap_source(const pcap_source& ) = delete;
+      pcap_source(pcap_source&& ) = delete;
+
+      ~pcap_source() override
+      {
+        close();
+      }
+
+      int32_t open(const std::string& path) override;
+      int32_t next(const uint8_t*& frame, uint32_t& len, uint64_t& stamp) override;
+      void close() override;
+
+    private:
+      /**
+       * @brief Interface of a pcapng section, timestamps are in units of 10^-m_exp or 2^-m_exp.
+       * */
+      struct interface_t {
+        uint16_t m_linktype;
+        uint32_t m_snaplen;
+        uint8_t m_exp;
+        bool m_pow2;
+      };
+
+      int32_t next_pcap(const uint8_t*& frame, uint32_t& len, uint64_t& stamp);
+      int32_t next_pcapng(const uint8_t*& frame, uint32_t& len, uint64_t& stamp);
+      void parse_interface(const uint8_t* body, uint32_t bodyLen);
+      uint64_t to_ns(const interface_t& intf, uint64_t ts) const;
+
+      uint16_t u16(const uint8_t* in) const;
+      uint32_t u32(const uint8_t* in) const;
+
+      uint8_t* m_base;
+      size_t m_len;
+      size_t m_offset;
+      /* file is pcapng. */
+      bool m_ng;
+      /* byte order of file differs from host. */
+      bool m_swap;
+      /* pcap timestamps are in ns. */
+      bool m_nsec;
+      /* link type of pcap file. */
+      uint32_t m_linktype;
+      /* interfaces of current pcapng section. */
+      std::vector<interface_t> m_interfaces;
+  };
+
+  /**
+   * @brief Writes ethernet frames to a pcap file with nanosecond timestamps, records are
+   *        buffered and written out in large chunks.
+   * */
+  class pcap_sink {
+    public:
+      pcap_sink()
+      {
+        m_handle = ACE_INVALID_HANDLE;
+        m_frames = 0;
+      }
+
+      pcap_sink(const pcap_sink& ) = delete;
+      pcap_sink(pcap_sink&& ) = delete;
+
+      ~pcap_sink()
+      {
+        close();
+      }
+
+      /*
+       * @brief Creates or truncates the file and writes the pcap header.
+       * @param path of the file.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t open(const std::string& path);
+
+      /*
+       * @brief Appends one record.
+       * @param ethernet frame.
+       * @param length of frame.
+       * @param timestamp in ns since epoch.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t write(const uint8_t* frame, uint32_t len, uint64_t stamp);
+
+      /* Writes out buffered records. */
+      int32_t flush();
+      void close();
+
+      bool is_open() const
+      {
+        return(m_handle != ACE_INVALID_HANDLE);
+      }
+
+      uint64_t frames() const
+      {
+        return(m_frames);
+      }
+
+    private:
+      ACE_HANDLE m_handle;
+      uint64_t m_frames;
+      std::vector<uint8_t> m_buf;
+  };
+
+  /**
+   * @brief Writes ethernet frames to a pcapng file with nanosecond timestamps. Every interface
+   *        is described by its own block, which may be added at any point of the file, and
+   *        records are buffered and written out in large chunks.
+   * */
+  class pcapng_sink {
+    public:
+      /* epb_flags direction of a record. */
+      enum dir_t : uint32_t {
+        DIR_UNKNOWN = 0,
+        DIR_IN = 1,
+        DIR_OUT = 2
+      };
+
+      pcapng_sink()
+      {
+        m_handle = ACE_INVALID_HANDLE;
+        m_frames = 0;
+        m_bytes = 0;
+        m_interfaces = 0;
+      }
+
+      pcapng_sink(const pcapng_sink& ) = delete;
+      pcapng_sink(pcapng_sink&& ) = delete;
+
+      ~pcapng_sink()
+      {
+        close();
+      }
+
+      /*
+       * @brief Creates or truncates the file and writes the section header.
+       * @param path of the file.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t open(const std::string& path);
+
+      /*
+       * @brief Describes one more ethernet interface.
+       * @param name of the interface recorded in the file.
+       * @param number of bytes kept of every frame, 0 if frames are not truncated.
+       * @return id of the interface for write.
+       * */
+      uint32_t add_interface(const std::string& name, uint32_t snaplen);
+
+      /*
+       * @brief Appends one enhanced packet block.
+       * @param id of interface returned by add_interface.
+       * @param frame as captured.
+       * @param length of captured frame.
+       * @param length of frame on the wire.
+       * @param timestamp in ns since epoch.
+       * @param direction of frame.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t write(uint32_t id, const uint8_t* frame, uint32_t capLen, uint32_t len, uint64_t stamp, dir_t dir);
+
+      /*
+       * @brief Appends the statistics of one interface.
+       * @param id of interface returned by add_interface.
+       * @param timestamp in ns since epoch.
+       * @param frames dropped on the interface since capture started.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t statistics(uint32_t id, uint64_t stamp, uint64_t drops);
+
+      /* Writes out buffered blocks. */
+      int32_t flush();
+      void close();
+
+      bool is_open() const
+      {
+        return(m_handle != ACE_INVALID_HANDLE);
+      }
+
+      uint64_t frames() const
+      {
+        return(m_frames);
+      }
+
+      /* Size of the file including blocks not yet written out. */
+      uint64_t bytes() const
+      {
+        return(m_bytes);
+      }
+
+      uint32_t interfaces() const
+      {
+        return(m_interfaces);
+      }
+
+    private:
+      int32_t append(const void* data, size_t len);
+
+      ACE_HANDLE m_handle;
+      uint64_t m_frames;
+      uint64_t m_bytes;
+      uint32_t m_interfaces;
+      std::vector<uint8_t> m_buf;
+  };
+
+}
+
+#endif /*__CAPTURE_H__*/
@@ -0,0 +1,200 @@
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "delegate.hpp"
+
+namespace mna {
+
+  /**
+   * @brief Epoch based reclamation of memory read by threads other than its owner. A reader
+   *        announces the global epoch in a slot of its own upon entering a read section and
+   *        clears it upon leaving, which is a store to its own cache line, no lock and no
+   *        write shared with any other thread. An owner unlinks what it frees so that no reader
+   *        entering afterwards can reach it and retires it with the epoch of that moment; it is
+   *        reclaimed once every reader inside a read section announced a later epoch. When no
+   *        reader thread is attached at all, owners free at once as before.
+   * */
+  class epoch {
+    public:
+      enum : uint32_t {
+        CACHE_LINE = 64,
+        /* reader threads attached at once. */
+        MAX_READERS = 64
+      };
+
+      /* Epoch announced by a reader outside any read section, epochs start at 1. */
+      static const uint64_t QUIESCENT = 0;
+
+      /**
+       * @brief Read section of the calling thread, the thread takes a reader slot upon its first
+       *        section and hands it back when it ends. Sections nest.
+       * */
+      class guard {
+        public:
+          guard()
+          {
+            m_ok = epoch::instance().enter();
+          }
+
+          guard(const guard& ) = delete;
+          guard(guard&& ) = delete;
+
+          ~guard()
+          {
+            if(m_ok) {
+              epoch::instance().leave();
+            }
+          }
+
+          /* False if every reader slot is taken, nothing may be read then. */
+          explicit operator bool() const
+          {
+            return(m_ok);
+          }
+
+        private:
+          bool m_ok;
+      };
+
+      static epoch& instance();
+
+      epoch(const epoch& ) = delete;
+      epoch(epoch&& ) = delete;
+
+      /* Epoch to retire with, read once what is retired is unlinked. */
+      uint64_t now() const
+      {
+        return(m_epoch.load(std::memory_order_seq_cst));
+      }
+
+      /* True while any reader thread is attached, what is freed has to be retired then. */
+      bool readers() const
+      {
+        return(m_attached.load(std::memory_order_seq_cst) != 0);
+      }
+
+      /*
+       * @brief Moves the global epoch on and looks up the oldest epoch announced by a reader.
+       * @param none
+       * @return epoch before which every retired object may be reclaimed.
+       * */
+      uint64_t safe();
+
+      /*
+       * @brief Waits until every reader inside a read section has left it, so that nothing
+       *        unlinked beforehand is held by any reader. The calling thread must not be inside
+       *        a read section of its own.
+       * @param none
+       * @return none
+       * */
+      void synchronize();
+
+    private:
+      friend class guard;
+
+      /* Reader slot of a thread, handed back when the thread ends. */
+      struct thread_slot_t;
+
+      struct alignas(CACHE_LINE) reader_t {
+        std::atomic<uint64_t> m_epoch;
+        std::atomic<bool> m_used;
+      };
+
+      epoch();
+
+      /* Announces the global epoch in the slot of the calling thread, false without a slot. */
+      bool enter();
+      void leave();
+      /* Takes a free slot, MAX_READERS if none is left. */
+      uint32_t attach();
+      void detach(uint32_t slot);
+
+      /* slot of the calling thread. */
+      static thread_local thread_slot_t m_thread;
+
+      alignas(CACHE_LINE) std::atomic<uint64_t> m_epoch;
+      std::atomic<uint32_t> m_attached;
+      reader_t m_readers[MAX_READERS];
+  };
+
+  /**
+   * @brief Objects retired by one owner and not reclaimed yet, oldest first. Not thread safe,
+   *        every shard owns one.
+   * */
+  class limbo {
+    public:
+      /* Frees what was retired, invoked with the argument it was retired with. */
+      using reclaim_t = delegate<void (uintptr_t)>;
+
+      enum : uint32_t {
+        /* retired objects which make retire try to reclaim. */
+        BATCH = 64
+      };
+
+      limbo()
+      {
+        m_head = 0;
+        m_retired = 0;
+        m_reclaimed = 0;
+      }
+
+      limbo(const limbo& ) = delete;
+      limbo(limbo&& ) = delete;
+
+      ~limbo()
+      {
+        drain();
+      }
+
+      /*
+       * @brief Frees an unlinked object once no reader can hold it, at once if no reader thread
+       *        is attached.
+       * @param delegate freeing the object.
+       * @param argument of the delegate, pointer or index of the object.
+       * @return none
+       * */
+      void retire(reclaim_t reclaim, uintptr_t arg);
+
+      /* Frees what every reader is done with, returns objects freed. */
+      uint32_t reclaim();
+
+      /* Frees everything, once readers of the owner are stopped. */
+      void drain();
+
+      uint64_t pending() const
+      {
+        return(m_items.size() - m_head);
+      }
+
+      uint64_t retired() const
+      {
+        return(m_retired);
+      }
+
+      uint64_t reclaimed() const
+      {
+        return(m_reclaimed);
+      }
+
+    private:
+      struct item_t {
+        uint64_t m_epoch;
+        reclaim_t m_reclaim;
+        uintptr_t m_arg;
+      };
+
+      /* items before m_head are reclaimed, the vector is compacted once half of it is. */
+      std::vector<item_t> m_items;
+      size_t m_head;
+      uint64_t m_retired;
+      uint64_t m_reclaimed;
+  };
+
+}
+
+#endif /*__EPOCH_H__*/
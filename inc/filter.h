@@ -0,0 +1,138 @@
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include <cstring>
+#include <vector>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+
+#include "ace/Basic_Types.h"
+#include "ace/Event_Handler.h"
+
+namespace mna {
+
+  /**
+   * @brief A handler enabled in middleware, frames matching it are let through to user space.
+   *        A proto of 0 matches every frame of the ethertype and a port of 0 matches every
+   *        datagram of the proto.
+   * */
+  struct match_t {
+    /* Ethernet type in host byte order. */
+    uint16_t m_ethertype;
+    /* IP protocol for IPv4 frames. */
+    uint8_t m_proto;
+    /* UDP/TCP destination port in host byte order. */
+    uint16_t m_port;
+
+    match_t(uint16_t ethertype = 0, uint8_t proto = 0, uint16_t port = 0)
+    {
+      m_ethertype = ethertype;
+      m_proto = proto;
+      m_port = port;
+    }
+
+    bool operator==(const match_t& rhs) const
+    {
+      return(m_ethertype == rhs.m_ethertype && m_proto == rhs.m_proto && m_port == rhs.m_port);
+    }
+  };
+
+  /**
+   * @brief Counters read with PACKET_STATISTICS. Kernel clears its counters upon every read,
+   *        they are accumulated here. Frames rejected by the filter never reach the socket
+   *        and are not part of these counters.
+   * */
+  struct filter_stats_t {
+    /* Frames queued to the socket. */
+    uint64_t m_delivered;
+    /* Frames which passed the filter but were dropped by kernel for want of room. */
+    uint64_t m_dropped;
+    /* Number of times the TPACKET_V3 queue was frozen. */
+    uint64_t m_freeze;
+    /* Number of times the program was regenerated and attached. */
+    uint32_t m_attached;
+  };
+
+  /**
+   * @brief Classic BPF socket filter generated from the set of enabled handlers and attached
+   *        with SO_ATTACH_FILTER, so that irrelevant traffic is dropped in kernel.
+   * */
+  class filter {
+    public:
+      filter()
+      {
+        std::memset(&m_stats, 0, sizeof(m_stats));
+      }
+
+      filter(const filter& ) = default;
+      filter(filter&& ) = default;
+      ~filter() = default;
+
+      /*
+       * @brief Adds a handler to the set, a handler already present is ignored.
+       * @param handler to be let through.
+       * @return true if set has changed.
+       * */
+      bool enable(const match_t& m);
+
+      /*
+       * @brief Removes a handler from the set.
+       * @param handler to be dropped in kernel from now on.
+       * @return true if set has changed.
+       * */
+      bool disable(const match_t& m);
+
+      /*
+       * @brief Generates the program for current set of handlers and attaches it to the socket,
+       *        an attached program is replaced atomically.
+       * @param handle of socket.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t attach(ACE_HANDLE handle);
+
+      /*
+       * @brief Joins the socket to a PACKET_FANOUT group whose frames are spread by a classic
+       *        BPF program keyed on the dhcp chaddr, every frame of one client lands on the
+       *        same socket. Must be invoked after bind.
+       * @param handle of PF_PACKET socket.
+       * @param fanout group id shared by every worker.
+       * @param number of sockets in the group.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t fanout(ACE_HANDLE handle, uint16_t group, uint32_t members);
+
+      /*
+       * @brief Reads PACKET_STATISTICS of socket and accumulates them.
+       * @param handle of PF_PACKET socket.
+       * @return accumulated counters.
+       * */
+      const filter_stats_t& update(ACE_HANDLE handle);
+
+      /* Counters accumulated so far, nothing is read from socket. */
+      const filter_stats_t& stats() const
+      {
+        return(m_stats);
+      }
+
+      const std::vector<match_t>& handlers() const
+      {
+        return(m_handlers);
+      }
+
+      const std::vector<struct sock_filter>& program() const
+      {
+        return(m_program);
+      }
+
+    private:
+      /* Builds m_program from m_handlers. */
+      void generate();
+
+      std::vector<match_t> m_handlers;
+      std::vector<struct sock_filter> m_program;
+      filter_stats_t m_stats;
+  };
+
+}
+
+#endif /*__FILTER_H__*/
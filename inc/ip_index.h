@@ -0,0 +1,225 @@
+#ifndef __IP_INDEX_H__
+#define __IP_INDEX_H__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "epoch.h"
+
+namespace mna {
+
+  /**
+   * @brief Index of the addresses of one subnet to 32-bit values, the slot of the lease holding
+   *        the address. The subnet is cut into pages of PAGE addresses and the value of an
+   *        address is read directly at its offset within its page, a lookup being two loads and
+   *        no hash. A page is allocated when its first address is added and freed when its last
+   *        one goes, so that a sparsely leased /8 costs little more than its page table.
+   *        Pages are in address order and every page has a bit per address present, so a range
+   *        is walked in order by skipping empty pages and counting trailing zeros, and the count
+   *        of addresses present is kept per page and per BLOCK, so that the utilization of any
+   *        prefix adds up at most 128 block counters (a /9), 32 page counters (a /17) or 8 words
+   *        of bits (a /23), the whole subnet being its size.
+   *        find and scan may run on reader threads within an epoch::guard while the owner
+   *        changes the index: a page is published once it is filled in and, once given a limbo,
+   *        an emptied page is retired rather than freed. A reader may see a value a moment
+   *        stale and checks it against what it points to.
+   *        Addresses are in host byte order.
+   * */
+  class ip_index {
+    public:
+      enum : uint32_t {
+        WORD_BITS = 64,
+        /* addresses of a page, 4KB of values, a /22. */
+        PAGE = 1024,
+        /* addresses of a block, counted as a whole, a /16. */
+        BLOCK = 65536,
+        /* value returned by find for an address not present. */
+        NIL = 0xFFFFFFFFU,
+        /* largest subnet, a /8. */
+        MIN_PREFIX = 8
+      };
+
+      ip_index()
+      {
+        m_subnet = 0;
+        m_count = 0;
+        m_size = 0;
+        m_pages_used = 0;
+        m_limbo = nullptr;
+      }
+
+      ip_index(const ip_index& ) = delete;
+      ip_index(ip_index&& ) = default;
+
+      ~ip_index()
+      {
+        clear();
+      }
+
+      /* Retires emptied pages through the limbo of the owner, nullptr frees them at once. */
+      void set_limbo(limbo* lb)
+      {
+        m_limbo = lb;
+      }
+
+      /*
+       * @brief Sizes the page table for a subnet, every address added before is dropped.
+       * @param address of the subnet.
+       * @param length of prefix of the subnet, MIN_PREFIX to 32.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup(uint32_t subnet, uint32_t prefixLen);
+
+      /*
+       * @brief Looks up the value of an address.
+       * @param address.
+       * @return value, NIL if address is not present or outside the subnet.
+       * */
+      uint32_t find(uint32_t ip) const
+      {
+        uint32_t idx = ip - m_subnet;
+        const page_t* page = nullptr;
+
+        if(ip < m_subnet || idx >= m_count || !(page = page_at(idx / PAGE))) {
+          return(NIL);
+        }
+
+        return(page->m_value[idx % PAGE]);
+      }
+
+      /*
+       * @brief Adds an address.
+       * @param address.
+       * @param value of the address, other than NIL.
+       * @return 0 upon success else < 0 if address is present or outside the subnet.
+       * */
+      int32_t insert(uint32_t ip, uint32_t value);
+
+      /*
+       * @brief Removes an address.
+       * @param address.
+       * @return 0 upon success else < 0 if address is not present.
+       * */
+      int32_t erase(uint32_t ip);
+
+      /*
+       * @brief Number of addresses present within a prefix, the utilization of a subnet.
+       * @param address within the prefix.
+       * @param length of prefix, 0 to 32.
+       * @return addresses present, 0 for a prefix outside the subnet.
+       * */
+      uint64_t count(uint32_t prefix, uint32_t prefixLen) const;
+
+      /*
+       * @brief Hands the addresses present within a range to visit in ascending order, at most
+       *        limit of them, so that a large range is walked a slice at a time in between packets.
+       * @param address to start from, the cursor returned by the previous slice.
+       * @param last address of range.
+       * @param addresses visited at most.
+       * @param callable invoked with address and value.
+       * @return cursor of the next slice, greater than last once the range is done.
+       * */
+      template<typename F>
+      uint64_t scan(uint64_t from, uint32_t last, uint64_t limit, F visit) const
+      {
+        uint64_t end = static_cast<uint64_t>(last) + 1;
+        uint64_t idx = 0;
+        uint64_t stop = 0;
+        uint64_t bits = 0;
+
+        if(!m_count || from >= end || last < m_subnet) {
+          return(end);
+        }
+
+        idx = (from > m_subnet) ? (from - m_subnet) : 0;
+        stop = ((end - m_subnet) < m_count) ? (end - m_subnet) : m_count;
+
+        while(idx < stop && (idx = next_page(idx)) < stop) {
+          const page_t* page = page_at(idx / PAGE);
+
+          /* bits of the page from idx on, one word at a time, a page emptied meanwhile has none. */
+          for(uint32_t word = (idx % PAGE) / WORD_BITS; page && word < PAGE / WORD_BITS; ++word) {
+            bits = page->m_bits[word];
+
+            if(word == (idx % PAGE) / WORD_BITS) {
+              bits &= ~0ULL << (idx % WORD_BITS);
+            }
+
+            for(; bits; bits &= bits - 1) {
+              uint64_t at = ((idx / PAGE) * PAGE) + (word * WORD_BITS) + __builtin_ctzll(bits);
+
+              if(at >= stop) {
+                return(end);
+              }
+
+              if(!limit--) {
+                return(m_subnet + at);
+              }
+
+              visit(static_cast<uint32_t>(m_subnet + at), page->m_value[at % PAGE]);
+            }
+          }
+
+          idx = ((idx / PAGE) + 1) * PAGE;
+        }
+
+        return(end);
+      }
+
+      uint64_t size() const
+      {
+        return(m_size);
+      }
+
+      /* Bytes held by the page table, the counters and the pages. */
+      uint64_t bytes() const
+      {
+        return((m_pages.capacity() * sizeof(page_t*)) + (m_live.capacity() * sizeof(uint16_t)) +
+               (m_blocks.capacity() * sizeof(uint32_t)) + (m_used.capacity() * sizeof(uint64_t)) +
+               (m_pages_used * sizeof(page_t)));
+      }
+
+    private:
+      struct page_t {
+        /* bit per address present. */
+        uint64_t m_bits[PAGE / WORD_BITS];
+        /* value of every address, NIL if not present. */
+        uint32_t m_value[PAGE];
+      };
+
+      /* Page of the owner or of a reader, nullptr while it is empty. */
+      page_t* page_at(uint64_t pg) const
+      {
+        return(__atomic_load_n(&m_pages[pg], __ATOMIC_ACQUIRE));
+      }
+
+      /* Frees a retired page, uintptr_t being the page. */
+      void free_page(uintptr_t page);
+      /* Frees every page. */
+      void clear();
+
+      /* Returns offset of the first address of the first page at or past idx which is not
+       * empty, idx itself if its page is not empty, m_count if there is none. */
+      uint64_t next_page(uint64_t idx) const;
+
+      uint32_t m_subnet;
+      /* addresses of the subnet. */
+      uint64_t m_count;
+      uint64_t m_size;
+      uint64_t m_pages_used;
+      /* page of every PAGE addresses, nullptr while none of them is present. */
+      std::vector<page_t*> m_pages;
+      /* addresses present in every page. */
+      std::vector<uint16_t> m_live;
+      /* addresses present in every block. */
+      std::vector<uint32_t> m_blocks;
+      /* bit per page which is not empty. */
+      std::vector<uint64_t> m_used;
+      /* nullptr unless pages are read by other threads. */
+      limbo* m_limbo;
+  };
+
+}
+
+#endif /*__IP_INDEX_H__*/
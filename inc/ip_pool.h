@@ -0,0 +1,198 @@
+#ifndef __IP_POOL_H__
+#define __IP_POOL_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "mac_index.h"
+
+namespace mna {
+
+  /**
+   * @brief IPv4 addresses of one subnet handed out to DHCP clients. Every address has one bit
+   *        telling whether it is free, and every 64-bit word of bits has one bit one level up
+   *        telling whether it has any free address, up to a single word. Looking up a free
+   *        address takes one count of trailing zeros per level, four for a /8, however full the
+   *        pool is, and handing an address out or back touches at most one word per level.
+   *        Addresses are in host byte order. One pool is shared by every shard of the lease
+   *        table: once shared, allocate, claim and release may run on any thread at once, bits
+   *        being taken and given back with atomic operations, while setting up ranges,
+   *        exclusions and reservations is done before any thread hands out addresses.
+   * */
+  class ip_pool {
+    public:
+      enum : uint32_t {
+        WORD_BITS = 64,
+        /* largest subnet, a /8. */
+        MIN_PREFIX = 8
+      };
+
+      ip_pool()
+      {
+        m_subnet = 0;
+        m_count = 0;
+        m_size = 0;
+        m_free = 0;
+        m_shared = false;
+      }
+
+      ip_pool(const ip_pool& ) = delete;
+      ip_pool(ip_pool&& ) = default;
+      ~ip_pool() = default;
+
+      /*
+       * @brief Sizes the pool for a subnet, no address is handed out until a range is added.
+       * @param address of the subnet.
+       * @param length of prefix of the subnet, MIN_PREFIX to 32.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup(uint32_t subnet, uint32_t prefixLen);
+
+      /*
+       * @brief Makes the addresses of a range available to be handed out.
+       * @param first address of range.
+       * @param last address of range.
+       * @return 0 upon success else < 0 if range is not within the subnet.
+       * */
+      int32_t add_range(uint32_t first, uint32_t last);
+
+      /*
+       * @brief Takes the addresses of a range out of the pool, free or not, a range added
+       *        afterwards may bring them back.
+       * @param first address of range.
+       * @param last address of range.
+       * @return 0 upon success else < 0 if range is not within the subnet.
+       * */
+      int32_t exclude(uint32_t first, uint32_t last);
+
+      /*
+       * @brief Takes an address out of the pool and keeps it for one client.
+       * @param chaddr of client.
+       * @param address of client.
+       * @return 0 upon success else < 0 if address is outside subnet, handed out already or
+       *         client has a reservation.
+       * */
+      int32_t reserve(const uint8_t* mac, uint32_t ip);
+
+      /*
+       * @brief Hands out the reserved address of a client, else the lowest free address.
+       * @param chaddr of client.
+       * @return address, 0 when the pool is exhausted.
+       * */
+      uint32_t allocate(const uint8_t* mac);
+
+      /*
+       * @brief Hands out a given address, a binding brought back from the lease journal.
+       * @param chaddr of client.
+       * @param address to be handed out.
+       * @return 0 upon success else < 0 if address is neither free nor reserved for the client.
+       * */
+      int32_t claim(const uint8_t* mac, uint32_t ip);
+
+      /*
+       * @brief Hands an address back to the pool, reserved and excluded addresses stay out.
+       * @param address returned by allocate.
+       * @return 0 upon success else < 0 if address was not handed out from the pool.
+       * */
+      int32_t release(uint32_t ip);
+
+      /*
+       * @brief Lets more than one thread hand out addresses. A locked operation on a word which
+       *        misses the cache waits for it, so a pool of one shard sticks to plain ones.
+       * @param true once more than one shard serves clients.
+       * @return none
+       * */
+      void share(bool shared)
+      {
+        m_shared = shared;
+      }
+
+      /* Addresses which can be handed out, reservations excluded. */
+      uint64_t size() const
+      {
+        return(m_size);
+      }
+
+      uint64_t free_count() const
+      {
+        return(__atomic_load_n(&m_free, __ATOMIC_RELAXED));
+      }
+
+      uint32_t subnet() const
+      {
+        return(m_subnet);
+      }
+
+      /* Bytes held by the bitmaps and the reservations. */
+      uint64_t bytes() const;
+
+    private:
+      /* Marks an address free and its word one level up non zero, false if it was free. */
+      bool set_free(uint32_t idx);
+      /* Takes a free address, false if it is not free or another thread took it first. */
+      bool take(uint32_t idx);
+      /* Clears the bit of an emptied word of level 0 up the levels, as far as words empty. */
+      void clear_summary(uint32_t idx);
+
+      uint64_t fetch_or(uint64_t& word, uint64_t bits)
+      {
+        uint64_t old = 0;
+
+        if(m_shared) {
+          return(__atomic_fetch_or(&word, bits, __ATOMIC_SEQ_CST));
+        }
+
+        old = word;
+        word = old | bits;
+        return(old);
+      }
+
+      uint64_t fetch_and(uint64_t& word, uint64_t bits)
+      {
+        uint64_t old = 0;
+
+        if(m_shared) {
+          return(__atomic_fetch_and(&word, bits, __ATOMIC_SEQ_CST));
+        }
+
+        old = word;
+        word = old & bits;
+        return(old);
+      }
+
+      void count_free(int64_t delta)
+      {
+        if(m_shared) {
+          __atomic_fetch_add(&m_free, delta, __ATOMIC_RELAXED);
+        } else {
+          m_free += delta;
+        }
+      }
+
+      bool test(const std::vector<uint64_t>& bits, uint32_t idx) const
+      {
+        return((bits[idx / WORD_BITS] >> (idx % WORD_BITS)) & 1);
+      }
+
+      uint32_t m_subnet;
+      /* addresses of the subnet. */
+      uint64_t m_count;
+      uint64_t m_size;
+      uint64_t m_free;
+      /* allocate, claim and release run on more than one thread. */
+      bool m_shared;
+      /* bit per address of a range and neither excluded nor reserved. */
+      std::vector<uint64_t> m_dynamic;
+      /* bit per reserved address, kept out of ranges added later. */
+      std::vector<uint64_t> m_fixed;
+      /* level 0 has bit per free address, level n bit per non zero word of level n - 1; a bit
+       * above level 0 may be set for a word which was just emptied, never left clear for a
+       * word with a free address once a release is done. */
+      std::vector<std::vector<uint64_t> > m_levels;
+      /* chaddr to offset of reserved address within the subnet. */
+      mac_index m_reserved;
+  };
+
+}
+
+#endif /*__IP_POOL_H__*/
@@ -0,0 +1,330 @@
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ace/Basic_Types.h"
+#include "ace/Task.h"
+#include "ace/Thread_Manager.h"
+
+#include "delegate.hpp"
+#include "mac_index.h"
+
+namespace mna {
+
+  /**
+   * @brief One change of a lease as it is laid out in the journal, every field in host byte order.
+   * */
+  struct lease_record_t {
+    enum type_t : uint8_t {
+      /* lease is granted or renewed by an ACK. */
+      BIND = 1,
+      /* client gave the address back. */
+      RELEASE = 2,
+      /* lease timer ran out. */
+      EXPIRE = 3
+    };
+
+    /* CRC32C of every byte of the record past this field. */
+    uint32_t m_crc;
+    uint8_t m_type;
+    uint8_t m_rsvd;
+    uint8_t m_chaddr[6];
+    uint32_t m_ip;
+    /* end of lease in seconds since epoch. */
+    uint64_t m_expiry;
+    /* time of change in ns since epoch. */
+    uint64_t m_stamp;
+    /* duration of lease in seconds. */
+    uint32_t m_lease;
+    uint32_t m_rsvd2;
+  };
+
+  static_assert(sizeof(lease_record_t) == 40, "journal record layout is fixed");
+
+  /**
+   * @brief Counters of the lease journal.
+   * */
+  struct journal_stats_t {
+    /* Records written to file. */
+    uint64_t m_records;
+    /* fdatasync calls, every one commits all records written before it. */
+    uint64_t m_syncs;
+    /* Largest number of records committed by one fdatasync. */
+    uint64_t m_max_batch;
+    /* Records which found the ring full and waited in the overflow of their producer. */
+    uint64_t m_overflows;
+    /* Snapshots written, every one cuts the journal back to its header. */
+    uint64_t m_snapshots;
+    /* Records in the journal past the latest snapshot, replayed upon startup. */
+    uint64_t m_tail;
+    /* Bindings alive as of the latest record written. */
+    uint64_t m_bindings;
+  };
+
+  /**
+   * @brief Single producer single consumer ring of journal records. The middleware appends and
+   *        the writer thread of the journal drains. A record finding the ring full is parked in
+   *        an overflow of the producer and pushed again with the next append or retry, so that
+   *        neither side ever waits and no record is lost.
+   * */
+  class journal_ring {
+    public:
+      enum : uint32_t {
+        CACHE_LINE = 64
+      };
+
+      journal_ring()
+      {
+        m_mask = 0;
+        m_head.store(0);
+        m_tail_cache = 0;
+        m_overflows.store(0);
+        m_appended = 0;
+        m_tail.store(0);
+        m_tail_local = 0;
+        m_head_cache = 0;
+        m_synced.store(0);
+      }
+
+      journal_ring(const journal_ring& ) = delete;
+      journal_ring(journal_ring&& ) = delete;
+      ~journal_ring() = default;
+
+      /*
+       * @brief Allocates the records.
+       * @param number of records, rounded up to power of two.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup(uint32_t slots);
+
+      /*
+       * @brief Producer side, seals the record with its CRC and queues it.
+       * @param record, m_crc is filled in.
+       * @return sequence number of the record, it is on disk once synced() reaches it.
+       * */
+      uint64_t append(lease_record_t& rec);
+
+      /* Producer side, moves parked records to the ring as far as there is room. */
+      void retry();
+
+      /* Consumer side, returns the oldest record not yet popped, nullptr when ring is empty. */
+      const lease_record_t* front();
+
+      void pop()
+      {
+        ++m_tail_local;
+      }
+
+      /* Consumer side, hands popped records back to producer. */
+      void commit()
+      {
+        m_tail.store(m_tail_local, std::memory_order_release);
+      }
+
+      /* Consumer side, records popped and not committed are popped again, they did not make it to disk. */
+      void rewind()
+      {
+        m_tail_local = m_tail.load(std::memory_order_relaxed);
+      }
+
+      /* Consumer side, marks every popped record as durable. */
+      void synced(uint64_t seq)
+      {
+        m_synced.store(seq, std::memory_order_release);
+      }
+
+      /* Number of records appended to this ring which are on disk. */
+      uint64_t synced() const
+      {
+        return(m_synced.load(std::memory_order_acquire));
+      }
+
+      uint64_t consumed() const
+      {
+        return(m_tail_local);
+      }
+
+      uint64_t overflows() const
+      {
+        return(m_overflows.load(std::memory_order_relaxed));
+      }
+
+    private:
+      /* Queues into the ring, false when it is full. */
+      bool push(const lease_record_t& rec);
+
+      std::unique_ptr<lease_record_t[]> m_slots;
+      uint64_t m_mask;
+      /* producer */
+      alignas(CACHE_LINE) std::atomic<uint64_t> m_head;
+      uint64_t m_tail_cache;
+      std::atomic<uint64_t> m_overflows;
+      /* records appended, parked ones included. */
+      uint64_t m_appended;
+      std::vector<lease_record_t> m_parked;
+      /* consumer */
+      alignas(CACHE_LINE) std::atomic<uint64_t> m_tail;
+      uint64_t m_tail_local;
+      uint64_t m_head_cache;
+      std::atomic<uint64_t> m_synced;
+  };
+
+  /**
+   * @brief Append-only journal of lease changes. Every middleware appends into a ring of its own
+   *        and one writer thread drains every ring into the file, committing whatever it drained
+   *        with one fdatasync, so that a burst of lease changes costs one flush and the datapath
+   *        never waits for the disk. The writer folds every record it commits into a table of
+   *        the bindings alive, and once the journal holds more records than allowed it writes the
+   *        table out as a snapshot and cuts the journal back to its header, so that neither the
+   *        file nor the replay upon startup grows without bound and the datapath is never paused.
+   *        Upon startup the snapshot is mapped and folded, the journal past it is replayed, a torn
+   *        or corrupt tail is cut off and the bindings still alive are handed to every middleware.
+   * */
+  class lease_journal : public ACE_Task_Base {
+    public:
+      using record_delegate_t = delegate<void (const lease_record_t&)>;
+
+      enum : uint32_t {
+        MAX_RINGS = 64,
+        MAGIC = 0x4A4D4C49U,
+        SNAP_MAGIC = 0x534D4C49U,
+        VERSION = 1,
+        HDR_LEN = 16,
+        /* records written out with one write before the file is synced. */
+        WRITE_CHUNK = 4096
+      };
+
+      lease_journal() : ACE_Task_Base(&m_thr_mgr)
+      {
+        m_handle = ACE_INVALID_HANDLE;
+        m_end = 0;
+        m_failing = false;
+        m_slots = 0;
+        m_sync_us = 0;
+        m_count.store(0);
+        m_done.store(false);
+        m_running = false;
+        m_records.store(0);
+        m_syncs.store(0);
+        m_max_batch.store(0);
+        m_compact = 0;
+        m_tail.store(0);
+        m_snapshots.store(0);
+        m_bindings.store(0);
+      }
+
+      lease_journal(const lease_journal& ) = delete;
+      lease_journal(lease_journal&& ) = delete;
+
+      virtual ~lease_journal()
+      {
+        stop();
+      }
+
+      /*
+       * @brief Loads the snapshot, replays the journal past it, cuts off a torn tail and opens
+       *        the journal for appending.
+       * @param path of the journal, created if missing, the snapshot is <path>.snap.
+       * @param records of the ring of every middleware.
+       * @param time in us the writer idles before looking for records again.
+       * @param records the journal holds before a snapshot is taken, 0 never takes one.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup(const std::string& path, uint32_t slots, uint32_t syncUs, uint64_t compact);
+
+      /*
+       * @brief Hands out the ring of one more middleware.
+       * @param none
+       * @return ring, nullptr when journal is not set up or every ring is taken.
+       * */
+      journal_ring* attach();
+
+      /*
+       * @brief Spawns the writer thread.
+       * @param none
+       * @return 0 upon success else < 0.
+       * */
+      int open(void* args = 0) override;
+
+      /*
+       * @brief Drains and commits every ring until stop is invoked.
+       * @param none
+       * @return 0 upon success else < 0.
+       * */
+      int svc(void) override;
+
+      /* Commits what is left, closes the file and joins the writer thread. */
+      void stop();
+
+      journal_stats_t stats() const;
+
+      /* Bindings alive as of the replay upon setup, latest record of every client. The table
+       * belongs to the writer thread once open is invoked, it is read before. */
+      const std::vector<lease_record_t>& leases() const
+      {
+        return(m_leases);
+      }
+
+      /*
+       * @brief Maps a journal or snapshot and hands every intact record to the delegate in order.
+       * @param path of the file.
+       * @param MAGIC for a journal, SNAP_MAGIC for a snapshot.
+       * @param delegate invoked with every record.
+       * @param offset past the last intact record is updated.
+       * @return number of records, < 0 upon error.
+       * */
+      static int64_t replay(const std::string& path, uint32_t magic, record_delegate_t apply, uint64_t& end);
+
+      /* CRC32C, the checksum of every record. */
+      static uint32_t crc32c(const void* data, size_t len);
+
+      /* Journal shared by every middleware of the process. */
+      static lease_journal& instance();
+
+    private:
+      /* Folds one replayed or committed record into m_leases. */
+      void fold(const lease_record_t& rec);
+      /* Writes the bindings alive to the snapshot and cuts the journal back to its header. */
+      int32_t snapshot();
+      /* Writes out and syncs records of every ring, returns number of records written. */
+      uint32_t drain();
+      /* Writes m_buf to file. */
+      int32_t write_out(ACE_HANDLE handle);
+
+      ACE_HANDLE m_handle;
+      /* offset past the last record synced, a failed write is cut back to it. */
+      uint64_t m_end;
+      /* writes fail and are retried. */
+      bool m_failing;
+      std::string m_path;
+      uint32_t m_slots;
+      uint32_t m_sync_us;
+      std::array<journal_ring, MAX_RINGS> m_rings;
+      /* rings handed out, published to writer thread. */
+      std::atomic<uint32_t> m_count;
+      std::atomic<bool> m_done;
+      bool m_running;
+      std::atomic<uint64_t> m_records;
+      std::atomic<uint64_t> m_syncs;
+      std::atomic<uint64_t> m_max_batch;
+      uint64_t m_compact;
+      /* records in the journal past the snapshot. */
+      std::atomic<uint64_t> m_tail;
+      std::atomic<uint64_t> m_snapshots;
+      std::atomic<uint64_t> m_bindings;
+      std::vector<uint8_t> m_buf;
+      std::vector<lease_record_t> m_leases;
+      /* chaddr to position in m_leases. */
+      mac_index m_folded;
+      /* writer thread is not waited for by ACE_Thread_Manager::instance. */
+      ACE_Thread_Manager m_thr_mgr;
+  };
+
+}
+
+#endif /*__JOURNAL_H__*/
@@ -0,0 +1,74 @@
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include <array>
+#include <time.h>
+
+#include "ace/Basic_Types.h"
+
+namespace mna {
+
+  /* Wall clock in ns, same clock as kernel receive timestamps. */
+  inline uint64_t clock_ns()
+  {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return((static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec);
+  }
+
+  /**
+   * @brief Log-linear histogram of latencies in nanoseconds. Every power of two is split into
+   *        SUB_BUCKETS linear buckets, so a percentile is off by at most 1/SUB_BUCKETS of its
+   *        value. Recording is one increment and needs no allocation.
+   * */
+  class latency_histogram {
+    public:
+      enum : uint32_t {
+        SUB_BITS = 4,
+        SUB_BUCKETS = (1U << SUB_BITS),
+        BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS
+      };
+
+      latency_histogram()
+      {
+        reset();
+      }
+
+      latency_histogram(const latency_histogram& ) = default;
+      latency_histogram(latency_histogram&& ) = default;
+      ~latency_histogram() = default;
+
+      /* Adds one sample in nanoseconds. */
+      void record(uint64_t ns);
+
+      /*
+       * @brief Returns the value below which the given fraction of samples fall.
+       * @param percentile in the range 0 to 100.
+       * @return upper bound of the bucket holding the percentile in nanoseconds, 0 if empty.
+       * */
+      uint64_t percentile(double p) const;
+
+      void reset();
+
+      uint64_t count() const
+      {
+        return(m_count);
+      }
+
+      uint64_t max() const
+      {
+        return(m_max);
+      }
+
+    private:
+      static uint32_t bucket(uint64_t ns);
+      static uint64_t upper(uint32_t idx);
+
+      std::array<uint64_t, BUCKETS> m_buckets;
+      uint64_t m_count;
+      uint64_t m_max;
+  };
+
+}
+
+#endif /*__LATENCY_H__*/
@@ -0,0 +1,162 @@
+#ifndef __LEASE_STORE_H__
+#define __LEASE_STORE_H__
+
+#include <atomic>
+#include <cstdint>
+
+#include "ip_pool.h"
+
+namespace mna {
+
+  namespace dhcp {
+    class server;
+    struct lease_view_t;
+  }
+
+  /**
+   * @brief Leases of every shard summed up.
+   * */
+  struct lease_store_stats_t {
+    uint32_t m_shards;
+    uint64_t m_leases;
+    uint64_t m_bound;
+    uint64_t m_cold;
+    /* Addresses of the shared pool, free ones and ones which can be handed out. */
+    uint64_t m_pool_free;
+    uint64_t m_pool_size;
+  };
+
+  /**
+   * @brief The lease table of the process split into a power of two shards by hash of chaddr,
+   *        one per worker, the shard of a client being the worker the kernel fanout hands its
+   *        packets to. A shard is the dhcp::server of its worker, with its own index on MAC,
+   *        index on address, slab of entries and timing wheel, none of which is touched by
+   *        another thread. What spans shards is held here: the pool of addresses, shared so that
+   *        an address is handed out by one shard at a time, and one header per shard in a cache
+   *        line of its own, where the owning worker publishes its counters with plain stores
+   *        and from which stats of every shard are summed up without stopping any of them.
+   *        The header points to the dhcp::server of the shard as well, so that a thread other
+   *        than its worker reads leases of the shard within an epoch::guard.
+   * */
+  class lease_store {
+    public:
+      enum : uint32_t {
+        CACHE_LINE = 64,
+        MAX_SHARDS = 64
+      };
+
+      /**
+       * @brief Counters of one shard, written by its worker only.
+       * */
+      struct alignas(CACHE_LINE) shard_t {
+        std::atomic<uint64_t> m_leases;
+        std::atomic<uint64_t> m_bound;
+        std::atomic<uint64_t> m_cold;
+        /* server of the shard, nullptr until attached and once it is destroyed. */
+        std::atomic<const dhcp::server*> m_server;
+      };
+
+      static_assert(sizeof(shard_t) == CACHE_LINE, "header of a shard fills one cache line");
+
+      static lease_store& instance();
+
+      lease_store(const lease_store& ) = delete;
+      lease_store(lease_store&& ) = delete;
+
+      /*
+       * @brief Splits the lease table, before any worker is created.
+       * @param number of shards, power of two up to MAX_SHARDS.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup(uint32_t shards);
+
+      uint32_t shards() const
+      {
+        return(m_shards);
+      }
+
+      /*
+       * @brief Shard holding the lease of a client, the kernel fanout program computes the
+       *        very same value, see mna::filter::fanout.
+       * @param pointer to 6 bytes of chaddr.
+       * @return index of shard.
+       * */
+      uint32_t shard_of(const uint8_t* chaddr) const;
+
+      shard_t& shard(uint32_t idx)
+      {
+        return(m_shard[idx & (MAX_SHARDS - 1)]);
+      }
+
+      /*
+       * @brief Server of a shard for a reader of another thread, to be used only within the
+       *        epoch::guard it was looked up in.
+       * @param index of shard.
+       * @return server, nullptr if the shard has none.
+       * */
+      const dhcp::server* server(uint32_t idx) const
+      {
+        return(m_shard[idx & (MAX_SHARDS - 1)].m_server.load());
+      }
+
+      /* Addresses handed out by every shard. */
+      ip_pool& pool()
+      {
+        return(m_pool);
+      }
+
+      /*
+       * @brief Tells the first caller to set up the pool, every other caller finds it set up.
+       * @param none
+       * @return true for the first caller.
+       * */
+      bool claim_pool()
+      {
+        return(!m_pool_claimed.exchange(true));
+      }
+
+      /* Sums up the header of every shard, relaxed loads of one cache line per shard. */
+      lease_store_stats_t stats() const;
+
+      /*
+       * @brief Copies the lease of a client from the shard holding it, from any thread and
+       *        without a lock.
+       * @param pointer to 6 bytes of chaddr.
+       * @param copy of the lease is updated.
+       * @return true if the client is known.
+       * */
+      bool read_by_mac(const uint8_t* chaddr, dhcp::lease_view_t& view) const;
+
+      /*
+       * @brief Copies the lease holding an address, every shard being looked up as the pool is
+       *        shared by all of them.
+       * @param address, host byte order.
+       * @param copy of the lease is updated.
+       * @return true if the address is handed out.
+       * */
+      bool read_by_ip(uint32_t ip, dhcp::lease_view_t& view) const;
+
+
+    private:
+      lease_store()
+      {
+        m_shards = 1;
+        m_pool_claimed = false;
+
+        for(shard_t& sh : m_shard) {
+          sh.m_leases = 0;
+          sh.m_bound = 0;
+          sh.m_cold = 0;
+          sh.m_server = nullptr;
+        }
+      }
+
+      shard_t m_shard[MAX_SHARDS];
+      uint32_t m_shards;
+      std::atomic<bool> m_pool_claimed;
+      ip_pool m_pool;
+  };
+
+}
+
+#endif /*__LEASE_STORE_H__*/
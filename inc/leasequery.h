@@ -0,0 +1,212 @@
+#ifndef __LEASEQUERY_H__
+#define __LEASEQUERY_H__
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ace/Event_Handler.h"
+#include "ace/Reactor.h"
+
+#include "protocol.h"
+
+namespace mna {
+
+  /**
+   * @brief Counters of the bulk leasequery responder.
+   * */
+  struct leasequery_stats_t {
+    /* Connections accepted. */
+    uint64_t m_connections;
+    /* Connections refused as every session was taken. */
+    uint64_t m_refused;
+    uint64_t m_queries;
+    /* DHCPLEASEACTIVE messages streamed. */
+    uint64_t m_records;
+    uint64_t m_bytes;
+    /* Times a socket was full and the stream waited for it to be writable. */
+    uint64_t m_blocked;
+  };
+
+  class leasequery;
+
+  /**
+   * @brief One TCP connection of a bulk leasequery requestor. Queries are served one after the
+   *        other, every one as a stream of DHCPLEASEACTIVE ended by DHCPLEASEQUERYDONE, every
+   *        message preceded by its length in two bytes as RFC 6926 lays out. The lease table is
+   *        walked one shard after the other, a chunk at a time from a cursor on the address, a
+   *        chunk being encoded only once the one before it is written out, so that memory held
+   *        by a stream is bounded and a slow requestor holds up nothing but itself.
+   * */
+  class leasequery_session : public ACE_Event_Handler {
+    public:
+      enum : uint32_t {
+        /* leases encoded at once. */
+        CHUNK = 256,
+        /* chunks written in one upcall before the reactor serves packets again. */
+        BURST = 4,
+        /* bytes of queries a requestor may queue up. */
+        MAX_PENDING = 64 * 1024
+      };
+
+      /* What a query asks for, RFC 6926 section 6.2. */
+      enum query_t : uint8_t {
+        QUERY_NONE = 0,
+        QUERY_BY_MAC,
+        QUERY_BY_CLIENT_ID,
+        QUERY_ALL
+      };
+
+      /* Status codes of DHCPLEASEQUERYDONE. */
+      enum status_t : uint8_t {
+        SUCCESS = 0,
+        UNSPEC_FAIL = 1,
+        QUERY_TERMINATED = 2,
+        MALFORMED_QUERY = 3,
+        NOT_ALLOWED = 4
+      };
+
+      /* dhcp-state option of a lease. */
+      enum : uint8_t {
+        STATE_ACTIVE = 2
+      };
+
+      leasequery_session(leasequery& parent, ACE_HANDLE handle);
+      leasequery_session(const leasequery_session& ) = delete;
+      leasequery_session(leasequery_session&& ) = delete;
+      virtual ~leasequery_session();
+
+      /* Reads queries, the next one starts once the stream of the one before is written out. */
+      ACE_INT32 handle_input(ACE_HANDLE handle) override;
+      /* Writes out what is encoded and encodes the next chunk, as long as the socket takes it. */
+      ACE_INT32 handle_output(ACE_HANDLE handle) override;
+      /* Hands the session back to the listener which deletes it. */
+      ACE_INT32 handle_close(ACE_HANDLE handle, ACE_Reactor_Mask mask) override;
+
+      ACE_HANDLE get_handle() const override
+      {
+        return(m_handle);
+      }
+
+      /* A stream is being encoded or written out. */
+      bool busy() const
+      {
+        return(m_active || m_sent < m_out.size());
+      }
+
+    private:
+      /* Starts the oldest complete query queued in m_in, if no stream is going on. */
+      int32_t next_query();
+      /* Parses one query, a malformed one is answered at once. */
+      void start(const uint8_t* in, uint32_t inLen);
+      /* Encodes the next chunk of the stream, DHCPLEASEQUERYDONE after the last one. */
+      void refill();
+      /* Appends DHCPLEASEACTIVE for a bound lease matching the query. */
+      void encode(const mna::dhcp::lease_view_t& lease);
+      /* Appends DHCPLEASEQUERYDONE, the status code is left out upon SUCCESS. */
+      void done(uint8_t status, const char* text);
+      /* Appends the header of a message, returns offset of its length. */
+      size_t begin(uint8_t type);
+      /* Appends one option. */
+      void put(uint8_t tag, const void* value, uint8_t len);
+      /* Fills in the length of the message begun at offset and ends its options. */
+      void end(size_t at);
+
+      leasequery& m_parent;
+      ACE_HANDLE m_handle;
+      /* queries received and not yet served. */
+      std::vector<uint8_t> m_in;
+      /* messages encoded, written out up to m_sent. */
+      std::vector<uint8_t> m_out;
+      size_t m_sent;
+      /* query being streamed. */
+      bool m_active;
+      /* requestor is done sending, the session ends with its last stream. */
+      bool m_eof;
+      query_t m_query;
+      uint32_t m_xid;
+      uint8_t m_chaddr[6];
+      std::string m_clientId;
+      /* shard being walked, the number of shards once every lease is walked. */
+      uint32_t m_shard;
+      /* next address of the shard to walk from. */
+      uint64_t m_cursor;
+      /* base-time of the stream, seconds since epoch. */
+      uint32_t m_now;
+  };
+
+  /**
+   * @brief Bulk leasequery responder of RFC 6926 listening on loopback. It runs on the reactor
+   *        of the first worker and copies leases of every shard within an epoch::guard, so the
+   *        workers owning them take no lock and are never stopped, and it is driven by
+   *        writability of every connection rather than by the size of the table, so that
+   *        packets keep being served while millions of leases stream out.
+   * */
+  class leasequery : public ACE_Event_Handler {
+    public:
+      enum : uint32_t {
+        MAX_SESSIONS = 16,
+        BACKLOG = 16
+      };
+
+      explicit leasequery(mna::dhcp::server& server) : m_server(server)
+      {
+        m_handle = ACE_INVALID_HANDLE;
+        std::memset(&m_stats, 0, sizeof(m_stats));
+      }
+
+      leasequery(const leasequery& ) = delete;
+      leasequery(leasequery&& ) = delete;
+
+      virtual ~leasequery()
+      {
+        close();
+      }
+
+      /*
+       * @brief Listens on loopback and registers with the reactor.
+       * @param reactor the listener and every session are registered with.
+       * @param TCP port, RFC 6926 assigns 67.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t open(ACE_Reactor& rctr, uint16_t port);
+
+      /* Closes the listener and every session. */
+      void close();
+
+      /* Accepts every pending connection. */
+      ACE_INT32 handle_input(ACE_HANDLE handle) override;
+
+      ACE_HANDLE get_handle() const override
+      {
+        return(m_handle);
+      }
+
+      /* A stream of some session is waiting for its socket to be writable. */
+      bool busy() const;
+
+      /* Deletes a session the reactor is done with. */
+      void closed(leasequery_session* session);
+
+      /* Server of the first worker, for what is the same in every shard. */
+      mna::dhcp::server& server()
+      {
+        return(m_server);
+      }
+
+      leasequery_stats_t& stats()
+      {
+        return(m_stats);
+      }
+
+    private:
+      mna::dhcp::server& m_server;
+      ACE_HANDLE m_handle;
+      std::vector<std::unique_ptr<leasequery_session> > m_sessions;
+      leasequery_stats_t m_stats;
+  };
+
+}
+
+#endif /*__LEASEQUERY_H__*/
@@ -0,0 +1,95 @@
+#ifndef __LOOP_H__
+#define __LOOP_H__
+
+#include <cstring>
+
+#include "ace/Reactor.h"
+#include "ace/Time_Value.h"
+
+#include "leasequery.h"
+#include "middleware.h"
+
+namespace mna {
+
+  /**
+   * @brief Counters maintained by the busy poll loop.
+   * */
+  struct loop_stats_t {
+    /* Iterations of the loop. */
+    uint64_t m_polls;
+    /* Iterations which dispatched at least one frame. */
+    uint64_t m_busy;
+    /* Number of backoff sleeps taken while idle. */
+    uint64_t m_sleeps;
+  };
+
+  /**
+   * @brief Drives one middleware with the loop selected in config. Reactor based loops register
+   *        the middleware for READ_MASK, the busy poll loop polls the socket without blocking
+   *        and expires the timer queue of reactor itself, so timers started through middleware
+   *        reach handle_timeout in every mode. The bulk leasequery responder, when configured,
+   *        is registered with the same reactor, the busy poll loop dispatches it in between
+   *        polls. The loop ends upon end_reactor_event_loop.
+   * */
+  class event_loop {
+    public:
+      enum : uint32_t {
+        /* prefixes of the pool whose utilization is logged per report at most. */
+        MAX_PREFIXES = 256
+      };
+
+      event_loop(mna::middleware& mw, ACE_Reactor& reactor) : m_mw(mw), m_reactor(reactor), m_leasequery(mw.dhcp())
+      {
+        std::memset(&m_stats, 0, sizeof(m_stats));
+        m_report = ACE_Time_Value::zero;
+      }
+
+      event_loop(const event_loop& ) = delete;
+      event_loop(event_loop&& ) = delete;
+      ~event_loop() = default;
+
+      /*
+       * @brief Creates the reactor backing the given loop, select based for busy poll loop as
+       *        it is only used for its timer queue.
+       * @param loop
+       * @return reactor owning its implementation, nullptr upon failure.
+       * */
+      static ACE_Reactor* make_reactor(loop_t loop);
+
+      /*
+       * @brief Runs the loop in calling thread until end_reactor_event_loop.
+       * @param none
+       * @return 0 upon success else < 0.
+       * */
+      int32_t run();
+
+      /* Ends the loop from any thread. */
+      void stop();
+
+      const loop_stats_t& stats() const
+      {
+        return(m_stats);
+      }
+
+    private:
+      int32_t run_reactor();
+      int32_t run_busy_poll();
+
+      /* Logs and resets the latency histogram, and logs the counters of the receive path, of
+         lease timers and of leases, every m_latency_report seconds. */
+      void report();
+
+      /* Logs the leases of the shard served within the pool subnet, and within every prefix of
+         m_utilization_prefix holding any. */
+      void report_utilization();
+
+      mna::middleware& m_mw;
+      ACE_Reactor& m_reactor;
+      mna::leasequery m_leasequery;
+      ACE_Time_Value m_report;
+      loop_stats_t m_stats;
+  };
+
+}
+
+#endif /*__LOOP_H__*/
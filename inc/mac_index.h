@@ -0,0 +1,180 @@
+#ifndef __MAC_INDEX_H__
+#define __MAC_INDEX_H__
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "epoch.h"
+
+namespace mna {
+
+  /**
+   * @brief Open addressing index of 48-bit MAC addresses to 32-bit values, laid out in the
+   *        manner of a swiss table. Slots are grouped by GROUP, every slot has one control byte
+   *        holding either EMPTY, DELETED or 7 bits of the hash of its key, and a lookup compares
+   *        the control bytes of a whole group against the hash at once before any key is read.
+   *        Keys and values are stored inline, nothing is allocated unless the table grows.
+   *        find may run on reader threads within an epoch::guard while the owner changes the
+   *        index: a slot is filled in before its control byte, the table is published as a
+   *        whole when it is rebuilt and, once given a limbo, the one it replaces is retired
+   *        rather than freed. A reader may see a value a moment stale and checks it against
+   *        what it points to.
+   * */
+  class mac_index {
+    public:
+      enum : uint32_t {
+        GROUP = 16,
+        /* value returned by find for a key not present. */
+        NIL = 0xFFFFFFFFU
+      };
+
+      mac_index()
+      {
+        m_capacity = 0;
+        m_size = 0;
+        m_growth_left = 0;
+        m_table = nullptr;
+        m_limbo = nullptr;
+      }
+
+      mac_index(const mac_index& ) = delete;
+      mac_index(mac_index&& ) = delete;
+
+      ~mac_index()
+      {
+        delete m_table;
+      }
+
+      /* Retires replaced tables through the limbo of the owner, nullptr frees them at once. */
+      void set_limbo(limbo* lb)
+      {
+        m_limbo = lb;
+      }
+
+      /* Packs the MAC into the key of the index. */
+      static uint64_t key_of(const uint8_t* mac)
+      {
+        uint64_t key = 0;
+        std::memcpy(&key, mac, 6);
+        return(key);
+      }
+
+      /*
+       * @brief Looks up the value of a key.
+       * @param key built by key_of.
+       * @return value, NIL if key is not present.
+       * */
+      uint32_t find(uint64_t key) const;
+
+      /*
+       * @brief Adds a key, the table grows once it is 7/8 full.
+       * @param key built by key_of, only its low 48 bits are kept.
+       * @param value of the key, other than NIL.
+       * @return 0 upon success else < 0 if the key is already present.
+       * */
+      int32_t insert(uint64_t key, uint32_t value);
+
+      /*
+       * @brief Removes a key.
+       * @param key built by key_of.
+       * @return 0 upon success else < 0 if the key is not present.
+       * */
+      int32_t erase(uint64_t key);
+
+      /* Sizes the table to hold count keys without growing. */
+      void reserve(uint64_t count);
+      void clear();
+
+      uint64_t size() const
+      {
+        return(m_size);
+      }
+
+      uint64_t capacity() const
+      {
+        return(m_capacity);
+      }
+
+      /* Bytes held by the table. */
+      uint64_t bytes() const
+      {
+        return(m_capacity * (sizeof(int8_t) + sizeof(slot_t)));
+      }
+
+    private:
+      /* control byte of a slot never used and of a slot whose key was erased. */
+      static const int8_t EMPTY = -128;
+      static const int8_t DELETED = -2;
+
+      /* packed with the 48 bits of the key only, a slot costs 10 bytes rather than 16. */
+      struct slot_t {
+        uint32_t m_key_lo;
+        uint16_t m_key_hi;
+        uint32_t m_value;
+
+        uint64_t key() const
+        {
+          return((static_cast<uint64_t>(m_key_hi) << 32) | m_key_lo);
+        }
+
+        void set_key(uint64_t key)
+        {
+          m_key_lo = static_cast<uint32_t>(key & 0xFFFFFFFFU);
+          m_key_hi = static_cast<uint16_t>((key >> 32) & 0xFFFF);
+        }
+      } __attribute__((packed));
+
+      /* Control bytes and slots, replaced as a whole. */
+      struct table_t {
+        explicit table_t(uint64_t capacity) : m_ctrl(new int8_t[capacity]), m_slots(new slot_t[capacity])
+        {
+          m_mask = (capacity / GROUP) - 1;
+        }
+
+        /* number of groups less one. */
+        uint64_t m_mask;
+        std::unique_ptr<int8_t[]> m_ctrl;
+        std::unique_ptr<slot_t[]> m_slots;
+      };
+
+      static uint64_t hash(uint64_t key)
+      {
+        /* finalizer of murmur3, every bit of the MAC reaches the low 7 bits and the group. */
+        key ^= key >> 33;
+        key *= 0xFF51AFD7ED558CCDULL;
+        key ^= key >> 33;
+        key *= 0xC4CEB9FE1A85EC53ULL;
+        key ^= key >> 33;
+        return(key);
+      }
+
+      /* Bit n of the result is set if control byte n of the group equals h2. */
+      static uint32_t match(const table_t& tbl, uint64_t group, int8_t h2);
+      /* Bit n of the result is set if slot n of the group is EMPTY. */
+      static uint32_t match_empty(const table_t& tbl, uint64_t group);
+      /* Bit n of the result is set if slot n of the group is EMPTY or DELETED. */
+      static uint32_t match_free(const table_t& tbl, uint64_t group);
+
+      /* Returns the slot of the key, NIL if not present. */
+      static uint64_t locate(const table_t& tbl, uint64_t key);
+      /* Returns the first free slot along the probe sequence of the hash. */
+      static uint64_t free_slot(const table_t& tbl, uint64_t h);
+      void rehash(uint64_t capacity);
+      /* Frees a retired table, uintptr_t being the table. */
+      void free_table(uintptr_t tbl);
+
+      /* published with a release store, read by readers with an acquire load. */
+      table_t* m_table;
+      /* number of slots, power of two and multiple of GROUP. */
+      uint64_t m_capacity;
+      uint64_t m_size;
+      /* keys which can be added before the table grows, DELETED slots count as used. */
+      uint64_t m_growth_left;
+      /* nullptr unless the index is read by other threads. */
+      limbo* m_limbo;
+  };
+
+}
+
+#endif /*__MAC_INDEX_H__*/
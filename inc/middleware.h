@@ -2,8 +2,11 @@
 #define __MIDDLEWARE_H__
 
 #include <fcntl.h>
+#include <utility>
+#include <vector>
 #include <sys/un.h>
 #include <sys/ioctl.h>
+#include <linux/sockios.h>
 #include <linux/if_packet.h>
 
 #include "ace/Reactor.h"
@@ -18,6 +21,16 @@
 
 #include "protocol.h"
 #include "delegate.hpp"
+#include "ring.h"
+#include "batch.h"
+#include "filter.h"
+#include "xdp.h"
+#include "pool.h"
+#include "latency.h"
+#include "capture.h"
+#include "tap.h"
+#include "wheel.h"
+#include "journal.h"
 
 namespace mna {
 
@@ -26,6 +39,184 @@ namespace mna {
     SIZE_1MB = (SIZE_1KB * SIZE_1KB),
     ETH_ALEN = 6,
     ETH_P_ALL = 0x0003,
+    /* Room left in front of a response for ethernet, IP and UDP header. */
+    TX_HEADROOM = sizeof(mna::eth::ETH) + sizeof(mna::ipv4::IP) + sizeof(mna::transport::UDP),
+  };
+
+  /**
+   * @brief Event loop driving the middleware.
+   * */
+  enum loop_t : uint8_t {
+    /* ACE_Select_Reactor, one frame per upcall. */
+    LOOP_SELECT = 0,
+    /* ACE_Dev_Poll_Reactor (epoll), socket is drained until empty in one upcall. */
+    LOOP_EPOLL = 1,
+    /* Run to completion, socket is polled without blocking with SO_BUSY_POLL. */
+    LOOP_BUSY_POLL = 2
+  };
+
+  /**
+   * @brief Tunables for the middleware, populated from command line in main.
+   * */
+  struct config_t {
+    /* Receive through PACKET_RX_RING (TPACKET_V3) instead of one recv per frame. */
+    bool m_rx_ring;
+    /* Size of one ring block in bytes, multiple of page size. */
+    uint32_t m_rx_block_size;
+    /* Number of blocks in the ring. */
+    uint32_t m_rx_block_count;
+    /* Size of one frame slot in bytes. */
+    uint32_t m_rx_frame_size;
+    /* Timeout in ms after which a partially filled block is handed to user space. */
+    uint32_t m_rx_block_timeout;
+    /* Transmit through PACKET_TX_RING instead of one send per frame. */
+    bool m_tx_ring;
+    /* Size of one transmit ring block in bytes, multiple of page size. */
+    uint32_t m_tx_block_size;
+    /* Number of blocks in the transmit ring. */
+    uint32_t m_tx_block_count;
+    /* Size of one transmit slot in bytes. */
+    uint32_t m_tx_frame_size;
+    /* Frames drained per wakeup with recvmmsg and sent with sendmmsg, < 2 disables batching. */
+    uint32_t m_batch;
+    /* Drop frames of no enabled handler in kernel with a BPF socket filter. */
+    bool m_filter;
+    /* Number of worker threads, each owning a socket of one PACKET_FANOUT group. */
+    uint32_t m_workers;
+    /* PACKET_FANOUT group id shared by sockets of every worker. */
+    uint16_t m_fanout_group;
+    /* Receive and transmit through an AF_XDP socket instead of PF_PACKET. */
+    bool m_xdp;
+    /* Queue of the interface the AF_XDP socket is bound to. */
+    uint32_t m_xdp_queue;
+    /* Number of UMEM frames, half for receive and half for transmit. */
+    uint32_t m_xdp_frames;
+    /* Number of 2KB buffers of the packet pool shared by every worker. */
+    uint32_t m_pool_buffers;
+    /* Back the packet pool with hugepages. */
+    bool m_pool_hugepage;
+    /* Event loop of every worker. */
+    loop_t m_loop;
+    /* SO_BUSY_POLL in us for the busy poll loop. */
+    uint32_t m_busy_poll_us;
+    /* Empty polls after which the busy poll loop starts backing off. */
+    uint32_t m_busy_spin;
+    /* Upper bound in us of the backoff sleep of busy poll loop. */
+    uint32_t m_busy_max_sleep_us;
+    /* Interval in seconds of request to reply latency report, 0 disables measurement. */
+    uint32_t m_latency_report;
+    /* pcap/pcapng file replayed instead of opening the interface. */
+    std::string m_replay;
+    /* pcap file receiving the replies produced while replaying. */
+    std::string m_replay_out;
+    /* Replay at capture timestamps scaled by this factor, 0 replays as fast as possible. */
+    double m_replay_speed;
+    /* Path prefix of the rotating pcapng files of capture tap, empty disables the tap. */
+    std::string m_tap;
+    /* Records held by the tap ring of every middleware. */
+    uint32_t m_tap_slots;
+    /* Bytes kept of every frame by the tap, 0 keeps whole frames. */
+    uint32_t m_tap_snaplen;
+    /* Size in MB after which the tap moves on to next file. */
+    uint32_t m_tap_file_mb;
+    /* Number of tap files kept, 0 keeps every file. */
+    uint32_t m_tap_files;
+    /* Client MAC traced by the tap, all zero traces every frame. */
+    std::array<uint8_t, 6> m_tap_mac;
+    /* Resolution in ms of the timing wheel, the reactor ticks it at this interval. */
+    uint32_t m_wheel_tick_ms;
+    /* Timers preallocated in the timing wheel of every middleware. */
+    uint32_t m_wheel_timers;
+    /* Expiries dispatched per sweep of the timing wheel before packets are served again, 0 for no limit. */
+    uint32_t m_sweep_budget;
+    /* Time in us one sweep may take before packets are served again, 0 for no limit. */
+    uint32_t m_sweep_budget_us;
+    /* Subnet addresses are handed out of, host byte order. */
+    uint32_t m_pool_subnet;
+    /* Length of prefix of the subnet. */
+    uint32_t m_pool_prefix;
+    /* First and last address of ranges handed out, every host address of the subnet if empty. */
+    std::vector<std::pair<uint32_t, uint32_t> > m_pool_ranges;
+    /* First and last address of ranges never handed out. */
+    std::vector<std::pair<uint32_t, uint32_t> > m_pool_exclusions;
+    /* Address kept for one client. */
+    std::vector<std::pair<std::array<uint8_t, 6>, uint32_t> > m_pool_reservations;
+    /* Length of the prefixes of the pool utilization is reported per, 0 for the subnet as a whole. */
+    uint32_t m_utilization_prefix;
+    /* Path of the lease journal, empty keeps leases in memory only. */
+    std::string m_journal;
+    /* Records held by the journal ring of every middleware. */
+    uint32_t m_journal_slots;
+    /* Time in us the journal writer idles when nothing is pending, bounds the commit delay. */
+    uint32_t m_journal_sync_us;
+    /* Records the journal holds before the bindings are snapshot and it is cut, 0 never cuts it. */
+    uint64_t m_journal_compact;
+    /* Back the slabs of leases with hugepages. */
+    bool m_lease_hugepage;
+    /* TCP port on loopback of the bulk leasequery responder, 0 for none. */
+    uint16_t m_leasequery_port;
+    /* Shard of the lease table served, the id of the worker. */
+    uint32_t m_shard;
+
+    config_t()
+    {
+      m_rx_ring = false;
+      m_rx_block_size = 128 * SIZE_1KB;
+      m_rx_block_count = 32;
+      m_rx_frame_size = 2 * SIZE_1KB;
+      m_rx_block_timeout = 4;
+      m_tx_ring = false;
+      m_tx_block_size = 64 * SIZE_1KB;
+      m_tx_block_count = 16;
+      m_tx_frame_size = 2 * SIZE_1KB;
+      m_batch = 0;
+      m_filter = true;
+      m_workers = 1;
+      m_fanout_group = 0;
+      m_xdp = false;
+      m_xdp_queue = 0;
+      m_xdp_frames = 4096;
+      m_pool_buffers = 4096;
+      m_pool_hugepage = false;
+      m_loop = LOOP_SELECT;
+      m_busy_poll_us = 50;
+      m_busy_spin = 10000;
+      m_busy_max_sleep_us = 500;
+      m_latency_report = 0;
+      m_replay_speed = 0;
+      m_tap_slots = 4096;
+      m_tap_snaplen = 128;
+      m_tap_file_mb = 64;
+      m_tap_files = 8;
+      m_tap_mac.fill(0);
+      m_wheel_tick_ms = 100;
+      m_wheel_timers = 64 * SIZE_1KB;
+      m_sweep_budget = SIZE_1KB;
+      m_sweep_budget_us = 500;
+      /* 192.168.1.0/24 */
+      m_pool_subnet = 0xC0A80100U;
+      m_pool_prefix = 24;
+      m_utilization_prefix = 0;
+      m_journal_slots = 16 * SIZE_1KB;
+      m_journal_sync_us = 200;
+      /* replay of 1M records upon startup takes well under a second. */
+      m_journal_compact = SIZE_1KB * SIZE_1KB;
+      m_lease_hugepage = false;
+      m_leasequery_port = 0;
+      m_shard = 0;
+    }
+  };
+
+  /**
+   * @brief Outcome of a replay.
+   * */
+  struct replay_stats_t {
+    /* Frames read from capture and dispatched to rx. */
+    uint64_t m_frames;
+    /* Frames transmitted in reply. */
+    uint64_t m_replies;
+    /* Wall clock time of the replay. */
+    uint64_t m_elapsed_ns;
   };
 
   class middleware : public ACE_Event_Handler {
@@ -35,13 +226,28 @@ namespace mna {
       using upstream_delegate_t = delegate<int32_t (const uint8_t*, uint32_t)>;
 
       /** This ctor is invoked when instantiated with non-const string.*/
-      middleware(std::string& intf)
+      middleware(std::string& intf, const config_t& cfg = config_t())
       {
         m_intf = std::move(intf);
+        m_config = cfg;
+        m_ring_base = nullptr;
+        m_ring_len = 0;
+        m_tx_pkt = nullptr;
+        m_rx_stamp = 0;
+        m_pkt_stamp = 0;
+        m_tx_stamps.reserve(SIZE_1KB);
         m_to_dispatch.reset();
         m_rx_dispatch.reset();
         m_tid = 0;
-        m_handle = open_and_bind_intf();
+        m_capture_stamp = 0;
+        std::memset(&m_replay_stats, 0, sizeof(m_replay_stats));
+        m_handle = m_config.m_replay.empty() ? open_and_bind_intf() : open_capture();
+        /* nullptr unless capture tap is set up. */
+        m_tap = mna::capture_tap::instance().attach();
+        /* nullptr unless lease journal is set up. */
+        m_journal = mna::lease_journal::instance().attach();
+        m_wheel.setup(m_config.m_wheel_timers, m_config.m_wheel_tick_ms);
+        m_tick_id = -1;
 
         /*Creating the instance of respective protocol layer.*/
         ACE_NEW_NORETURN(m_s, mna::dhcp::server());
@@ -49,22 +255,42 @@ namespace mna {
         ACE_NEW_NORETURN(m_ip, mna::ipv4::ip());
         ACE_NEW_NORETURN(m_et, mna::eth::ether(m_intf.c_str()));
 
+        connect_downstream();
+        restore_leases();
       }
 
       /** This ctor will be invoked when instantiated with const string.*/
-      middleware(std::string&& intf)
+      middleware(std::string&& intf, const config_t& cfg = config_t())
       {
         m_intf = intf;
+        m_config = cfg;
+        m_ring_base = nullptr;
+        m_ring_len = 0;
+        m_tx_pkt = nullptr;
+        m_rx_stamp = 0;
+        m_pkt_stamp = 0;
+        m_tx_stamps.reserve(SIZE_1KB);
         m_to_dispatch.reset();
         m_rx_dispatch.reset();
         m_tid = 0;
-        m_handle = open_and_bind_intf();
+        m_capture_stamp = 0;
+        std::memset(&m_replay_stats, 0, sizeof(m_replay_stats));
+        m_handle = m_config.m_replay.empty() ? open_and_bind_intf() : open_capture();
+        /* nullptr unless capture tap is set up. */
+        m_tap = mna::capture_tap::instance().attach();
+        /* nullptr unless lease journal is set up. */
+        m_journal = mna::lease_journal::instance().attach();
+        m_wheel.setup(m_config.m_wheel_timers, m_config.m_wheel_tick_ms);
+        m_tick_id = -1;
 
         /*Creating the instance of respective protocol layer.*/
         ACE_NEW_NORETURN(m_s, mna::dhcp::server());
         ACE_NEW_NORETURN(m_udp, mna::transport::udp());
         ACE_NEW_NORETURN(m_ip, mna::ipv4::ip());
         ACE_NEW_NORETURN(m_et, mna::eth::ether(m_intf.c_str()));
+
+        connect_downstream();
+        restore_leases();
       }
 
       middleware(const middleware& ) = default;
@@ -72,6 +298,8 @@ namespace mna {
 
       virtual ~middleware()
       {
+        unmap_rings();
+        mna::pkt_pool::instance().free(m_tx_pkt);
         delete m_s;
         delete m_udp;
         delete m_ip;
@@ -83,10 +311,49 @@ namespace mna {
       ACE_HANDLE handle_timeout(const ACE_Time_Value &tv, const void *act=0) override;
       ACE_HANDLE get_handle(void) const override;
 
+      /*
+       * @brief This member function receives whatever is pending on the socket through the
+       *        active backend without blocking, dispatches it upstream and flushes the replies.
+       * @param handle of socket.
+       * @return number of frames dispatched, 0 when nothing was pending.
+       * */
+      int32_t receive(ACE_HANDLE handle);
+
       long start_timer(ACE_UINT32 delay, const void *act, ACE_Time_Value interval = ACE_Time_Value::zero);
       long start_timer(ACE_UINT32 delay, const void *act, bool periodicity);
+      long start_timer(ACE_UINT32 delay, timer_token_t token, bool periodicity);
       void stop_timer(long timerId);
-      void reset_timer(long tId, ACE_UINT32 timeOutInSec);
+      /*
+       * @brief Moves a running timer to expire timeOutInSec from now, its node and id are kept.
+       * @param id returned by start_timer.
+       * @param new duration of the timer.
+       * @return 0 upon success else < 0 if the timer has expired or was stopped.
+       * */
+      int32_t reset_timer(long tId, ACE_UINT32 timeOutInSec);
+
+      /*
+       * @brief These member functions schedule/cancel the periodic reactor timer which advances
+       *        the timing wheel, invoked by the event loop once the reactor is known.
+       * @param none
+       * @return 0 upon success else < 0.
+       * */
+      int32_t start_tick();
+      void stop_tick();
+
+      /*
+       * @brief This member function dispatches lease timers due by now within the sweep budget,
+       *        expiries left over are dispatched by next sweep. Invoked upon every tick and by
+       *        the event loop between packets while a backlog is left.
+       * @param none
+       * @return number of timers dispatched.
+       * */
+      uint32_t sweep();
+
+      /* Returns true if due timers are waiting for next sweep. */
+      bool sweep_pending() const
+      {
+        return(m_wheel.backlog() > 0);
+      }
 
       long process_timeout(const void *act);
       /*
@@ -96,10 +363,59 @@ namespace mna {
        * */
       ACE_HANDLE open_and_bind_intf();
 
+      /*
+       * @brief This member function opens the output of replay in place of the interface.
+       * @param none
+       * @return ACE_INVALID_HANDLE as no socket is opened.
+       * */
+      ACE_HANDLE open_capture();
+
+      /*
+       * @brief This member function feeds every frame of the source to rx, as fast as possible
+       *        or paced by capture timestamps scaled by m_replay_speed, and reports packets/sec
+       *        every second. Timers started meanwhile are expired by this loop.
+       * @param source of frames.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t replay(capture_source& src);
+
+      /*
+       * @brief This member function maps the rings requested on the socket into user space.
+       * @param handle of PF_PACKET socket.
+       * @return 0 upon success else < 0.
+       * */
+      ACE_INT32 map_rings(ACE_HANDLE handle);
+      void unmap_rings();
+
       ACE_INT32 get_index();
+      ACE_INT32 get_mac(std::array<uint8_t, 6>& mac);
+      ACE_INT32 get_ip(uint32_t& ip);
+
+      /*
+       * @brief This member function connects the transmit path of protocol layers,
+       *        dhcp -> udp -> ip -> ether -> middleware.
+       * @param none
+       * @return none
+       * */
+      void connect_downstream();
+
+      /*
+       * @brief This member function sets up the address pool of dhcp server from the configuration,
+       *        address of the interface is never handed out. The pool is shared by every shard,
+       *        the first middleware sets it up and the others only size their index on address.
+       * @param address of the interface in network byte order, 0 if it has none.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup_pool(uint32_t localIP);
 
       static middleware* instance();
 
+      /* Reactor this handler is registered with, the singleton until then. */
+      ACE_Reactor* get_reactor() const
+      {
+        return(reactor() ? reactor() : ACE_Reactor::instance());
+      }
+
       void set_timer_dispatch(timer_delegate_t tmr)
       {
         m_to_dispatch = tmr;
@@ -120,8 +436,34 @@ namespace mna {
         m_rx_dispatch = rx;
       }
 
+      /*
+       * @brief These member functions add/remove a handler to/from the socket filter, the
+       *        filter is regenerated and attached again whenever the set changes. The DHCP
+       *        server is the only handler of this tree and is enabled when the socket is
+       *        opened, so nothing calls them yet.
+       * @param handler to be enabled/disabled.
+       * @return 0 upon success else < 0.
+       * */
+      ACE_INT32 enable_handler(const match_t& m);
+      ACE_INT32 disable_handler(const match_t& m);
+
+      /* Reads PACKET_STATISTICS and returns the accumulated counters, nothing is read unless
+         frames come through a PF_PACKET socket. */
+      const filter_stats_t& filter_stats()
+      {
+        return(packet_socket() ? m_filter.update(m_handle) : m_filter.stats());
+      }
+
+      /* Frames come through a PF_PACKET socket rather than AF_XDP or a replayed capture. */
+      bool packet_socket() const
+      {
+        return(ACE_INVALID_HANDLE != m_handle && !m_xdp.is_open());
+      }
+
       int32_t rx(const uint8_t*, uint32_t);
       int32_t tx(uint8_t*, uint32_t);
+      uint8_t* tx_buffer(uint32_t& capacity);
+      uint32_t flush();
 
       mna::dhcp::server& dhcp() const
       {
@@ -143,15 +485,166 @@ namespace mna {
         return(*m_et);
       }
 
+      const config_t& config() const
+      {
+        return(m_config);
+      }
+
+      const rx_ring_stats_t& rx_ring_stats() const
+      {
+        return(m_rx_ring.stats());
+      }
+
+      /* Frames are received from the TPACKET_V3 ring. */
+      bool rx_ring_attached() const
+      {
+        return(m_rx_ring.is_attached());
+      }
+
+      const tx_ring_stats_t& tx_ring_stats() const
+      {
+        return(m_tx_ring.stats());
+      }
+
+      /* Responses are sent through the PACKET_TX_RING. */
+      bool tx_ring_attached() const
+      {
+        return(m_tx_ring.is_attached());
+      }
+
+      const mmsg_stats_t& batch_stats() const
+      {
+        return(m_batch.stats());
+      }
+
+      /* Frames are received with recvmmsg and replies sent with sendmmsg. */
+      bool batch_enabled() const
+      {
+        return(m_batch.is_enabled());
+      }
+
+      /* Reads XDP_STATISTICS and returns the counters of the AF_XDP socket. */
+      const xdp_stats_t& xdp_stats()
+      {
+        return(m_xdp.stats());
+      }
+
+      /* Frames come through the AF_XDP socket. */
+      bool xdp_open() const
+      {
+        return(m_xdp.is_open());
+      }
+
+      pool_stats_t pool_stats() const
+      {
+        return(mna::pkt_pool::instance().stats());
+      }
+
+      const replay_stats_t& replay_stats() const
+      {
+        return(m_replay_stats);
+      }
+
+      const wheel_stats_t& wheel_stats() const
+      {
+        return(m_wheel.stats());
+      }
+
+      /*
+       * @brief Leases of the server, bytes include the timers of the wheel.
+       * @param none
+       * @return counters of leases.
+       * */
+      mna::slab_stats_t entry_stats() const
+      {
+        return(dhcp().entry_stats());
+      }
+
+      mna::dhcp::lease_stats_t lease_stats() const
+      {
+        mna::dhcp::lease_stats_t st = dhcp().stats();
+
+        st.m_bytes += m_wheel.bytes();
+        return(st);
+      }
+
+      /*
+       * @brief Appends a change of a lease to the journal ring of this middleware.
+       * @param lease_record_t::type_t of the change.
+       * @param chaddr of client.
+       * @param address of client, host byte order.
+       * @param lease in seconds.
+       * @return none
+       * */
+      void journal(uint8_t type, const uint8_t* chaddr, uint32_t ip, uint32_t lease);
+
+      /*
+       * @brief Brings back the bindings replayed from the lease journal whose lease has not run out.
+       * @param none
+       * @return number of bindings restored.
+       * */
+      uint32_t restore_leases();
+
+      /* Frames the capture tap missed as its ring was full. */
+      uint64_t tap_drops() const
+      {
+        return(m_tap ? m_tap->drops() : 0);
+      }
+
+      /* Request to reply latency, populated when latency report is enabled in config. */
+      latency_histogram& latency()
+      {
+        return(m_latency);
+      }
+
     private:
 
+      /* Receive time of the frame being dispatched, kernel timestamp when backend has one. */
+      uint64_t rx_stamp();
+      /* Records latency of every reply flushed since previous flush. */
+      void record_latency();
+
       middleware() = default;
       static middleware* m_instance;
       std::string m_intf;
       /*! socket fd */
       ACE_HANDLE m_handle;
-      /*! UDP Socket */
-      ACE_SOCK_Dgram m_sock_dgram;
+      config_t m_config;
+      /*! TPACKET_V3 receive ring, attached only when enabled in config. */
+      rx_ring m_rx_ring;
+      /*! PACKET_TX_RING, attached only when enabled in config. */
+      tx_ring m_tx_ring;
+      /*! BPF socket filter built from enabled handlers. */
+      filter m_filter;
+      /*! recvmmsg/sendmmsg batch, used when rings are not in place. */
+      mmsg_batch m_batch;
+      /*! AF_XDP socket, replaces PF_PACKET socket when enabled in config. */
+      xdp m_xdp;
+      /*! Pool buffer of the response when neither transmit ring nor batch is in place. */
+      uint8_t* m_tx_pkt;
+      /*! Receive time in ns of the request being processed, 0 outside of a request. */
+      uint64_t m_rx_stamp;
+      /*! Kernel receive time in ns of the frame read with recv, 0 if not known. */
+      uint64_t m_pkt_stamp;
+      /*! Receive time of the request of every reply queued since last flush. */
+      std::vector<uint64_t> m_tx_stamps;
+      latency_histogram m_latency;
+      /*! Replies produced while replaying, written in place of being sent. */
+      pcap_sink m_sink;
+      /*! Capture time of the frame being replayed. */
+      uint64_t m_capture_stamp;
+      replay_stats_t m_replay_stats;
+      /*! Ring of the capture tap, nullptr when tap is off. */
+      tap_ring* m_tap;
+      /*! Ring of lease journal, nullptr if it is not set up. */
+      journal_ring* m_journal;
+      /*! Timers started through start_timer, dispatched to m_to_dispatch upon expiry. */
+      timing_wheel m_wheel;
+      /*! Reactor timer advancing the wheel, < 0 while not scheduled. */
+      long m_tick_id;
+      /*! mmap'd region holding the packet rings. */
+      uint8_t* m_ring_base;
+      size_t m_ring_len;
       /* upstream interface to */
       upstream_delegate_t m_rx_dispatch;
       /*! runnining number for timerID */
@@ -0,0 +1,115 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <atomic>
+#include <memory>
+
+#include "ace/Basic_Types.h"
+
+namespace mna {
+
+  /**
+   * @brief Snapshot of the counters maintained by the packet buffer pool.
+   * */
+  struct pool_stats_t {
+    /* Number of buffers carved out at startup. */
+    uint32_t m_buffers;
+    /* Buffers handed out and not yet returned. */
+    uint32_t m_in_use;
+    /* Largest number of buffers in use at once since startup. */
+    uint32_t m_high_water;
+    /* Number of alloc which found the pool empty. */
+    uint64_t m_exhausted;
+    /* Pool is backed by hugepages. */
+    bool m_hugepage;
+  };
+
+  /**
+   * @brief Fixed-size packet buffers carved out of one mapping at startup, nothing is allocated
+   *        on the heap afterwards. Free buffers form a lock-free stack whose head carries a tag
+   *        against ABA, so buffers can be allocated and freed from any worker thread. A buffer
+   *        is BUFFER_SIZE bytes, aligned to cache line, of which the first HEADROOM bytes are
+   *        left for headers to be prepended.
+   * */
+  class pkt_pool {
+    public:
+      enum : uint32_t {
+        BUFFER_SIZE = 2048,
+        HEADROOM = 128,
+        CACHE_LINE = 64,
+        NIL = 0xFFFFFFFFU
+      };
+
+      pkt_pool()
+      {
+        m_base = nullptr;
+        m_len = 0;
+        m_count = 0;
+        m_hugepage = false;
+        m_head.store(NIL);
+        m_in_use.store(0);
+        m_high_water.store(0);
+        m_exhausted.store(0);
+      }
+
+      pkt_pool(const pkt_pool& ) = delete;
+      pkt_pool(pkt_pool&& ) = delete;
+
+      ~pkt_pool()
+      {
+        release();
+      }
+
+      /*
+       * @brief Maps and carves out the buffers, hugepages are used when asked for and available.
+       *        A pool already set up is left as is.
+       * @param number of buffers.
+       * @param true to back the pool with hugepages.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup(uint32_t count, bool hugepage);
+
+      /*
+       * @brief Pops a buffer off the free stack.
+       * @param none
+       * @return start of buffer, data begins HEADROOM bytes into it, nullptr when pool is empty.
+       * */
+      uint8_t* alloc();
+
+      /*
+       * @brief Pushes a buffer back to the free stack.
+       * @param any pointer into the buffer, e.g. past the headroom.
+       * @return none
+       * */
+      void free(const uint8_t* buf);
+
+      /* Returns true if pointer lies in one of the buffers of the pool. */
+      bool owns(const uint8_t* buf) const
+      {
+        return(m_base && buf >= m_base && buf < (m_base + (static_cast<size_t>(m_count) * BUFFER_SIZE)));
+      }
+
+      pool_stats_t stats() const;
+
+      /* Pool shared by every middleware and protocol layer of the process. */
+      static pkt_pool& instance();
+
+    private:
+      void release();
+
+      uint8_t* m_base;
+      size_t m_len;
+      uint32_t m_count;
+      bool m_hugepage;
+      /* index of next free buffer, one per buffer. */
+      std::unique_ptr<std::atomic<uint32_t>[]> m_next;
+      /* tag in upper half, index of top buffer in lower half. */
+      alignas(CACHE_LINE) std::atomic<uint64_t> m_head;
+      alignas(CACHE_LINE) std::atomic<uint32_t> m_in_use;
+      std::atomic<uint32_t> m_high_water;
+      std::atomic<uint64_t> m_exhausted;
+  };
+
+}
+
+#endif /*__POOL_H__*/
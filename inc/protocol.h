@@ -4,106 +4,116 @@
 #include <iostream>
 #include <delegate.hpp>
 #include <array>
-#include <unordered_map>
+#include <memory>
+#include <string>
+#include <vector>
 #include <algorithm>
 #include <cstring>
 #include <arpa/inet.h>
 
+#include "epoch.h"
+#include "ip_index.h"
+#include "ip_pool.h"
+#include "journal.h"
+#include "lease_store.h"
+#include "mac_index.h"
+#include "slab.h"
+#include "wheel.h"
+
 namespace mna {
+  /**
+   * @brief State machine of one client, a single pointer to the table of the current state.
+   *        Every state class provides receive, onEntry and onExit and is a singleton, the table
+   *        of a class is built once from its instance and shared by every machine in that
+   *        state, so a machine is allocated along with its owner and costs no heap.
+   * */
   class FSM {
 
     public:
-      /* Type Aliasing */
       /**
        * @brief : parent is the instance of a class that instantiating this FSM.
        *          the next argument is the received requiest buffer and the last
        *          argument is the length of received request.
        * */
-      using receive_delegate_t = delegate<int32_t (void* parent, const uint8_t*, uint32_t)>;
-      using state_delegate_t = delegate<void (void* parent)>;
+      using receive_t = int32_t (*)(void* inst, void* parent, const uint8_t*, uint32_t);
+      using state_t = void (*)(void* inst, void* parent);
 
-      FSM(void* parent)
+      struct ops_t {
+        void* m_inst;
+        receive_t m_receive;
+        state_t m_on_entry;
+        state_t m_on_exit;
+      };
+
+      FSM()
       {
-        on_receive.reset();
-        on_exit.reset();
-        on_entry.reset();
-        m_parent = parent;
+        m_ops = nullptr;
       }
 
       FSM(const FSM& fsm) = default;
       FSM(FSM&& fsm) = default;
-
-      FSM& operator=(const FSM& fsm)
-      {
-        on_receive = fsm.on_receive;
-        on_exit = fsm.on_exit;
-        on_entry = fsm.on_entry;
-        return(*this);
-      }
-
-      ~FSM()
-      {
-        on_receive.reset();
-        on_exit.reset();
-        on_entry.reset();
-        m_parent = nullptr;
-      }
+      FSM& operator=(const FSM& fsm) = default;
+      ~FSM() = default;
 
       /**
-       * @brief This member function is used to set the State in FSM. This member function accepts the instance of a class
-       *        and that class has to define receive as well as onEntry and onExit member function.Those member functions
-       *        are assigned to delegate.
+       * @brief This member function is used to set the State in FSM. The current state is exited
+       *        and the state of the class of inst is entered.
+       * @param pointer to parent who has instantiated the FSM class.
        * @param reference to an instance to the class
        * @return none.
        * */
       template<typename C>
-      void setState(C& inst)
+      void setState(void* parent, C& inst)
       {
-        if(on_receive && on_exit) {
+        static const ops_t ops = {&inst, &receive_stub<C>, &entry_stub<C>, &exit_stub<C>};
+
+        if(m_ops) {
           /* invoking upon state exit */
-          on_exit(m_parent);
-          on_exit.reset();
-          on_receive.reset();
-          on_entry.reset();
+          m_ops->m_on_exit(m_ops->m_inst, parent);
         }
 
-        /* assigning the respective delegates */
-        on_receive = receive_delegate_t::from<C, &C::receive>(inst);
-        on_exit = state_delegate_t::from<C, &C::onExit>(inst);
-        on_entry = state_delegate_t::from<C, &C::onEntry>(inst);
+        m_ops = &ops;
 
         /* invoking upon state entry */
-        on_entry(m_parent);
+        m_ops->m_on_entry(m_ops->m_inst, parent);
       }
 
       /**
-       * @brief This member function is used to get the reference of the instance of state class. The state is represented
-       *        calss and that class has to  implement certain member method.
-       * @param none
-       * @return Reference to FSM instance.
-       * */
-      FSM& getState()
-      {
-        return(*this);
-      }
-
-      /**
-       * @brief This member function is invoked from respective state which inturn invokes delegates.
+       * @brief This member function is invoked from respective state which inturn invokes receive of it.
        * @param pointer to parent who has instantiated the FSM class.
        * @param pointer to const char of input buffer.
        * @param length of received length.
-       * @return whatever deledagte returns.
+       * @return whatever receive of the state returns, < 0 if no state is entered yet.
        * */
-      int32_t rx(const uint8_t* inPtr, uint32_t inLen) const
+      int32_t rx(void* parent, const uint8_t* inPtr, uint32_t inLen) const
       {
-        return(on_receive(m_parent, inPtr, inLen));
+        if(!m_ops) {
+          return(-1);
+        }
+
+        return(m_ops->m_receive(m_ops->m_inst, parent, inPtr, inLen));
       }
 
-      private:
-        receive_delegate_t on_receive;
-        state_delegate_t on_entry;
-        state_delegate_t on_exit;
-        void* m_parent;
+    private:
+      template<typename C>
+      static int32_t receive_stub(void* inst, void* parent, const uint8_t* inPtr, uint32_t inLen)
+      {
+        return(static_cast<C*>(inst)->receive(parent, inPtr, inLen));
+      }
+
+      template<typename C>
+      static void entry_stub(void* inst, void* parent)
+      {
+        static_cast<C*>(inst)->onEntry(parent);
+      }
+
+      template<typename C>
+      static void exit_stub(void* inst, void* parent)
+      {
+        static_cast<C*>(inst)->onExit(parent);
+      }
+
+      const ops_t* m_ops;
   };
 
   namespace eth {
@@ -135,6 +145,7 @@ namespace mna {
         {
           m_src_mac.fill(0);
           m_dst_mac.fill(0);
+          m_intf_mac.fill(0);
         }
 
         ether(const ether& ) = default;
@@ -154,6 +165,22 @@ namespace mna {
           return(m_upstream);
         }
 
+        void set_downstream(downstream_t ds)
+        {
+          m_downstream = ds;
+        }
+
+        /* MAC address of the interface, used as source of outgoing frames. */
+        void intf_mac(std::array<uint8_t, 6> mac)
+        {
+          m_intf_mac = mac;
+        }
+
+        std::array<uint8_t, 6>& intf_mac()
+        {
+          return(m_intf_mac);
+        }
+
         void src_mac(std::array<uint8_t, 6> smac)
         {
           m_src_mac = smac;
@@ -191,6 +218,7 @@ namespace mna {
         uint32_t m_index;
         std::array<uint8_t, 6> m_src_mac;
         std::array<uint8_t, 6> m_dst_mac;
+        std::array<uint8_t, 6> m_intf_mac;
     };
 
   }
@@ -226,7 +254,13 @@ namespace mna {
         using upstream_t = delegate<int32_t (const uint8_t*, uint32_t)>;
         using downstream_t = delegate<int32_t (uint8_t*, uint32_t)>;
 
-        ip() = default;
+        ip()
+        {
+          m_src_ip = 0;
+          m_dst_ip = 0;
+          m_local_ip = 0;
+        }
+
         ip(const ip& ) = default;
         ip(ip&& ) = default;
         ~ip() = default;
@@ -260,11 +294,28 @@ namespace mna {
           return(m_dst_ip);
         }
 
+        void set_downstream(downstream_t ds)
+        {
+          m_downstream = ds;
+        }
+
+        /* IP address of the interface in network byte order. */
+        void local_ip(uint32_t lip)
+        {
+          m_local_ip = lip;
+        }
+
+        uint32_t local_ip() const
+        {
+          return(m_local_ip);
+        }
+
       private:
         upstream_t m_upstream;
         downstream_t m_downstream;
         uint32_t m_src_ip;
         uint32_t m_dst_ip;
+        uint32_t m_local_ip;
     };
 
   }
@@ -342,6 +393,11 @@ namespace mna {
           m_upstream = us;
         }
 
+        void set_downstream(downstream_t ds)
+        {
+          m_downstream = ds;
+        }
+
         void src_port(uint16_t port)
         {
           m_src_port = port;
@@ -430,6 +486,30 @@ namespace mna {
    * */
   namespace dhcp {
 
+    enum limits_t : uint32_t {
+      /* Upper bound of an encoded response, dhcp header plus options. */
+      SIZE_RESPONSE = 1024,
+      /* Offset of chaddr in dhcp header. */
+      CHADDR_OFFSET = 28
+    };
+
+    /**
+     * @brief Hash of client MAC used to pin a client to one worker and its shard of the lease
+     *        table. The kernel fanout program computes the very same value, see
+     *        mna::filter::fanout and mna::lease_store::shard_of.
+     * @param pointer to 6 bytes of chaddr.
+     * @return 32 bit hash.
+     * */
+    inline uint32_t chaddr_hash(const uint8_t* chaddr)
+    {
+      uint32_t hi = (uint32_t(chaddr[0]) << 24) | (uint32_t(chaddr[1]) << 16) |
+                    (uint32_t(chaddr[2]) << 8) | uint32_t(chaddr[3]);
+      uint32_t lo = (uint32_t(chaddr[4]) << 8) | uint32_t(chaddr[5]);
+      uint32_t h = (hi ^ lo) * 0x9E3779B1U;
+
+      return(h ^ (h >> 16));
+    }
+
     enum message_type_t : uint8_t {
       /*DHCP Message Type*/
       DISCOVER = 1,
@@ -439,7 +519,14 @@ namespace mna {
       ACK = 5,
       NACK = 6,
       RELEASE = 7,
-      INFORM = 8
+      INFORM = 8,
+      /*Leasequery, RFC 4388 and RFC 6926*/
+      LEASEQUERY = 10,
+      LEASEUNASSIGNED = 11,
+      LEASEUNKNOWN = 12,
+      LEASEACTIVE = 13,
+      BULKLEASEQUERY = 14,
+      LEASEQUERYDONE = 15
     };
 
     enum option_t : uint8_t {
@@ -476,81 +563,82 @@ namespace mna {
       CLASS_IDENTIFIER = 60,
       CLIENT_IDENTIFIER = 61,
       RAPID_COMMIT = 80,
+      RELAY_AGENT_INFO = 82,
+      CLIENT_LAST_TRANSACTION_TIME = 91,
+      ASSOCIATED_IP = 92,
       AUTO_CONFIGURE = 116,
+      /*Bulk leasequery, RFC 6926*/
+      STATUS_CODE = 151,
+      BASE_TIME = 152,
+      START_TIME_OF_STATE = 153,
+      QUERY_START_TIME = 154,
+      QUERY_END_TIME = 155,
+      DHCP_STATE = 156,
+      DATA_SOURCE = 157,
       END = 255
 
     };
 
-    /** Element TLV received in request (DISCOVER, REQUEST) */
-    struct element_def_t {
-
-      uint8_t m_tag;
-      uint8_t m_len;
-      std::array<uint8_t, 255> m_val;
-
+    /**
+     * @brief Options of the request being processed, located in place within the packet rather
+     *        than copied, valid until the next request is parsed. A repeated option overrides
+     *        the earlier one.
+     * */
+    class options_t {
       public:
 
-        ~element_def_t() = default;
-
-        element_def_t()
-        {
-          m_tag = 0;
-          m_len = 0;
-          m_val.fill(0);
-        }
-
-        /*Forcing a copy constructor to be generated by the compiler.*/
-        element_def_t(const element_def_t& elm)
+        options_t()
         {
-          set_tag(elm.get_tag());
-          set_len(elm.get_len());
-          set_val(elm.get_val());
+          m_base = nullptr;
+          m_at.fill(0);
         }
 
-        element_def_t(element_def_t&& elem) noexcept = default;
-
-        element_def_t& operator=(element_def_t&& elem) = default;
+        options_t(const options_t& ) = default;
+        options_t(options_t&& ) = default;
+        ~options_t() = default;
 
-        element_def_t& operator=(const element_def_t& elem)
-        {
-          m_tag = elem.m_tag;
-          m_len = elem.m_len;
-          m_val = elem.m_val;
-          return *this;
-        }
+        /*
+         * @brief Indexes every option up to END, a truncated option ends the parsing.
+         * @param pointer to the dhcp option past the magic cookie.
+         * @param length of dhcp option data.
+         * @return none
+         * */
+        void parse(const uint8_t* in, uint32_t inLen);
 
-        /**
-         * @brief by adding const qualifier ensures that this method does not
-         * modify the private data member.This is a way to make this as pointer to const.*/
-        const std::array<uint8_t, 255>& get_val() const
+        /*
+         * @brief Looks up an option of the request.
+         * @param tag of the option.
+         * @param length of value is updated.
+         * @return value of the option, nullptr if the request does not carry it.
+         * */
+        const uint8_t* get(uint8_t tag, uint8_t& len) const
         {
-          return(m_val);
-        }
+          if(!m_at[tag]) {
+            return(nullptr);
+          }
 
-        uint8_t get_tag() const
-        {
-          return(m_tag);
+          len = m_base[m_at[tag]];
+          return(&m_base[m_at[tag] + 1]);
         }
 
-        uint8_t get_len() const
+        bool has(uint8_t tag) const
         {
-          return(m_len);
+          return(m_at[tag] != 0);
         }
 
-        void set_tag(uint8_t tag)
+        /* DHCP Message Type of the request, 0 if it carries none. */
+        uint8_t message_type() const
         {
-          m_tag = tag;
-        }
+          uint8_t len = 0;
+          const uint8_t* val = get(MESSAGE_TYPE, len);
 
-        void set_len(uint8_t len)
-        {
-          m_len = len;
+          return((val && len) ? val[0] : 0);
         }
 
-        void set_val(const std::array<uint8_t, 255> &val)
-        {
-          m_val = val;
-        }
+      private:
+        const uint8_t* m_base;
+        /* offset of the length byte of every option, 0 if the option is absent. */
+        std::array<uint16_t, 256> m_at;
     };
 
     class server;
@@ -695,186 +783,486 @@ namespace mna {
     }__attribute__((packed))dhcp_t;
 
 
-    using element_def_UMap_t = std::unordered_map<uint8_t, element_def_t>;
-
+    /**
+     * @brief Data of a lease few clients have or which is seldom read, allocated only once a
+     *        client sends it. It is never changed once the entry points to it, a client sending
+     *        other values gets a new one and the one before is retired, as readers of other
+     *        threads may be copying it.
+     * */
+    struct lease_cold_t {
+      /* Host Name option of the client. */
+      std::string m_hostName;
+      /* Client Identifier option of the client. */
+      std::string m_clientId;
+    };
 
+    /**
+     * @brief Lease of one client, kept within one cache line. What is the same for every
+     *        client, configuration and timer delegates, is read from server, options of a
+     *        request are parsed in place by server and are not kept past the request.
+     * */
     class dhcpEntry {
       public:
-        using start_timer_t = delegate<long (uint32_t, const void*, bool)>;
-        using stop_timer_t = delegate<void (long)>;
-        using reset_timer_t = delegate<void (long, uint32_t)>;
 
-        /** This UMap stores DHCP Option received in DISCOVER/REQUEST. */
-        element_def_UMap_t m_elemDefUMap;
-
-        dhcpEntry(const dhcpEntry& fsm) = default;
-        dhcpEntry(dhcpEntry&& fsm) = default;
+        dhcpEntry(const dhcpEntry& ) = delete;
+        dhcpEntry(dhcpEntry&& ) = delete;
 
         dhcpEntry()
         {
-          m_fsm = new FSM(this);
+          m_parent = nullptr;
+          m_cold = nullptr;
+          m_tid = 0;
+          m_clientIP = 0;
+          m_xid = 0;
+          m_expiry = 0;
+          m_chaddr.fill(0);
+          m_bound = false;
         }
 
-        ~dhcpEntry()
-        {
-        }
+        ~dhcpEntry();
 
-
-        dhcpEntry(server* parent, uint32_t clientIP, uint32_t routerIP, uint32_t dnsIP,
-                  uint32_t lease, uint32_t mtu, uint32_t serverID, std::string domainName)
+        dhcpEntry(server* parent, uint32_t clientIP)
         {
-          m_fsm = new FSM(this);
           m_parent = parent;
-          std::swap(m_clientIP, clientIP);
-          std::swap(m_routerIP, routerIP);
-          std::swap(m_dnsIP, dnsIP);
-          std::swap(m_lease, lease);
-          std::swap(m_mtu, mtu);
-          std::swap(m_serverID, serverID);
-          std::swap(m_domainName, domainName);
+          m_cold = nullptr;
+          m_tid = 0;
+          m_clientIP = clientIP;
+          m_xid = 0;
+          m_expiry = 0;
+          m_chaddr.fill(0);
+          m_bound = false;
 
           /* Initializing the State Machine. */
           setState(OnDiscover::instance());
         }
 
-        FSM& getState() const
-        {
-          return(m_fsm->getState());
-        }
-
         template<typename C>
         void setState(C& inst)
         {
-          m_fsm->setState<C>(inst);
+          m_fsm.setState<C>(this, inst);
         }
 
         int32_t rx(const uint8_t* in, uint32_t inLen);
 
-        int32_t parseOptions(const uint8_t* in, uint32_t inLen);
         int32_t buildAndSendResponse(const uint8_t* in, uint32_t inLen);
         int32_t tx(uint8_t* out, uint32_t outLen);
 
+        /* Options of the request being processed. */
+        const options_t& options() const;
+
         /** Timer related API. */
-        long startTimer(uint32_t delay, const void* txn);
+        long startTimer(uint32_t delay, timer_token_t token);
         void stopTimer(long tid);
+        /* Moves the deadline of a running timer, < 0 if it is no longer running. */
+        int32_t resetTimer(long tid, uint32_t delay);
 
-        uint32_t get_lease() const
+        /* Slot of this entry in the slot table of server, handed to every timer started. */
+        timer_token_t get_token() const
         {
-          return(m_lease);
+          return(m_token);
         }
 
-        std::array<uint8_t, 6> get_chaddr() const
+        void set_token(timer_token_t token)
         {
-          return(m_chaddr);
+          m_token = token;
         }
 
-        long get_tid() const
+        /* Address offered to the client, host byte order. */
+        uint32_t get_client_ip() const
         {
-          return(m_tid);
+          return(m_clientIP);
         }
 
-        void set_tid(long tid)
+        /* Seconds the lease timer runs for, the lease itself once server is provisioned with one. */
+        uint32_t get_lease_timer() const
         {
-          m_tid = tid;
+          return(1);
         }
 
-        void set_start_timer(start_timer_t st)
+        /* End of the lease in seconds since epoch, 0 unless bound. */
+        uint32_t get_expiry() const
         {
-          m_start_timer = st;
+          return(__atomic_load_n(&m_expiry, __ATOMIC_RELAXED));
         }
 
-        start_timer_t& get_start_timer()
+        void set_expiry(uint32_t expiry)
         {
-          return(m_start_timer);
+          __atomic_store_n(&m_expiry, expiry, __ATOMIC_RELAXED);
         }
 
-        void set_stop_timer(stop_timer_t st)
+        void set_chaddr(const uint8_t* chaddr)
         {
-          m_stop_timer = st;
+          std::memcpy(m_chaddr.data(), chaddr, m_chaddr.size());
         }
 
-        stop_timer_t& get_stop_timer()
+        /* True once an ACK is journaled for the lease and until it is released or expires. */
+        bool is_bound() const
         {
-          return(m_stop_timer);
+          return(__atomic_load_n(&m_bound, __ATOMIC_RELAXED));
         }
 
-        void set_reset_timer(reset_timer_t rt)
+        /*
+         * @brief Records a change of the lease in the lease journal.
+         * @param lease_record_t::type_t of the change.
+         * @return none
+         * */
+        void journal(uint8_t type);
+
+        /*
+         * @brief Gives the lease up upon a RELEASE or DECLINE, server frees the entry once the
+         *        request is processed and hands the address of a RELEASE back to the pool.
+         * @param none
+         * @return none
+         * */
+        void release();
+
+        std::array<uint8_t, 6> get_chaddr() const
         {
-          m_reset_timer = rt;
+          return(m_chaddr);
+        }
+
+        long get_tid() const
+        {
+          return(m_tid);
+        }
+
+        void set_tid(long tid)
+        {
+          m_tid = tid;
         }
 
+        /* Cold data of the lease, nullptr unless the client sent any. */
+        const lease_cold_t* get_cold() const
+        {
+          return(__atomic_load_n(&m_cold, __ATOMIC_ACQUIRE));
+        }
 
       private:
 
-        start_timer_t m_start_timer;
-        stop_timer_t m_stop_timer;
-        reset_timer_t m_reset_timer;
+        /* Keeps what the request carries of the cold data. */
+        void update_cold(const options_t& opts);
 
-        /* Per DHCP Client State Machine. */
-        FSM* m_fsm;
         /*backpointer to dhcp server.*/
         server* m_parent;
+        /** The timer ID*/
+        long m_tid;
+        /** Slot and generation of this entry. */
+        timer_token_t m_token;
+        /* Per DHCP Client State Machine. */
+        FSM m_fsm;
+        /* replaced rather than changed, see lease_cold_t. */
+        lease_cold_t* m_cold;
         /* The IP address allocated/Offered to DHCP Client. */
         uint32_t m_clientIP;
         /* Unique transaction ID of message received. */
         uint32_t m_xid;
-        /* The Router IP for DHCP Client. */
-        uint32_t m_routerIP;
-        /* The Domain Name Server IP. */
-        uint32_t m_dnsIP;
-        /* The validit of Offered IP address to DHCP Client. */
-        uint32_t m_lease;
-        /* The size of Ethernet Packet. */
-        uint32_t m_mtu;
-        /* The DHCP Server Identifier - Which is IP Address. */
-        uint32_t m_serverID;
+        /* End of the lease in seconds since epoch. */
+        uint32_t m_expiry;
         /* The DHCP Client MAC Address. */
         std::array<uint8_t, 6> m_chaddr;
-        /* The Domain Name to be assigned to DHCP Client. */
-        std::string m_domainName;
-        /* Name of Machine on which DHCP server is running. */
-        std::string m_hostName;
-        /** The timer ID*/
-        long m_tid;
+        /** Binding is in the lease journal. */
+        bool m_bound;
     };
 
-    using dhcp_entry_onMAC_t = std::unordered_map<std::string, dhcpEntry*>;
-    using dhcp_entry_onIP_t = std::unordered_map<uint32_t, dhcpEntry>;
+    static_assert(sizeof(dhcpEntry) <= 64, "lease of a client fits in one cache line");
+
+    /**
+     * @brief Leases held by the server and what they cost.
+     * */
+    struct lease_stats_t {
+      /* Entries, offered and bound. */
+      uint64_t m_leases;
+      uint64_t m_bound;
+      /* Entries which have cold data. */
+      uint64_t m_cold;
+      /* Bytes held by slabs of entries, cold data, indices and pool. */
+      uint64_t m_bytes;
+    };
+
+    /**
+     * @brief Copy of a lease taken by a thread other than the worker owning it.
+     * */
+    struct lease_view_t {
+      /* Address, host byte order. */
+      uint32_t m_ip;
+      /* End of the lease in seconds since epoch, 0 unless bound. */
+      uint32_t m_expiry;
+      std::array<uint8_t, 6> m_chaddr;
+      bool m_bound;
+      std::string m_hostName;
+      std::string m_clientId;
+    };
+
+    /* chaddr packed by mac_index::key_of to slot of the entry. */
+    using dhcp_entry_onMAC_t = mna::mac_index;
+    /* address handed out to slot of the entry holding it. */
+    using dhcp_entry_onIP_t = mna::ip_index;
 
     class server {
 
       public:
 
         using upstream_t = delegate<int32_t (const uint8_t* in, uint32_t inLen)>;
-        using start_timer_t = delegate<long (uint32_t, const void*, bool)>;
+        using downstream_t = delegate<int32_t (uint8_t* out, uint32_t outLen)>;
+        /* Hands out the buffer in which a response is encoded, capacity is updated. */
+        using tx_buffer_t = delegate<uint8_t* (uint32_t&)>;
+        using start_timer_t = delegate<long (uint32_t, timer_token_t, bool)>;
         using stop_timer_t = delegate<void (long)>;
-        using reset_timer_t = delegate<void (long, uint32_t)>;
+        using reset_timer_t = delegate<int32_t (long, uint32_t)>;
+        /* Appends a lease change, type, chaddr, address and lease in seconds. */
+        using journal_t = delegate<void (uint8_t, const uint8_t*, uint32_t, uint32_t)>;
+
+        dhcp_entry_onMAC_t m_dhcpIndexOnMAC;
+        dhcp_entry_onIP_t m_dhcpIndexOnIP;
 
-        dhcp_entry_onMAC_t m_dhcpUmapOnMAC;
-        dhcp_entry_onIP_t m_dhcpUmapOnIP;
+        server() : m_pool(lease_store::instance().pool())
+        {
+          m_shard = nullptr;
+          m_released = nullptr;
+          m_restoring = false;
+          m_bound_count = 0;
+          m_cold_count = 0;
+          m_routerIP = 0;
+          m_dnsIP = 0;
+          m_lease = 0;
+          m_mtu = 0;
+          m_serverID = 0;
+          /* pages and tables the indices drop go through the limbo of the shard as well. */
+          m_dhcpIndexOnMAC.set_limbo(&m_limbo);
+          m_dhcpIndexOnIP.set_limbo(&m_limbo);
+        }
 
-        server() = default;
-        server(const server& ) = default;
-        server(server&& ) = default;
+        server(const server& ) = delete;
+        server(server&& ) = delete;
 
         ~server()
         {
-          dhcp_entry_onMAC_t::const_iterator it;
-          for(it = m_dhcpUmapOnMAC.begin(); it != m_dhcpUmapOnMAC.end(); ++it) {
-            dhcpEntry *dEnt = it->second;
-            delete dEnt;
+          /* readers of other threads find the shard gone, the ones reading it are waited for. */
+          if(m_shard) {
+            m_shard->m_server.store(nullptr);
+            epoch::instance().synchronize();
           }
+
+          m_limbo.drain();
+
+          /* the pool outlives the shard, addresses held by its entries go back to it. */
+          m_dhcpIndexOnIP.scan(0, 0xFFFFFFFFU, ~0ULL, [&](uint32_t ip, uint32_t slot) {
+            (void)slot;
+            m_pool.release(ip);
+          });
+
+          m_entries.clear();
+          m_bound_count = 0;
+          m_cold_count = 0;
+          publish();
         }
 
         int32_t rx(const uint8_t* in, uint32_t inLen);
         int32_t tx(uint8_t* in, uint32_t inLen);
+
+        /*
+         * @brief Expiry of a lease timer, act carries the timer_token_t of the entry.
+         * @param act of the timer.
+         * @return 0 upon success else < 0 for a stale token.
+         * */
         long timedOut(const void* txn);
 
+        /*
+         * @brief Marks the entry of the request being processed to be freed once its FSM has
+         *        returned, as a state may not free the entry it runs for.
+         * @param entry released by its client.
+         * @return none
+         * */
+        void release(dhcpEntry* dEnt)
+        {
+          m_released = dEnt;
+        }
+
+        /*
+         * @brief Returns the entry a timer token refers to.
+         * @param token handed to the timer.
+         * @return entry, nullptr if the slot was released since the timer was started.
+         * */
+        dhcpEntry* resolve(timer_token_t token) const
+        {
+          return(m_entries.get(token.m_slot, token.m_gen));
+        }
+
+        /*
+         * @brief Sizes the slabs entries are allocated from, before the first request.
+         * @param entries of a slab.
+         * @param true to back slabs with hugepages.
+         * @return 0 upon success else < 0.
+         * */
+        int32_t setup_entries(uint32_t cells, bool hugepage)
+        {
+          return(m_entries.setup(cells, hugepage));
+        }
+
+        /*
+         * @brief Returns the entry of a client.
+         * @param chaddr of client.
+         * @return entry, nullptr if the client is not known.
+         * */
+        dhcpEntry* find_by_mac(const uint8_t* chaddr) const
+        {
+          uint32_t slot = m_dhcpIndexOnMAC.find(mna::mac_index::key_of(chaddr));
+
+          if(mna::mac_index::NIL == slot) {
+            return(nullptr);
+          }
+
+          return(m_entries.at(slot));
+        }
+
+        /*
+         * @brief Returns the entry holding an address, the lookup of a RELEASE by ciaddr, of a
+         *        DECLINE by requested address and of an operator.
+         * @param address, host byte order.
+         * @return entry, nullptr if the address is not handed out.
+         * */
+        dhcpEntry* find_by_ip(uint32_t ip) const
+        {
+          uint32_t slot = m_dhcpIndexOnIP.find(ip);
+
+          if(mna::ip_index::NIL == slot) {
+            return(nullptr);
+          }
+
+          return(m_entries.at(slot));
+        }
+
+        /*
+         * @brief Number of addresses leased within a prefix, kept up to date as leases come and go.
+         * @param address within the prefix, host byte order.
+         * @param length of prefix.
+         * @return addresses leased.
+         * */
+        uint64_t count_leases(uint32_t prefix, uint32_t prefixLen) const
+        {
+          return(m_dhcpIndexOnIP.count(prefix, prefixLen));
+        }
+
+        /*
+         * @brief Hands the entries of a range of addresses to visit in ascending order of address,
+         *        a slice of at most limit of them, so that an operator query is served in between
+         *        packets rather than holding up the reactor.
+         * @param address to start from, the cursor returned by the previous slice.
+         * @param last address of range.
+         * @param entries visited at most.
+         * @param callable invoked with every entry.
+         * @return cursor of the next slice, greater than last once the range is done.
+         * */
+        template<typename F>
+        uint64_t scan_leases(uint64_t from, uint32_t last, uint64_t limit, F visit) const
+        {
+          return(m_dhcpIndexOnIP.scan(from, last, limit, [&](uint32_t ip, uint32_t slot) {
+            (void)ip;
+            visit(*m_entries.at(slot));
+          }));
+        }
+
+        slab_stats_t entry_stats() const
+        {
+          return(m_entries.stats());
+        }
+
+        /*
+         * @brief Copies the lease of a client, from any thread and without a lock, while the
+         *        worker owning the shard goes on serving packets.
+         * @param chaddr of client.
+         * @param copy of the lease is updated.
+         * @return true if the client is known.
+         * */
+        bool read_by_mac(const uint8_t* chaddr, lease_view_t& view) const;
+
+        /*
+         * @brief Copies the lease holding an address, from any thread and without a lock.
+         * @param address, host byte order.
+         * @param copy of the lease is updated.
+         * @return true if the address is handed out.
+         * */
+        bool read_by_ip(uint32_t ip, lease_view_t& view) const;
+
+        /*
+         * @brief Copies the leases of a range of addresses in ascending order of address, a
+         *        slice of at most limit of them, from any thread and without a lock. The same
+         *        as scan_leases for a reader, a lease changed meanwhile is copied either before
+         *        or after the change and one freed meanwhile is left out.
+         * @param address to start from, the cursor returned by the previous slice.
+         * @param last address of range.
+         * @param leases visited at most.
+         * @param callable invoked with the copy of every lease.
+         * @return cursor of the next slice, greater than last once the range is done.
+         * */
+        template<typename F>
+        uint64_t read_leases(uint64_t from, uint32_t last, uint64_t limit, F visit) const
+        {
+          epoch::guard guard;
+          lease_view_t view;
+
+          if(!guard) {
+            return(from);
+          }
+
+          return(m_dhcpIndexOnIP.scan(from, last, limit, [&](uint32_t ip, uint32_t slot) {
+            if(read_slot(slot, view) && view.m_ip == ip) {
+              visit(static_cast<const lease_view_t&>(view));
+            }
+          }));
+        }
+
+        /*
+         * @brief Frees what readers of other threads are done with, upon every sweep.
+         * @param none
+         * @return objects freed.
+         * */
+        uint32_t reclaim()
+        {
+          return(m_limbo.reclaim());
+        }
+
+        /*
+         * @brief Hands cold data an entry no longer points to over to be freed once no reader
+         *        can be copying it.
+         * @param cold data replaced.
+         * @return none
+         * */
+        void retire_cold(lease_cold_t* cold)
+        {
+          m_limbo.retire(limbo::reclaim_t::from<server, &server::free_cold>(*this), reinterpret_cast<uintptr_t>(cold));
+        }
+
         void set_upstream(upstream_t us)
         {
           m_upstream = us;
         }
 
+        void set_downstream(downstream_t ds)
+        {
+          m_downstream = ds;
+        }
+
+        void set_tx_buffer(tx_buffer_t tb)
+        {
+          m_tx_buffer = tb;
+        }
+
+        /*
+         * @brief Returns the buffer in which response is to be encoded. The buffer has room
+         *        in front of it for the lower layer headers.
+         * @param capacity of the buffer is updated.
+         * @return pointer to buffer else nullptr if downstream is not connected.
+         * */
+        uint8_t* tx_buffer(uint32_t& capacity)
+        {
+          if(!m_tx_buffer) {
+            return(nullptr);
+          }
+
+          return(m_tx_buffer(capacity));
+        }
+
         void set_start_timer(start_timer_t st)
         {
           m_start_timer = st;
@@ -890,13 +1278,180 @@ namespace mna {
           m_reset_timer = rt;
         }
 
+        /* Timers of every entry go through the delegates of server. */
+        long start_timer(uint32_t delay, timer_token_t token)
+        {
+          return(m_start_timer(delay, token, false));
+        }
+
+        void stop_timer(long tid)
+        {
+          m_stop_timer(tid);
+        }
+
+        /* Moves the deadline of a running timer, < 0 if it is no longer running or not wired. */
+        int32_t reset_timer(long tid, uint32_t delay)
+        {
+          if(!m_reset_timer) {
+            return(-1);
+          }
+
+          return(m_reset_timer(tid, delay));
+        }
+
+        /* Options of the request being processed. */
+        const options_t& options() const
+        {
+          return(m_options);
+        }
+
+        uint32_t get_router_ip() const
+        {
+          return(m_routerIP);
+        }
+
+        uint32_t get_dns_ip() const
+        {
+          return(m_dnsIP);
+        }
+
+        uint32_t get_lease() const
+        {
+          return(m_lease);
+        }
+
+        uint32_t get_mtu() const
+        {
+          return(m_mtu);
+        }
+
+        uint32_t get_server_id() const
+        {
+          return(m_serverID);
+        }
+
+        const std::string& get_domain_name() const
+        {
+          return(m_domainName);
+        }
+
+        const std::string& get_host_name() const
+        {
+          return(m_hostName);
+        }
+
+        /* Entries count their bindings and cold data as they take and drop them. */
+        void count_bound(int32_t delta)
+        {
+          m_bound_count += delta;
+          publish();
+        }
+
+        void count_cold(int32_t delta)
+        {
+          m_cold_count += delta;
+          publish();
+        }
+
+        /*
+         * @brief Makes this server the shard of the lease table it publishes its counters to.
+         * @param index of shard, the id of the worker.
+         * @return none
+         * */
+        void attach(uint32_t shard)
+        {
+          m_shard = &lease_store::instance().shard(shard);
+          m_shard->m_server.store(this);
+          publish();
+        }
+
+        lease_stats_t stats() const;
+
+        /* Addresses handed out to clients, shared by every shard and configured by the first. */
+        ip_pool& pool()
+        {
+          return(m_pool);
+        }
+
+        void set_journal(journal_t jr)
+        {
+          m_journal = jr;
+        }
+
+        /*
+         * @brief Hands a change of a lease to the lease journal, changes made while restoring
+         *        are in the journal already.
+         * @param entry of the lease.
+         * @param lease_record_t::type_t of the change.
+         * @return none
+         * */
+        void journal(const dhcpEntry& dEnt, uint8_t type);
+
+        /*
+         * @brief Brings back a binding from the lease journal, the entry is bound and its lease
+         *        timer runs for what is left of the lease.
+         * @param chaddr of client.
+         * @param address bound to client, host byte order.
+         * @param seconds left of the lease.
+         * @return 0 upon success else < 0 if client is known or address is not free.
+         * */
+        int32_t restore(const uint8_t* chaddr, uint32_t ip, uint32_t remaining);
+
       private:
 
+        /* Allocates an entry for an address taken from the pool, nullptr if no slab is left. */
+        dhcpEntry* new_entry(uint32_t clientIP);
+        /* Frees the entry of a slot, its address is handed back by the caller. */
+        void free_entry(uint32_t slot);
+        /* Journals the end of a lease, stops its timer, unindexes and frees the entry and
+           hands its address back to the pool unless toPool is false. */
+        void drop(dhcpEntry* dEnt, uint8_t type, bool toPool);
+
+        /* Stores counters into the header of the shard, the only writer of its cache line. */
+        void publish()
+        {
+          if(m_shard) {
+            m_shard->m_leases.store(m_entries.size(), std::memory_order_relaxed);
+            m_shard->m_bound.store(m_bound_count, std::memory_order_relaxed);
+            m_shard->m_cold.store(m_cold_count, std::memory_order_relaxed);
+          }
+        }
+        /* Adds the entry to the index on MAC and the index on address, to both or neither. */
+        int32_t index(dhcpEntry* dEnt, uint64_t MAC);
+        /* Removes the entry from both indices. */
+        void unindex(const dhcpEntry* dEnt);
+        /* Copies the entry of a slot within an epoch::guard, false if it is freed meanwhile. */
+        bool read_slot(uint32_t slot, lease_view_t& view) const;
+
+        void free_cold(uintptr_t cold)
+        {
+          delete reinterpret_cast<lease_cold_t*>(cold);
+        }
+
         start_timer_t m_start_timer;
         stop_timer_t m_stop_timer;
         reset_timer_t m_reset_timer;
 
+        /* Entries by slot, a timer token is the slot with its generation. */
+        slab<dhcpEntry> m_entries;
+        /* What is freed while readers of other threads may still hold it. */
+        limbo m_limbo;
+        ip_pool& m_pool;
+        /* header of the shard, nullptr until attached. */
+        lease_store::shard_t* m_shard;
+        journal_t m_journal;
+        /* entry released by the request being processed, freed once its FSM has returned. */
+        dhcpEntry* m_released;
+        /* Set while restore replays a binding. */
+        bool m_restoring;
+        uint64_t m_bound_count;
+        uint64_t m_cold_count;
+        /* Parsed in place upon every request. */
+        options_t m_options;
+
         upstream_t m_upstream;
+        downstream_t m_downstream;
+        tx_buffer_t m_tx_buffer;
         /* The Router IP for DHCP Client. */
         uint32_t m_routerIP;
         /* The Domain Name Server IP. */
@@ -909,6 +1464,8 @@ namespace mna {
         uint32_t m_serverID;
         /* The Domain Name to be assigned to DHCP Client. */
         std::string m_domainName;
+        /* Name of Machine on which DHCP server is running. */
+        std::string m_hostName;
     };
 
   }
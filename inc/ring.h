@@ -0,0 +1,280 @@
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <cstring>
+#include <sys/mman.h>
+#include <linux/if_packet.h>
+
+#include "ace/Basic_Types.h"
+#include "ace/Event_Handler.h"
+#include "ace/Time_Value.h"
+
+#include "delegate.hpp"
+
+namespace mna {
+
+  /**
+   * @brief Counters maintained by the TPACKET_V3 receive ring. The reactor wakes once per
+   *        retired block, so frames/wakeups is the average number of frames walked in place
+   *        per reactor callback.
+   * */
+  struct rx_ring_stats_t {
+    /* Number of times the reactor dispatched handle_input for the ring. */
+    uint64_t m_wakeups;
+    /* Number of blocks handed back to the kernel. */
+    uint64_t m_blocks;
+    /* Number of frames dispatched upstream. */
+    uint64_t m_frames;
+    /* Frames processed in the most recent wakeup. */
+    uint32_t m_last_frames;
+    /* Largest number of frames processed in one wakeup. */
+    uint32_t m_max_frames;
+  };
+
+  /**
+   * @brief Memory mapped PACKET_RX_RING (TPACKET_V3). The kernel fills whole blocks of
+   *        frames and flips the block status to TP_STATUS_USER, frames are then passed to
+   *        upstream in place, without copy and without any per packet allocation.
+   * */
+  class rx_ring {
+    public:
+      using frame_delegate_t = delegate<int32_t (const uint8_t*, uint32_t)>;
+
+      rx_ring()
+      {
+        m_base = nullptr;
+        m_block_size = 0;
+        m_block_count = 0;
+        m_frame_size = 0;
+        m_current = 0;
+        m_stamp = 0;
+        std::memset(&m_stats, 0, sizeof(m_stats));
+      }
+
+      rx_ring(const rx_ring& ) = default;
+      rx_ring(rx_ring&& ) = default;
+      ~rx_ring() = default;
+
+      /*
+       * @brief Switches the socket to TPACKET_V3 and requests the receive ring from kernel.
+       *        The ring is not usable until attach is called with the mmap'd region.
+       * @param handle of PF_PACKET socket.
+       * @param size of one block in bytes, must be multiple of page size.
+       * @param number of blocks in the ring.
+       * @param size of one frame slot in bytes, must be multiple of TPACKET_ALIGNMENT.
+       * @param timeout in ms after which a partially filled block is retired to user space.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup(ACE_HANDLE handle, uint32_t blockSize, uint32_t blockCount,
+                    uint32_t frameSize, uint32_t timeoutMs);
+
+      /*
+       * @brief Records the start of the ring inside the mmap'd region.
+       * @param pointer to the first block of the receive ring.
+       * @return none
+       * */
+      void attach(uint8_t* base)
+      {
+        m_base = base;
+        m_current = 0;
+      }
+
+      void detach()
+      {
+        m_base = nullptr;
+      }
+
+      /*
+       * @brief Hands the ring back to kernel when it can not be mapped, frames are then
+       *        received by recv rather than filling a ring nobody reads.
+       * @param handle of PF_PACKET socket.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t release(ACE_HANDLE handle);
+
+      /*
+       * @brief Walks every block currently owned by user space and dispatches each frame
+       *        to upstream, then hands the block back to kernel.
+       * @param delegate to which each frame is dispatched.
+       * @return number of frames dispatched.
+       * */
+      uint32_t poll(frame_delegate_t upstream);
+
+      /* Size in bytes of the ring, needed to compute the mmap length. */
+      size_t size() const
+      {
+        return(static_cast<size_t>(m_block_size) * m_block_count);
+      }
+
+      bool is_attached() const
+      {
+        return(m_base != nullptr);
+      }
+
+      /* Kernel receive time in ns since epoch of the frame being dispatched by poll. */
+      uint64_t stamp() const
+      {
+        return(m_stamp);
+      }
+
+      const rx_ring_stats_t& stats() const
+      {
+        return(m_stats);
+      }
+
+    private:
+      uint8_t* m_base;
+      uint32_t m_block_size;
+      uint32_t m_block_count;
+      uint32_t m_frame_size;
+      /* Index of the next block to be examined. */
+      uint32_t m_current;
+      uint64_t m_stamp;
+      rx_ring_stats_t m_stats;
+  };
+
+
+  /**
+   * @brief Counters maintained by the PACKET_TX_RING. One kick (send with no payload) flushes
+   *        every slot queued since the previous kick.
+   * */
+  struct tx_ring_stats_t {
+    /* Frames queued into the ring. */
+    uint64_t m_frames;
+    /* Frames dropped because no slot was free. */
+    uint64_t m_drops;
+    /* Number of send() kicks issued. */
+    uint64_t m_kicks;
+    /* Kicks issued during the last complete one second window. */
+    uint64_t m_kicks_per_sec;
+    /* Slots queued or being transmitted by kernel. */
+    uint32_t m_in_flight;
+  };
+
+  /**
+   * @brief Memory mapped PACKET_TX_RING. A response is encoded directly into the data area of
+   *        the next free slot and committed, the queued slots are flushed to the wire with one
+   *        kick per reactor iteration.
+   * */
+  class tx_ring {
+    public:
+      tx_ring()
+      {
+        m_base = nullptr;
+        m_frame_size = 0;
+        m_frame_count = 0;
+        m_head = 0;
+        m_tail = 0;
+        m_pending = 0;
+        m_window_kicks = 0;
+        std::memset(&m_stats, 0, sizeof(m_stats));
+      }
+
+      tx_ring(const tx_ring& ) = default;
+      tx_ring(tx_ring&& ) = default;
+      ~tx_ring() = default;
+
+      /*
+       * @brief Requests the transmit ring from kernel, the socket is switched to TPACKET_V3
+       *        unless receive ring has done it already.
+       * @param handle of PF_PACKET socket.
+       * @param size of one block in bytes, must be multiple of page size.
+       * @param number of blocks in the ring.
+       * @param size of one frame slot in bytes.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup(ACE_HANDLE handle, uint32_t blockSize, uint32_t blockCount, uint32_t frameSize);
+
+      void attach(uint8_t* base)
+      {
+        m_base = base;
+        m_head = 0;
+        m_tail = 0;
+        m_pending = 0;
+      }
+
+      void detach()
+      {
+        m_base = nullptr;
+      }
+
+      /*
+       * @brief Hands the ring back to kernel when it can not be mapped, frames are then sent
+       *        by send.
+       * @param handle of PF_PACKET socket.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t release(ACE_HANDLE handle);
+
+      /*
+       * @brief Returns the start of data area of the next free slot, the caller encodes the
+       *        frame in place and hands it back with commit.
+       * @param capacity of the data area is updated.
+       * @return pointer to slot data else nullptr when ring is full.
+       * */
+      uint8_t* acquire(uint32_t& capacity);
+
+      /*
+       * @brief Queues a frame for transmission. A frame built in place in the slot returned by
+       *        acquire is queued without copy, any other frame is copied into the next slot.
+       * @param pointer to ethernet frame.
+       * @param length of ethernet frame.
+       * @return 0 upon success else < 0 when ring is full.
+       * */
+      int32_t commit(const uint8_t* frame, uint32_t len);
+
+      /*
+       * @brief Kicks the kernel to transmit every slot queued since the last flush.
+       * @param handle of PF_PACKET socket.
+       * @return number of frames flushed.
+       * */
+      uint32_t flush(ACE_HANDLE handle);
+
+      size_t size() const
+      {
+        return(static_cast<size_t>(m_frame_size) * m_frame_count);
+      }
+
+      bool is_attached() const
+      {
+        return(m_base != nullptr);
+      }
+
+      const tx_ring_stats_t& stats() const
+      {
+        return(m_stats);
+      }
+
+    private:
+      struct tpacket3_hdr* slot(uint32_t idx) const
+      {
+        return(reinterpret_cast<struct tpacket3_hdr*>(m_base + (static_cast<size_t>(idx % m_frame_count) * m_frame_size)));
+      }
+
+      /* Offset of frame data from the start of slot. */
+      static size_t data_offset()
+      {
+        return(TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+      }
+
+      /* Advances tail over the slots kernel has finished with. */
+      void reclaim();
+
+      uint8_t* m_base;
+      uint32_t m_frame_size;
+      uint32_t m_frame_count;
+      /* Running index of next slot to be filled. */
+      uint32_t m_head;
+      /* Running index of oldest slot not yet returned by kernel. */
+      uint32_t m_tail;
+      /* Slots committed since the last kick. */
+      uint32_t m_pending;
+      /* Start of the current kicks per second window. */
+      ACE_Time_Value m_window;
+      uint64_t m_window_kicks;
+      tx_ring_stats_t m_stats;
+  };
+
+}
+
+#endif /*__RING_H__*/
@@ -0,0 +1,414 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "epoch.h"
+
+namespace mna {
+
+  /**
+   * @brief Counters of a slab allocator.
+   * */
+  struct slab_stats_t {
+    /* Slabs mapped, never unmapped while the allocator lives as indices have to stay valid. */
+    uint32_t m_slabs;
+    /* Slabs backed by hugepages. */
+    uint32_t m_hugepage_slabs;
+    /* Slabs without any object, every cell of them is on the free list. */
+    uint32_t m_empty_slabs;
+    /* Cells of every slab. */
+    uint64_t m_capacity;
+    /* Objects alive. */
+    uint64_t m_used;
+    /* Largest number of objects alive at once. */
+    uint64_t m_peak;
+    /* Bytes mapped for slabs and their generations, the directory of slabs left out. */
+    uint64_t m_bytes;
+    /* Free cells of slabs holding at least one object, in per mille of capacity. */
+    uint32_t m_fragmentation;
+  };
+
+  /**
+   * @brief Mapping of slabs, the part of the slab allocator which does not depend on the type.
+   * */
+  class slab_base {
+    public:
+      enum : uint32_t {
+        /* index which is never handed out. */
+        NIL = 0xFFFFFFFFU,
+        /* cells of a slab unless told otherwise, 2MB of 64 byte objects. */
+        DEFAULT_CELLS = 32768,
+        /* fewest cells of a slab, bounds the directory of slabs to 4M entries. */
+        MIN_CELLS = 1024
+      };
+
+    protected:
+      /*
+       * @brief Maps the memory of one slab, hugepages are used when asked for and available.
+       * @param bytes of the slab, rounded up to a hugepage when hugepage is true.
+       * @param hugepage is updated, false if regular pages are used.
+       * @return start of slab, nullptr upon failure.
+       * */
+      static void* map(size_t& len, bool& hugepage);
+      static void unmap(void* base, size_t len);
+  };
+
+  /**
+   * @brief Allocator of objects of one type in contiguous slabs of cells. A free cell holds the
+   *        index of the next free cell, so the free list costs no memory of its own, and the
+   *        most recently freed cell, warm in cache, is handed out first. An object never moves
+   *        and is known by its index, which with the generation of the cell makes a handle
+   *        telling a live object from one freed since; the generation is odd while the cell
+   *        holds an object. Allocating and freeing is up to the owner only. Slabs are found
+   *        through a directory mapped once and never moved, so a reader thread within an
+   *        epoch::guard may look at any cell; a cell retired through a limbo keeps its object,
+   *        stale by its generation, until no reader can be looking at it.
+   * */
+  template<typename T>
+  class slab : public slab_base {
+    public:
+
+      slab()
+      {
+        m_shift = 0;
+        m_cells = 0;
+        m_hugepage = false;
+        m_hugepage_slabs = 0;
+        m_free = NIL;
+        m_used = 0;
+        m_peak = 0;
+        m_dir = nullptr;
+        m_dir_len = 0;
+        m_slabs = 0;
+        m_capacity = 0;
+      }
+
+      slab(const slab& ) = delete;
+      slab(slab&& ) = delete;
+
+      ~slab()
+      {
+        clear();
+
+        if(m_dir) {
+          unmap(m_dir, m_dir_len);
+        }
+      }
+
+      /*
+       * @brief Sizes the slabs and maps the directory of slabs, no slab is mapped until the
+       *        first object is allocated.
+       * @param cells of a slab, rounded up to power of two, MIN_CELLS at least.
+       * @param true to back slabs with hugepages.
+       * @return 0 upon success else < 0 once objects are allocated.
+       * */
+      int32_t setup(uint32_t cells, bool hugepage)
+      {
+        bool regular = false;
+
+        if(m_slabs || !cells) {
+          return(-1);
+        }
+
+        m_shift = 0;
+        while((1U << m_shift) < cells || (1U << m_shift) < MIN_CELLS) {
+          ++m_shift;
+        }
+
+        m_cells = 1U << m_shift;
+        m_hugepage = hugepage;
+
+        if(m_dir) {
+          unmap(m_dir, m_dir_len);
+        }
+
+        /* an entry for every slab there may ever be, pages are touched as slabs are added. */
+        m_dir_len = ((static_cast<uint64_t>(NIL) + 1) >> m_shift) * sizeof(slab_t);
+
+        if(!(m_dir = static_cast<slab_t*>(map(m_dir_len, regular)))) {
+          m_cells = 0;
+          return(-1);
+        }
+
+        return(0);
+      }
+
+      /*
+       * @brief Constructs an object in a free cell, a slab is mapped when none is left.
+       * @param arguments of constructor of T.
+       * @return index of the object, NIL if no slab could be mapped.
+       * */
+      template<typename... A>
+      uint32_t alloc(A&&... args)
+      {
+        uint32_t idx = m_free;
+
+        if(NIL == idx && grow() < 0) {
+          return(NIL);
+        }
+
+        idx = m_free;
+        m_free = cell(idx).m_next;
+        new (cell(idx).m_obj) T(std::forward<A>(args)...);
+        set_gen(idx, gen(idx) + 1);
+        ++m_live[idx >> m_shift];
+
+        if(++m_used > m_peak) {
+          m_peak = m_used;
+        }
+
+        return(idx);
+      }
+
+      /*
+       * @brief Destroys the object and puts its cell on top of the free list, every handle of it
+       *        is stale from now on.
+       * @param index returned by alloc.
+       * @return none
+       * */
+      void free(uint32_t idx)
+      {
+        if(stale(idx)) {
+          return;
+        }
+
+        set_gen(idx, gen(idx) + 1);
+        --m_used;
+        reclaim(idx);
+      }
+
+      /*
+       * @brief Makes every handle of the object stale at once and hands the cell to a limbo,
+       *        the object being destroyed and the cell reused once no reader can see it.
+       * @param index returned by alloc.
+       * @param limbo of the owner.
+       * @return none
+       * */
+      void retire(uint32_t idx, limbo& lb)
+      {
+        if(stale(idx)) {
+          return;
+        }
+
+        set_gen(idx, gen(idx) + 1);
+        --m_used;
+        lb.retire(limbo::reclaim_t::from<slab<T>, &slab<T>::reclaim>(*this), idx);
+      }
+
+      T* at(uint32_t idx) const
+      {
+        return(reinterpret_cast<T*>(cell(idx).m_obj));
+      }
+
+      /* Generation of a cell, odd while it holds an object. */
+      uint32_t gen(uint32_t idx) const
+      {
+        return(m_dir[idx >> m_shift].m_gen[idx & (m_cells - 1)]);
+      }
+
+      /*
+       * @brief Looks up the object of a handle.
+       * @param index of the object.
+       * @param generation of the cell when the handle was taken.
+       * @return object, nullptr if it was freed since.
+       * */
+      T* get(uint32_t idx, uint32_t gen) const
+      {
+        if(idx >= m_capacity || this->gen(idx) != gen || !(gen & 1)) {
+          return(nullptr);
+        }
+
+        return(at(idx));
+      }
+
+      /*
+       * @brief Generation of a cell as seen by a reader thread within an epoch::guard, read
+       *        before and after the object to tell whether it was freed meanwhile.
+       * @param index of the object.
+       * @return generation, 0 for an index past every slab.
+       * */
+      uint32_t read_gen(uint32_t idx) const
+      {
+        if(idx >= __atomic_load_n(&m_capacity, __ATOMIC_ACQUIRE)) {
+          return(0);
+        }
+
+        return(__atomic_load_n(&m_dir[idx >> m_shift].m_gen[idx & (m_cells - 1)], __ATOMIC_ACQUIRE));
+      }
+
+      uint64_t size() const
+      {
+        return(m_used);
+      }
+
+      /* Destroys every object and unmaps every slab, indices start over. Cells retired are
+       * reclaimed by draining the limbo beforehand. */
+      void clear()
+      {
+        for(uint32_t idx = 0; idx < m_capacity; ++idx) {
+          if(gen(idx) & 1) {
+            at(idx)->~T();
+          }
+        }
+
+        for(uint32_t slb = 0; slb < m_slabs; ++slb) {
+          unmap(m_dir[slb].m_cells, m_lens[slb]);
+          unmap(m_dir[slb].m_gen, gen_len());
+          m_dir[slb].m_cells = nullptr;
+          m_dir[slb].m_gen = nullptr;
+        }
+
+        __atomic_store_n(&m_capacity, 0U, __ATOMIC_RELEASE);
+        m_slabs = 0;
+        m_lens.clear();
+        m_live.clear();
+        m_hugepage_slabs = 0;
+        m_free = NIL;
+        m_used = 0;
+      }
+
+      slab_stats_t stats() const
+      {
+        slab_stats_t st;
+        uint64_t partialFree = 0;
+
+        st.m_slabs = m_slabs;
+        st.m_hugepage_slabs = m_hugepage_slabs;
+        st.m_empty_slabs = 0;
+        st.m_capacity = m_capacity;
+        st.m_used = m_used;
+        st.m_peak = m_peak;
+        st.m_bytes = static_cast<uint64_t>(m_slabs) * gen_len();
+
+        for(size_t len : m_lens) {
+          st.m_bytes += len;
+        }
+
+        for(uint32_t live : m_live) {
+          if(!live) {
+            ++st.m_empty_slabs;
+          } else {
+            partialFree += m_cells - live;
+          }
+        }
+
+        st.m_fragmentation = st.m_capacity ? static_cast<uint32_t>((partialFree * 1000) / st.m_capacity) : 0;
+        return(st);
+      }
+
+    private:
+      union cell_t {
+        alignas(T) unsigned char m_obj[sizeof(T)];
+        uint32_t m_next;
+      };
+
+      /* Cells of a slab and their generations. */
+      struct slab_t {
+        cell_t* m_cells;
+        uint32_t* m_gen;
+      };
+
+      cell_t& cell(uint32_t idx) const
+      {
+        return(m_dir[idx >> m_shift].m_cells[idx & (m_cells - 1)]);
+      }
+
+      bool stale(uint32_t idx) const
+      {
+        return(idx >= m_capacity || !(gen(idx) & 1));
+      }
+
+      void set_gen(uint32_t idx, uint32_t gen)
+      {
+        __atomic_store_n(&m_dir[idx >> m_shift].m_gen[idx & (m_cells - 1)], gen, __ATOMIC_RELEASE);
+      }
+
+      /* Destroys the object of a stale cell and puts the cell on top of the free list. */
+      void reclaim(uintptr_t idx)
+      {
+        at(idx)->~T();
+        --m_live[idx >> m_shift];
+        cell(idx).m_next = m_free;
+        m_free = static_cast<uint32_t>(idx);
+      }
+
+      size_t slab_len() const
+      {
+        return(static_cast<size_t>(m_cells) * sizeof(cell_t));
+      }
+
+      size_t gen_len() const
+      {
+        return(static_cast<size_t>(m_cells) * sizeof(uint32_t));
+      }
+
+      /* Maps one more slab and links its cells into the free list, lowest index on top. */
+      int32_t grow()
+      {
+        size_t len = slab_len();
+        size_t glen = gen_len();
+        bool hugepage = m_hugepage;
+        bool regular = false;
+        cell_t* base = nullptr;
+        uint32_t* gens = nullptr;
+        uint32_t first = m_capacity;
+
+        if(!m_dir || (static_cast<uint64_t>(first) + m_cells) > NIL) {
+          return(-1);
+        }
+
+        if(!(base = static_cast<cell_t*>(map(len, hugepage)))) {
+          return(-1);
+        }
+
+        /* generations start at 0, pages mapped anonymous are zero. */
+        if(!(gens = static_cast<uint32_t*>(map(glen, regular)))) {
+          unmap(base, len);
+          return(-1);
+        }
+
+        m_dir[m_slabs].m_cells = base;
+        m_dir[m_slabs].m_gen = gens;
+        ++m_slabs;
+        m_lens.push_back(len);
+        m_live.push_back(0);
+        m_hugepage_slabs += hugepage ? 1 : 0;
+        /* the slab is in the directory before a reader may index it. */
+        __atomic_store_n(&m_capacity, first + m_cells, __ATOMIC_RELEASE);
+
+        for(uint32_t off = m_cells; off > 0; --off) {
+          base[off - 1].m_next = m_free;
+          m_free = first + off - 1;
+        }
+
+        return(0);
+      }
+
+      uint32_t m_shift;
+      uint32_t m_cells;
+      bool m_hugepage;
+      uint32_t m_hugepage_slabs;
+      /* index of top of the free list. */
+      uint32_t m_free;
+      uint64_t m_used;
+      uint64_t m_peak;
+      /* slab of every index there may be, mapped by setup. */
+      slab_t* m_dir;
+      size_t m_dir_len;
+      uint32_t m_slabs;
+      /* cells of every slab mapped, published to readers. */
+      uint32_t m_capacity;
+      /* bytes mapped for every slab. */
+      std::vector<size_t> m_lens;
+      /* objects alive in every slab. */
+      std::vector<uint32_t> m_live;
+  };
+
+}
+
+#endif /*__SLAB_H__*/
@@ -0,0 +1,258 @@
+#ifndef __TAP_H__
+#define __TAP_H__
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "ace/Basic_Types.h"
+#include "ace/Task.h"
+#include "ace/Thread_Manager.h"
+
+#include "capture.h"
+
+namespace mna {
+
+  /**
+   * @brief Counters of the capture tap, summed over every ring.
+   * */
+  struct tap_stats_t {
+    /* Records written to file. */
+    uint64_t m_records;
+    /* Frames not captured as the ring was full. */
+    uint64_t m_drops;
+    /* Files opened since the tap was started. */
+    uint32_t m_files;
+  };
+
+  /**
+   * @brief Single producer single consumer ring of captured frames. The datapath of one
+   *        middleware pushes and the writer thread of the tap pops, neither ever waits for the
+   *        other: a frame finding the ring full is counted and dropped. Every slot holds one
+   *        record header followed by up to snaplen bytes of the frame.
+   * */
+  class tap_ring {
+    public:
+      enum : uint32_t {
+        CACHE_LINE = 64
+      };
+
+      struct record_t {
+        /* capture time in ns since epoch. */
+        uint64_t m_stamp;
+        /* length of frame on the wire. */
+        uint32_t m_len;
+        /* bytes of frame following this header. */
+        uint16_t m_caplen;
+        /* pcapng_sink::dir_t */
+        uint8_t m_dir;
+        uint8_t m_rsvd;
+      };
+
+      tap_ring()
+      {
+        m_mask = 0;
+        m_slot_size = 0;
+        m_snaplen = 0;
+        m_trace_all = true;
+        m_mac.fill(0);
+        m_head.store(0);
+        m_tail_cache = 0;
+        m_drops.store(0);
+        m_tail.store(0);
+        m_tail_local = 0;
+        m_head_cache = 0;
+      }
+
+      tap_ring(const tap_ring& ) = delete;
+      tap_ring(tap_ring&& ) = delete;
+      ~tap_ring() = default;
+
+      /*
+       * @brief Allocates the slots.
+       * @param number of slots, rounded up to power of two.
+       * @param bytes kept of every frame, 0 keeps up to a packet pool buffer.
+       * @param client MAC to be traced, all zero traces every frame.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup(uint32_t slots, uint32_t snaplen, const std::array<uint8_t, 6>& mac);
+
+      /*
+       * @brief Producer side, copies the frame into next free slot unless it is filtered out.
+       * @param ethernet frame.
+       * @param length of frame.
+       * @param direction of frame.
+       * @param capture time in ns since epoch.
+       * @return none
+       * */
+      void push(const uint8_t* frame, uint32_t len, pcapng_sink::dir_t dir, uint64_t stamp);
+
+      /*
+       * @brief Consumer side, returns the oldest record not yet popped.
+       * @param none
+       * @return record followed by its frame, nullptr when ring is empty.
+       * */
+      const record_t* front();
+
+      /* Consumer side, moves past the record returned by front, the slot is handed back
+         to producer with commit. */
+      void pop()
+      {
+        ++m_tail_local;
+      }
+
+      void commit()
+      {
+        m_tail.store(m_tail_local, std::memory_order_release);
+      }
+
+      uint64_t drops() const
+      {
+        return(m_drops.load(std::memory_order_relaxed));
+      }
+
+      uint32_t snaplen() const
+      {
+        return(m_snaplen);
+      }
+
+      bool is_setup() const
+      {
+        return(m_mask != 0);
+      }
+
+    private:
+      /* Returns true if frame is from or to the traced client, by ethernet or BOOTP chaddr. */
+      bool wanted(const uint8_t* frame, uint32_t len) const;
+
+      record_t* slot(uint64_t seq) const
+      {
+        return(reinterpret_cast<record_t*>(m_slots.get() + ((seq & m_mask) * m_slot_size)));
+      }
+
+      /* read only once set up. */
+      std::unique_ptr<uint8_t[]> m_slots;
+      uint64_t m_mask;
+      uint32_t m_slot_size;
+      uint32_t m_snaplen;
+      bool m_trace_all;
+      std::array<uint8_t, 6> m_mac;
+      /* producer */
+      alignas(CACHE_LINE) std::atomic<uint64_t> m_head;
+      uint64_t m_tail_cache;
+      std::atomic<uint64_t> m_drops;
+      /* consumer */
+      alignas(CACHE_LINE) std::atomic<uint64_t> m_tail;
+      uint64_t m_tail_local;
+      uint64_t m_head_cache;
+  };
+
+  /**
+   * @brief Always-on capture of frames received and transmitted by every middleware. Each
+   *        middleware pushes into a ring of its own and one writer thread drains every ring
+   *        into a pcapng file, one interface per ring. The file is rotated once it grows past
+   *        the configured size and only the most recent files are kept.
+   * */
+  class capture_tap : public ACE_Task_Base {
+    public:
+      enum : uint32_t {
+        MAX_RINGS = 64,
+        /* records written from one ring before moving on to the next. */
+        DRAIN_BUDGET = 256
+      };
+
+      capture_tap() : ACE_Task_Base(&m_thr_mgr)
+      {
+        m_slots = 0;
+        m_snaplen = 0;
+        m_file_bytes = 0;
+        m_keep = 0;
+        m_seq.store(0);
+        m_mac.fill(0);
+        m_count.store(0);
+        m_done.store(false);
+        m_running = false;
+        m_records.store(0);
+      }
+
+      capture_tap(const capture_tap& ) = delete;
+      capture_tap(capture_tap&& ) = delete;
+
+      virtual ~capture_tap()
+      {
+        stop();
+      }
+
+      /*
+       * @brief Configures the tap, rings attached afterwards capture frames.
+       * @param path prefix of files, <prefix>.<n>.pcapng.
+       * @param slots of every ring.
+       * @param bytes kept of every frame, 0 keeps whole frames.
+       * @param size in MB after which next file is started.
+       * @param number of files kept, 0 keeps every file.
+       * @param client MAC to be traced, all zero traces every frame.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup(const std::string& prefix, uint32_t slots, uint32_t snaplen,
+                    uint32_t fileMB, uint32_t files, const std::array<uint8_t, 6>& mac);
+
+      /*
+       * @brief Hands out the ring of one more middleware.
+       * @param none
+       * @return ring, nullptr when tap is not set up or every ring is taken.
+       * */
+      tap_ring* attach();
+
+      /*
+       * @brief Spawns the writer thread.
+       * @param none
+       * @return 0 upon success else < 0.
+       * */
+      int open(void* args = 0) override;
+
+      /*
+       * @brief Drains every ring to file until stop is invoked.
+       * @param none
+       * @return 0 upon success else < 0.
+       * */
+      int svc(void) override;
+
+      /* Drains what is left, closes the file and joins the writer thread. */
+      void stop();
+
+      tap_stats_t stats() const;
+
+      /* Tap shared by every middleware of the process. */
+      static capture_tap& instance();
+
+    private:
+      /* Writes up to DRAIN_BUDGET records of every ring, returns number of records written. */
+      uint32_t drain();
+      /* Closes current file, if any, and opens next one. */
+      int32_t rotate();
+      void close_file();
+
+      std::string m_prefix;
+      uint32_t m_slots;
+      uint32_t m_snaplen;
+      uint64_t m_file_bytes;
+      /* files kept, 0 keeps every file. */
+      uint32_t m_keep;
+      /* files opened, sequence number of next file. */
+      std::atomic<uint32_t> m_seq;
+      std::array<uint8_t, 6> m_mac;
+      std::array<tap_ring, MAX_RINGS> m_rings;
+      /* rings handed out, published to writer thread. */
+      std::atomic<uint32_t> m_count;
+      std::atomic<bool> m_done;
+      bool m_running;
+      std::atomic<uint64_t> m_records;
+      pcapng_sink m_sink;
+      /* writer thread is not waited for by ACE_Thread_Manager::instance. */
+      ACE_Thread_Manager m_thr_mgr;
+  };
+
+}
+
+#endif /*__TAP_H__*/
@@ -0,0 +1,235 @@
+#ifndef __WHEEL_H__
+#define __WHEEL_H__
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <time.h>
+
+#include "ace/Basic_Types.h"
+
+#include "delegate.hpp"
+#include "mac_index.h"
+
+namespace mna {
+
+  /**
+   * @brief Counters maintained by the timing wheel.
+   * */
+  struct wheel_stats_t {
+    /* Timers armed and not yet expired or cancelled. */
+    uint64_t m_pending;
+    /* Timers armed since startup. */
+    uint64_t m_scheduled;
+    /* Timers cancelled before expiry. */
+    uint64_t m_cancelled;
+    /* Timers dispatched upon expiry, every period of a periodic timer counts. */
+    uint64_t m_expired;
+    /* Timers moved down one level of the wheel. */
+    uint64_t m_cascaded;
+    /* Timers due and not yet dispatched as the budget of advance ran out. */
+    uint64_t m_backlog;
+    /* Age in ms of oldest due timer not yet dispatched, 0 when sweeper is up to date. */
+    uint64_t m_lag_ms;
+    /* Largest lag seen since startup. */
+    uint64_t m_max_lag_ms;
+    /* Calls to advance cut short by the budget. */
+    uint64_t m_throttled;
+  };
+
+  /**
+   * @brief Typed argument of a timer, the slot of the object the timer belongs to and the
+   *        generation of that slot when the timer was armed. The token travels by value as
+   *        the act of the timer, so nothing is allocated for it and nothing dangles, and a
+   *        timer of an object whose slot was recycled meanwhile is told apart by generation.
+   * */
+  struct timer_token_t {
+    uint32_t m_slot;
+    uint32_t m_gen;
+
+    const void* to_act() const
+    {
+      return(reinterpret_cast<const void*>((static_cast<uintptr_t>(m_gen) << 32) | m_slot));
+    }
+
+    static timer_token_t from_act(const void* act)
+    {
+      timer_token_t token;
+      uintptr_t v = reinterpret_cast<uintptr_t>(act);
+
+      token.m_slot = static_cast<uint32_t>(v & 0xFFFFFFFFU);
+      token.m_gen = static_cast<uint32_t>(v >> 32);
+      return(token);
+    }
+  };
+
+  static_assert(sizeof(uintptr_t) >= sizeof(timer_token_t), "timer token must fit into act of a timer");
+
+  /**
+   * @brief Hierarchical timing wheel of LEVELS levels of SLOTS slots each, level n covering
+   *        SLOTS^(n+1) ticks. A timer is linked into the slot of its expiry tick at the lowest
+   *        level able to hold it and moved one level down whenever the slot above comes due,
+   *        so arm, cancel and re-arm are O(1) and no allocation takes place once the node pool
+   *        is large enough. Timers are identified by node index and generation, a stale id
+   *        never reaches a node handed out again.
+   * */
+  class timing_wheel {
+    public:
+      using expiry_delegate_t = delegate<long (const void*)>;
+
+      enum : uint32_t {
+        SLOT_BITS = 8,
+        SLOTS = (1U << SLOT_BITS),
+        SLOT_MASK = (SLOTS - 1),
+        LEVELS = 4,
+        /* list of timers being dispatched, past the slots of every level. */
+        FIRING = (LEVELS * SLOTS),
+        /* m_prev of the first node of a list, or'ed with the list. */
+        HEAD = 0x80000000U,
+        NIL = 0xFFFFFFFFU
+      };
+
+      timing_wheel()
+      {
+        m_tick_ms = 1;
+        m_now = 0;
+        m_free = NIL;
+        m_heads.fill(NIL);
+        std::memset(&m_stats, 0, sizeof(m_stats));
+      }
+
+      timing_wheel(const timing_wheel& ) = delete;
+      timing_wheel(timing_wheel&& ) = delete;
+      ~timing_wheel() = default;
+
+      /*
+       * @brief Preallocates the node pool and aligns the wheel to the monotonic clock.
+       * @param number of timers which can be armed without growing the pool.
+       * @param resolution of the wheel in ms.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t setup(uint32_t timers, uint32_t tickMs);
+
+      /*
+       * @brief Arms a timer, it expires within one tick of the given delay.
+       * @param argument handed to the expiry delegate.
+       * @param delay in ms.
+       * @param period in ms of a periodic timer, 0 for a one-shot timer.
+       * @return id of the timer, < 0 upon failure.
+       * */
+      long schedule(const void* act, uint64_t delayMs, uint64_t intervalMs = 0);
+
+      /*
+       * @brief Disarms a timer, a stale or unknown id is ignored.
+       * @param id returned by schedule.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t cancel(long id);
+
+      /*
+       * @brief Moves a pending timer to a new expiry in place, the id stays valid.
+       * @param id returned by schedule.
+       * @param delay in ms from now.
+       * @return 0 upon success else < 0 if the timer is no longer pending.
+       * */
+      int32_t rearm(long id, uint64_t delayMs);
+
+      /*
+       * @brief Expires every tick up to the given time and dispatches due timers. A periodic
+       *        timer is armed again before its dispatch, timers may be armed and cancelled
+       *        from within the delegate. Once either budget is used up the timers left due
+       *        stay in backlog and the next call carries on with them before expiring any
+       *        further tick, so that a wave of expiries is spread over several calls.
+       * @param current monotonic time in ms.
+       * @param delegate invoked with argument of every expired timer.
+       * @param maximum number of timers dispatched, 0 for no limit.
+       * @param maximum time in ns spent dispatching, 0 for no limit.
+       * @return number of timers dispatched.
+       * */
+      uint32_t advance(uint64_t nowMs, expiry_delegate_t dispatch, uint32_t maxTimers = 0, uint64_t maxNs = 0);
+
+      /* Number of timers due and waiting for next advance. */
+      uint64_t backlog() const
+      {
+        return(m_stats.m_backlog);
+      }
+
+      const wheel_stats_t& stats() const
+      {
+        return(m_stats);
+      }
+
+      /* Bytes held by the nodes of timers and the periods of periodic ones. */
+      uint64_t bytes() const
+      {
+        return((m_nodes.capacity() * sizeof(node_t)) + m_intervals.bytes());
+      }
+
+      uint32_t tick_ms() const
+      {
+        return(m_tick_ms);
+      }
+
+      /* Monotonic clock in ms the wheel is advanced with. */
+      static uint64_t now_ms()
+      {
+        return(now_ns() / 1000000ULL);
+      }
+
+      static uint64_t now_ns()
+      {
+        struct timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return((static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec);
+      }
+
+    private:
+      /* one per armed timer, kept to 24 bytes as there is one per lease. */
+      struct node_t {
+        const void* m_act;
+        /* tick at which the timer is due, at or before m_now while in the firing list only. */
+        uint64_t m_expiry : 47;
+        /* period is held in m_intervals. */
+        uint64_t m_periodic : 1;
+        /* bumped upon every release, half of the timer id. */
+        uint64_t m_gen : 16;
+        /* next in the list of a slot, next free node while in the pool. */
+        uint32_t m_next;
+        /* previous in the list of a slot, HEAD | list for the first one, NIL while in the pool. */
+        uint32_t m_prev;
+      };
+
+      static_assert(sizeof(node_t) == 24, "node of a timer is expected to be 24 bytes");
+
+      /* Returns the node of a pending timer, NIL for a stale or unknown id. */
+      uint32_t lookup(long id) const;
+      uint32_t alloc();
+      void release(uint32_t idx);
+      void link(uint32_t idx);
+      void unlink(uint32_t idx);
+      /* Moves every timer of the slot down to where it belongs now. */
+      void cascade(uint32_t list);
+      /* Dispatches timers of the firing list until it is empty or the budget is used up. */
+      uint32_t fire(expiry_delegate_t& dispatch, uint32_t maxTimers, uint64_t deadline);
+
+      uint64_t ticks(uint64_t ms) const
+      {
+        /* rounded up to whole ticks. */
+        return((ms + m_tick_ms - 1) / m_tick_ms);
+      }
+
+      uint32_t m_tick_ms;
+      /* last tick expired. */
+      uint64_t m_now;
+      uint32_t m_free;
+      std::vector<node_t> m_nodes;
+      std::array<uint32_t, FIRING + 1> m_heads;
+      /* period in ticks of periodic timers keyed by node, few are armed at a time. */
+      mac_index m_intervals;
+      wheel_stats_t m_stats;
+  };
+
+}
+
+#endif /*__WHEEL_H__*/
@@ -0,0 +1,91 @@
+#ifndef __WORKER_H__
+#define __WORKER_H__
+
+#include "ace/Task.h"
+#include "ace/Reactor.h"
+
+#include "middleware.h"
+#include "loop.h"
+
+namespace mna {
+
+  /**
+   * @brief A worker thread owning its own reactor, raw socket, protocol stack and dhcp::server
+   *        shard. Sockets of every worker join one PACKET_FANOUT group which is keyed on client
+   *        MAC, hence every packet of a lease is processed by the same worker and the per lease
+   *        FSM is never touched by two threads.
+   * */
+  class worker : public ACE_Task_Base {
+    public:
+      worker(const std::string& intf, const config_t& cfg, uint32_t id)
+      {
+        m_id = id;
+        m_reactor = nullptr;
+        m_mw = nullptr;
+        m_loop = nullptr;
+
+        config_t own(cfg);
+
+        /* the worker serves the shard of the lease table its socket is fanned out to. */
+        own.m_shard = id;
+
+        /* one listener per port, the first worker answers leasequery. */
+        if(id) {
+          own.m_leasequery_port = 0;
+        }
+
+        m_reactor = mna::event_loop::make_reactor(cfg.m_loop);
+        ACE_NEW_NORETURN(m_mw, mna::middleware(std::string(intf), own));
+
+        if(m_reactor && m_mw) {
+          ACE_NEW_NORETURN(m_loop, mna::event_loop(*m_mw, *m_reactor));
+        }
+      }
+
+      worker(const worker& ) = delete;
+      worker(worker&& ) = delete;
+
+      virtual ~worker()
+      {
+        delete m_loop;
+        delete m_mw;
+        delete m_reactor;
+      }
+
+      /*
+       * @brief Spawns the thread of this worker.
+       * @param none
+       * @return 0 upon success else < 0.
+       * */
+      int open(void* args = 0) override;
+
+      /*
+       * @brief Runs the reactor of this worker until stop is invoked.
+       * @param none
+       * @return 0 upon success else < 0.
+       * */
+      int svc(void) override;
+
+      /* Ends the event loop of this worker. */
+      void stop();
+
+      mna::middleware& mw() const
+      {
+        return(*m_mw);
+      }
+
+      uint32_t id() const
+      {
+        return(m_id);
+      }
+
+    private:
+      uint32_t m_id;
+      ACE_Reactor* m_reactor;
+      mna::middleware* m_mw;
+      mna::event_loop* m_loop;
+  };
+
+}
+
+#endif /*__WORKER_H__*/
@@ -0,0 +1,169 @@
+#ifndef __XDP_H__
+#define __XDP_H__
+
+#include <cstring>
+#include <vector>
+#include <linux/bpf.h>
+#include <linux/if_xdp.h>
+
+#include "ace/Basic_Types.h"
+#include "ace/Event_Handler.h"
+
+#include "delegate.hpp"
+
+namespace mna {
+
+  /**
+   * @brief Counters maintained by the AF_XDP backend.
+   * */
+  struct xdp_stats_t {
+    /* Frames received from RX ring and dispatched upstream. */
+    uint64_t m_rx_frames;
+    /* Frames queued into TX ring. */
+    uint64_t m_tx_frames;
+    /* Frames dropped because no UMEM frame or TX descriptor was free. */
+    uint64_t m_tx_drops;
+    /* Number of sendto kicks issued for TX ring. */
+    uint64_t m_kicks;
+    /* Frames dropped by kernel, read with XDP_STATISTICS. */
+    uint64_t m_rx_dropped;
+    /* Number of times the fill ring was found empty by kernel. */
+    uint64_t m_fill_empty;
+  };
+
+  /**
+   * @brief AF_XDP socket bound to one queue of the interface, with its UMEM, fill, completion,
+   *        RX and TX rings. An XDP program attached in generic (SKB) mode redirects DHCP and
+   *        ARP frames to the socket and passes everything else to the kernel stack, so it can
+   *        be run on a veth pair. Frames are handed upstream as (const uint8_t*, uint32_t),
+   *        same as the PF_PACKET backend.
+   * */
+  class xdp {
+    public:
+      using frame_delegate_t = delegate<int32_t (const uint8_t*, uint32_t)>;
+
+      xdp()
+      {
+        m_handle = -1;
+        m_map_fd = -1;
+        m_prog_fd = -1;
+        m_link_fd = -1;
+        m_umem = nullptr;
+        m_umem_len = 0;
+        m_frame_size = 0;
+        m_tx_prod = 0;
+        m_tx_pending = 0;
+        std::memset(&m_stats, 0, sizeof(m_stats));
+      }
+
+      xdp(const xdp& ) = delete;
+      xdp(xdp&& ) = delete;
+
+      ~xdp()
+      {
+        close();
+      }
+
+      /*
+       * @brief Creates the AF_XDP socket with its UMEM and rings, binds it to the queue in copy
+       *        mode and attaches the redirect program to the interface.
+       * @param index of the interface.
+       * @param queue of the interface to be bound to.
+       * @param number of UMEM frames, half of them are used for receive and half for transmit.
+       * @param size of one UMEM frame, power of two not less than 2048.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t open(int32_t ifindex, uint32_t queue, uint32_t frames, uint32_t frameSize);
+
+      /* Detaches the program and releases socket, rings and UMEM. */
+      void close();
+
+      /*
+       * @brief Dispatches every frame in RX ring upstream and hands the frames back to kernel
+       *        through the fill ring.
+       * @param delegate to which each frame is dispatched.
+       * @return number of frames dispatched.
+       * */
+      uint32_t poll(frame_delegate_t upstream);
+
+      /*
+       * @brief Returns a free UMEM frame of the transmit half, caller encodes frame in place.
+       * @param capacity of the frame is updated.
+       * @return pointer to frame else nullptr when none is free.
+       * */
+      uint8_t* acquire(uint32_t& capacity);
+
+      /*
+       * @brief Queues a frame into TX ring, a frame not encoded in place is copied into a free
+       *        UMEM frame first.
+       * @param pointer to ethernet frame.
+       * @param length of ethernet frame.
+       * @return 0 upon success else < 0.
+       * */
+      int32_t commit(const uint8_t* frame, uint32_t len);
+
+      /*
+       * @brief Publishes queued descriptors, kicks kernel and recycles completed frames.
+       * @param none
+       * @return number of frames published.
+       * */
+      uint32_t flush();
+
+      ACE_HANDLE handle() const
+      {
+        return(m_handle);
+      }
+
+      bool is_open() const
+      {
+        return(m_handle >= 0);
+      }
+
+      const xdp_stats_t& stats();
+
+    private:
+      /**
+       * @brief One single producer single consumer ring shared with kernel.
+       * */
+      struct ring_t {
+        uint32_t* m_producer;
+        uint32_t* m_consumer;
+        uint32_t* m_flags;
+        void* m_desc;
+        uint32_t m_mask;
+        void* m_map;
+        size_t m_map_len;
+      };
+
+      int32_t map_ring(ring_t& ring, uint64_t pgoff, const struct xdp_ring_offset& off,
+                       uint32_t count, size_t descSize);
+      void unmap_ring(ring_t& ring);
+
+      /* Creates the XSKMAP, loads the program and attaches it to the interface. */
+      int32_t load_program(int32_t ifindex, uint32_t queue);
+
+      /* Moves completed transmit frames back to the free list. */
+      void reclaim();
+
+      ACE_HANDLE m_handle;
+      int32_t m_map_fd;
+      int32_t m_prog_fd;
+      int32_t m_link_fd;
+      uint8_t* m_umem;
+      size_t m_umem_len;
+      uint32_t m_frame_size;
+      ring_t m_fill;
+      ring_t m_comp;
+      ring_t m_rx;
+      ring_t m_tx;
+      /* Local producer of TX ring, published upon flush. */
+      uint32_t m_tx_prod;
+      uint32_t m_tx_pending;
+      /* UMEM addresses of free transmit frames. */
+      std::vector<uint64_t> m_tx_free;
+      xdp_stats_t m_stats;
+  };
+
+}
+
+#endif /*__XDP_H__*/
@@ -0,0 +1,125 @@
+#ifndef __BATCH_CC__
+#define __BATCH_CC__
+
+#include <cerrno>
+
+#include "ace/Log_Msg.h"
+
+#include "batch.h"
+
+int32_t mna::mmsg_batch::setup(uint32_t count, uint32_t frameSize)
+{
+  if(count < 2 || !frameSize) {
+    return(-1);
+  }
+
+  m_count = count;
+  m_frame_size = frameSize;
+  m_tx_pending = 0;
+
+  m_rx_buf.assign(static_cast<size_t>(count) * frameSize, 0);
+  m_rx_iov.resize(count);
+  m_rx_msg.resize(count);
+  m_tx_buf.assign(static_cast<size_t>(count) * frameSize, 0);
+  m_tx_iov.resize(count);
+  m_tx_msg.resize(count);
+
+  for(uint32_t idx = 0; idx < count; ++idx) {
+    m_rx_iov[idx].iov_base = &m_rx_buf[static_cast<size_t>(idx) * frameSize];
+    m_rx_iov[idx].iov_len = frameSize;
+    std::memset(&m_rx_msg[idx], 0, sizeof(struct mmsghdr));
+    m_rx_msg[idx].msg_hdr.msg_iov = &m_rx_iov[idx];
+    m_rx_msg[idx].msg_hdr.msg_iovlen = 1;
+
+    m_tx_iov[idx].iov_base = &m_tx_buf[static_cast<size_t>(idx) * frameSize];
+    m_tx_iov[idx].iov_len = 0;
+    std::memset(&m_tx_msg[idx], 0, sizeof(struct mmsghdr));
+    m_tx_msg[idx].msg_hdr.msg_iov = &m_tx_iov[idx];
+    m_tx_msg[idx].msg_hdr.msg_iovlen = 1;
+  }
+
+  return(0);
+}
+
+int32_t mna::mmsg_batch::recv(ACE_HANDLE handle, frame_delegate_t upstream)
+{
+  int32_t received = ::recvmmsg(handle, m_rx_msg.data(), m_count, MSG_DONTWAIT, nullptr);
+
+  if(received < 0) {
+    if(EAGAIN != errno && EWOULDBLOCK != errno) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l recvmmsg failed for handle %d\n"), handle));
+      return(-1);
+    }
+    return(0);
+  }
+
+  for(int32_t idx = 0; idx < received; ++idx) {
+    upstream(reinterpret_cast<const uint8_t*>(m_rx_iov[idx].iov_base), m_rx_msg[idx].msg_len);
+  }
+
+  if(received > 0) {
+    ++m_stats.m_rx_calls;
+    m_stats.m_rx_frames += received;
+
+    if(static_cast<uint32_t>(received) > m_stats.m_max_rx_batch) {
+      m_stats.m_max_rx_batch = received;
+    }
+  }
+
+  return(received);
+}
+
+uint8_t* mna::mmsg_batch::acquire(uint32_t& capacity)
+{
+  if(m_tx_pending >= m_count) {
+    return(nullptr);
+  }
+
+  capacity = m_frame_size;
+  return(reinterpret_cast<uint8_t*>(m_tx_iov[m_tx_pending].iov_base));
+}
+
+int32_t mna::mmsg_batch::queue(const uint8_t* frame, uint32_t len)
+{
+  uint32_t capacity = 0;
+  uint8_t* buf = acquire(capacity);
+
+  if(!buf || len > capacity) {
+    ++m_stats.m_tx_drops;
+    return(-1);
+  }
+
+  if(frame != buf) {
+    std::memcpy(buf, frame, len);
+  }
+
+  m_tx_iov[m_tx_pending].iov_len = len;
+  ++m_tx_pending;
+
+  return(0);
+}
+
+uint32_t mna::mmsg_batch::flush(ACE_HANDLE handle)
+{
+  uint32_t sent = 0;
+
+  while(sent < m_tx_pending) {
+    int32_t ret = ::sendmmsg(handle, &m_tx_msg[sent], (m_tx_pending - sent), 0);
+    ++m_stats.m_tx_calls;
+
+    if(ret <= 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l sendmmsg failed for handle %d\n"), handle));
+      m_stats.m_tx_drops += (m_tx_pending - sent);
+      break;
+    }
+
+    sent += ret;
+  }
+
+  m_stats.m_tx_frames += sent;
+  m_tx_pending = 0;
+
+  return(sent);
+}
+
+#endif /*__BATCH_CC__*/
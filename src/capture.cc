@@ -0,0 +1,566 @@
+#ifndef __CAPTURE_CC__
+#define __CAPTURE_CC__
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ace/Log_Msg.h"
+#include "ace/OS_NS_fcntl.h"
+#include "ace/OS_NS_sys_mman.h"
+#include "ace/OS_NS_sys_stat.h"
+#include "ace/OS_NS_unistd.h"
+
+#include "capture.h"
+
+namespace {
+
+  enum pcap_t : uint32_t {
+    PCAP_MAGIC_US = 0xA1B2C3D4U,
+    PCAP_MAGIC_NS = 0xA1B23C4DU,
+    PCAP_HDR_LEN = 24,
+    PCAP_REC_LEN = 16,
+    LINKTYPE_ETHERNET = 1,
+    /* pcapng block types */
+    NG_SHB = 0x0A0D0D0AU,
+    NG_IDB = 0x00000001U,
+    NG_SPB = 0x00000003U,
+    NG_ISB = 0x00000005U,
+    NG_EPB = 0x00000006U,
+    NG_BYTE_ORDER = 0x1A2B3C4DU,
+    NG_OPT_END = 0,
+    NG_OPT_IF_NAME = 2,
+    NG_OPT_EPB_FLAGS = 2,
+    NG_OPT_ISB_IFDROP = 5,
+    NG_OPT_TSRESOL = 9
+  };
+
+  /* buffered records are written out once this much is pending. */
+  const size_t SINK_CHUNK = 256 * 1024;
+
+}
+
+uint16_t mna::pcap_source::u16(const uint8_t* in) const
+{
+  uint16_t v = 0;
+  std::memcpy(&v, in, sizeof(v));
+  return(m_swap ? __builtin_bswap16(v) : v);
+}
+
+uint32_t mna::pcap_source::u32(const uint8_t* in) const
+{
+  uint32_t v = 0;
+  std::memcpy(&v, in, sizeof(v));
+  return(m_swap ? __builtin_bswap32(v) : v);
+}
+
+int32_t mna::pcap_source::open(const std::string& path)
+{
+  ACE_HANDLE handle = ACE_INVALID_HANDLE;
+  struct stat st;
+  int32_t retStatus = -1;
+  uint32_t magic = 0;
+
+  close();
+
+  do {
+
+    if((handle = ACE_OS::open(path.c_str(), O_RDONLY)) == ACE_INVALID_HANDLE) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l open of capture %s failed\n"), path.c_str()));
+      break;
+    }
+
+    if(ACE_OS::fstat(handle, &st) < 0 || st.st_size < PCAP_HDR_LEN) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l capture %s is too short\n"), path.c_str()));
+      break;
+    }
+
+    /* private writable mapping, a layer scribbling on a frame never reaches the file. */
+    void* base = ACE_OS::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE, handle, 0);
+
+    if(MAP_FAILED == base) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l mmap of capture %s failed\n"), path.c_str()));
+      break;
+    }
+
+    m_base = reinterpret_cast<uint8_t*>(base);
+    m_len = st.st_size;
+    std::memcpy(&magic, m_base, sizeof(magic));
+
+    if(NG_SHB == magic) {
+      /* byte order is taken from each section header as it is met. */
+      m_ng = true;
+      m_offset = 0;
+      retStatus = 0;
+      break;
+    }
+
+    m_ng = false;
+    m_swap = (PCAP_MAGIC_US == __builtin_bswap32(magic) || PCAP_MAGIC_NS == __builtin_bswap32(magic));
+    magic = m_swap ? __builtin_bswap32(magic) : magic;
+
+    if(PCAP_MAGIC_US != magic && PCAP_MAGIC_NS != magic) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l %s is neither pcap nor pcapng\n"), path.c_str()));
+      break;
+    }
+
+    m_nsec = (PCAP_MAGIC_NS == magic);
+    m_linktype = u32(m_base + 20);
+    m_offset = PCAP_HDR_LEN;
+    retStatus = 0;
+
+  } while(0);
+
+  if(handle != ACE_INVALID_HANDLE) {
+    /* mapping outlives the descriptor. */
+    ACE_OS::close(handle);
+  }
+
+  if(retStatus < 0) {
+    close();
+  }
+
+  return(retStatus);
+}
+
+void mna::pcap_source::close()
+{
+  if(m_base) {
+    ACE_OS::munmap(m_base, m_len);
+  }
+
+  m_base = nullptr;
+  m_len = 0;
+  m_offset = 0;
+  m_interfaces.clear();
+}
+
+int32_t mna::pcap_source::next(const uint8_t*& frame, uint32_t& len, uint64_t& stamp)
+{
+  if(!m_base) {
+    return(-1);
+  }
+
+  return(m_ng ? next_pcapng(frame, len, stamp) : next_pcap(frame, len, stamp));
+}
+
+int32_t mna::pcap_source::next_pcap(const uint8_t*& frame, uint32_t& len, uint64_t& stamp)
+{
+  while((m_offset + PCAP_REC_LEN) <= m_len) {
+    const uint8_t* rec = m_base + m_offset;
+    uint32_t capLen = u32(rec + 8);
+
+    if((m_offset + PCAP_REC_LEN + capLen) > m_len) {
+      /* truncated last record */
+      break;
+    }
+
+    m_offset += PCAP_REC_LEN + capLen;
+
+    if(LINKTYPE_ETHERNET != m_linktype) {
+      continue;
+    }
+
+    frame = rec + PCAP_REC_LEN;
+    len = capLen;
+    stamp = (static_cast<uint64_t>(u32(rec)) * 1000000000ULL) +
+            (m_nsec ? u32(rec + 4) : (static_cast<uint64_t>(u32(rec + 4)) * 1000ULL));
+    return(1);
+  }
+
+  return(0);
+}
+
+void mna::pcap_source::parse_interface(const uint8_t* body, uint32_t bodyLen)
+{
+  interface_t intf;
+  uint32_t offset = 8;
+
+  /* microsecond resolution unless told otherwise. */
+  intf.m_linktype = u16(body);
+  intf.m_snaplen = u32(body + 4);
+  intf.m_exp = 6;
+  intf.m_pow2 = false;
+
+  while((offset + 4) <= bodyLen) {
+    uint16_t code = u16(body + offset);
+    uint16_t optLen = u16(body + offset + 2);
+
+    if(NG_OPT_END == code || (offset + 4 + optLen) > bodyLen) {
+      break;
+    }
+
+    if(NG_OPT_TSRESOL == code && optLen >= 1) {
+      uint8_t v = body[offset + 4];
+      bool pow2 = (v & 0x80);
+      uint8_t exp = (v & 0x7F);
+
+      /* a timestamp is 64 bits, finer units than these can not be converted. */
+      if((pow2 && exp >= 64) || (!pow2 && exp > 19)) {
+        ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l if_tsresol 0x%x is not supported, microseconds are assumed\n"), v));
+      } else {
+        intf.m_pow2 = pow2;
+        intf.m_exp = exp;
+      }
+    }
+
+    /* options are padded to 32 bits. */
+    offset += 4 + ((optLen + 3) & ~3U);
+  }
+
+  m_interfaces.push_back(intf);
+}
+
+uint64_t mna::pcap_source::to_ns(const interface_t& intf, uint64_t ts) const
+{
+  uint64_t scale = 1;
+
+  if(intf.m_pow2) {
+    return(static_cast<uint64_t>((static_cast<long double>(ts) * 1000000000.0L) / (1ULL << intf.m_exp)));
+  }
+
+  if(intf.m_exp <= 9) {
+    for(uint8_t idx = intf.m_exp; idx < 9; ++idx) {
+      scale *= 10;
+    }
+    return(ts * scale);
+  }
+
+  for(uint8_t idx = 9; idx < intf.m_exp; ++idx) {
+    scale *= 10;
+  }
+  return(ts / scale);
+}
+
+int32_t mna::pcap_source::next_pcapng(const uint8_t*& frame, uint32_t& len, uint64_t& stamp)
+{
+  while((m_offset + 12) <= m_len) {
+    const uint8_t* blk = m_base + m_offset;
+    uint32_t type = 0;
+    uint32_t blkLen = 0;
+
+    std::memcpy(&type, blk, sizeof(type));
+
+    if(NG_SHB == type) {
+      uint32_t order = 0;
+      /* a new section may switch byte order, interfaces are per section. */
+      std::memcpy(&order, blk + 8, sizeof(order));
+      m_swap = (NG_BYTE_ORDER != order);
+      m_interfaces.clear();
+    }
+
+    type = u32(blk);
+    blkLen = u32(blk + 4);
+
+    if(blkLen < 12 || (m_offset + blkLen) > m_len) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l malformed pcapng block at offset %u\n"), m_offset));
+      return(-1);
+    }
+
+    m_offset += blkLen;
+    const uint8_t* body = blk + 8;
+    uint32_t bodyLen = blkLen - 12;
+
+    if(NG_IDB == type && bodyLen >= 8) {
+      parse_interface(body, bodyLen);
+      continue;
+    }
+
+    if(NG_EPB == type && bodyLen >= 20) {
+      uint32_t id = u32(body);
+      uint32_t capLen = u32(body + 12);
+
+      if(id >= m_interfaces.size() || LINKTYPE_ETHERNET != m_interfaces[id].m_linktype || capLen > (bodyLen - 20)) {
+        continue;
+      }
+
+      frame = body + 20;
+      len = capLen;
+      stamp = to_ns(m_interfaces[id], (static_cast<uint64_t>(u32(body + 4)) << 32) | u32(body + 8));
+      return(1);
+    }
+
+    if(NG_SPB == type && bodyLen >= 4 && !m_interfaces.empty()) {
+      uint32_t origLen = u32(body);
+      uint32_t capLen = origLen;
+
+      if(LINKTYPE_ETHERNET != m_interfaces[0].m_linktype) {
+        continue;
+      }
+
+      /* simple packet block carries no captured length and no timestamp. */
+      if(m_interfaces[0].m_snaplen && capLen > m_interfaces[0].m_snaplen) {
+        capLen = m_interfaces[0].m_snaplen;
+      }
+
+      if(capLen > (bodyLen - 4)) {
+        capLen = bodyLen - 4;
+      }
+
+      frame = body + 4;
+      len = capLen;
+      stamp = 0;
+      return(1);
+    }
+  }
+
+  return(0);
+}
+
+int32_t mna::pcap_sink::open(const std::string& path)
+{
+  uint8_t hdr[PCAP_HDR_LEN];
+  uint32_t v32 = 0;
+  uint16_t v16 = 0;
+
+  close();
+
+  if((m_handle = ACE_OS::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) == ACE_INVALID_HANDLE) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l creation of capture %s failed\n"), path.c_str()));
+    return(-1);
+  }
+
+  m_buf.clear();
+  m_buf.reserve(SINK_CHUNK + (64 * 1024));
+  m_frames = 0;
+
+  v32 = PCAP_MAGIC_NS; std::memcpy(hdr, &v32, 4);
+  v16 = 2; std::memcpy(hdr + 4, &v16, 2);
+  v16 = 4; std::memcpy(hdr + 6, &v16, 2);
+  /* thiszone and sigfigs */
+  v32 = 0; std::memcpy(hdr + 8, &v32, 4);
+  std::memcpy(hdr + 12, &v32, 4);
+  v32 = 65535; std::memcpy(hdr + 16, &v32, 4);
+  v32 = LINKTYPE_ETHERNET; std::memcpy(hdr + 20, &v32, 4);
+
+  m_buf.insert(m_buf.end(), hdr, hdr + sizeof(hdr));
+  return(0);
+}
+
+int32_t mna::pcap_sink::write(const uint8_t* frame, uint32_t len, uint64_t stamp)
+{
+  uint32_t rec[4];
+
+  if(!is_open()) {
+    return(-1);
+  }
+
+  rec[0] = static_cast<uint32_t>(stamp / 1000000000ULL);
+  rec[1] = static_cast<uint32_t>(stamp % 1000000000ULL);
+  rec[2] = len;
+  rec[3] = len;
+
+  m_buf.insert(m_buf.end(), reinterpret_cast<const uint8_t*>(rec), reinterpret_cast<const uint8_t*>(rec) + sizeof(rec));
+  m_buf.insert(m_buf.end(), frame, frame + len);
+  ++m_frames;
+
+  if(m_buf.size() >= SINK_CHUNK) {
+    return(flush());
+  }
+
+  return(0);
+}
+
+int32_t mna::pcap_sink::flush()
+{
+  size_t done = 0;
+
+  while(is_open() && done < m_buf.size()) {
+    ssize_t ret = ACE_OS::write(m_handle, m_buf.data() + done, m_buf.size() - done);
+
+    if(ret <= 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l write of capture failed for handle %d\n"), m_handle));
+      m_buf.clear();
+      return(-1);
+    }
+
+    done += ret;
+  }
+
+  m_buf.clear();
+  return(0);
+}
+
+void mna::pcap_sink::close()
+{
+  if(!is_open()) {
+    return;
+  }
+
+  flush();
+  ACE_OS::close(m_handle);
+  m_handle = ACE_INVALID_HANDLE;
+}
+
+int32_t mna::pcapng_sink::append(const void* data, size_t len)
+{
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+
+  m_buf.insert(m_buf.end(), in, in + len);
+  m_bytes += len;
+  return(0);
+}
+
+int32_t mna::pcapng_sink::open(const std::string& path)
+{
+  uint32_t shb[7];
+  int64_t sectionLen = -1;
+
+  close();
+
+  if((m_handle = ACE_OS::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) == ACE_INVALID_HANDLE) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l creation of capture %s failed\n"), path.c_str()));
+    return(-1);
+  }
+
+  m_buf.clear();
+  m_buf.reserve(SINK_CHUNK + (64 * 1024));
+  m_frames = 0;
+  m_bytes = 0;
+  m_interfaces = 0;
+
+  shb[0] = NG_SHB;
+  shb[1] = sizeof(shb);
+  shb[2] = NG_BYTE_ORDER;
+  /* version 1.0 */
+  shb[3] = 1;
+  /* section length is not known upfront. */
+  std::memcpy(&shb[4], &sectionLen, sizeof(sectionLen));
+  shb[6] = sizeof(shb);
+
+  return(append(shb, sizeof(shb)));
+}
+
+uint32_t mna::pcapng_sink::add_interface(const std::string& name, uint32_t snaplen)
+{
+  uint32_t nameLen = static_cast<uint32_t>(name.size());
+  uint32_t namePad = (nameLen + 3) & ~3U;
+  /* block header, linktype, snaplen, if_name, if_tsresol, end of options and trailer. */
+  uint32_t blkLen = 8 + 8 + (nameLen ? (4 + namePad) : 0) + 8 + 4 + 4;
+  uint32_t hdr[4];
+  uint32_t opt[3];
+  const uint32_t zero = 0;
+
+  if(!is_open()) {
+    return(m_interfaces);
+  }
+
+  hdr[0] = NG_IDB;
+  hdr[1] = blkLen;
+  /* linktype in lower half, reserved in upper half. */
+  hdr[2] = LINKTYPE_ETHERNET;
+  hdr[3] = snaplen;
+  append(hdr, sizeof(hdr));
+
+  if(nameLen) {
+    opt[0] = NG_OPT_IF_NAME | (nameLen << 16);
+    append(opt, 4);
+    append(name.data(), nameLen);
+    append(&zero, namePad - nameLen);
+  }
+
+  /* timestamps are in ns. */
+  opt[0] = NG_OPT_TSRESOL | (1U << 16);
+  opt[1] = 9;
+  opt[2] = NG_OPT_END;
+  append(opt, sizeof(opt));
+  append(&blkLen, sizeof(blkLen));
+
+  return(m_interfaces++);
+}
+
+int32_t mna::pcapng_sink::write(uint32_t id, const uint8_t* frame, uint32_t capLen, uint32_t len, uint64_t stamp, dir_t dir)
+{
+  uint32_t pad = ((capLen + 3) & ~3U) - capLen;
+  /* block header, epb fields, frame, epb_flags when known, end of options and trailer. */
+  uint32_t blkLen = 8 + 20 + capLen + pad + (dir ? 8 : 0) + 4 + 4;
+  uint32_t hdr[7];
+  uint32_t opt[3];
+  const uint32_t zero = 0;
+
+  if(!is_open()) {
+    return(-1);
+  }
+
+  hdr[0] = NG_EPB;
+  hdr[1] = blkLen;
+  hdr[2] = id;
+  hdr[3] = static_cast<uint32_t>(stamp >> 32);
+  hdr[4] = static_cast<uint32_t>(stamp);
+  hdr[5] = capLen;
+  hdr[6] = len;
+  append(hdr, sizeof(hdr));
+  append(frame, capLen);
+  append(&zero, pad);
+
+  if(dir) {
+    opt[0] = NG_OPT_EPB_FLAGS | (4U << 16);
+    opt[1] = dir;
+    append(opt, 8);
+  }
+
+  opt[0] = NG_OPT_END;
+  opt[1] = blkLen;
+  append(opt, 8);
+  ++m_frames;
+
+  if(m_buf.size() >= SINK_CHUNK) {
+    return(flush());
+  }
+
+  return(0);
+}
+
+int32_t mna::pcapng_sink::statistics(uint32_t id, uint64_t stamp, uint64_t drops)
+{
+  uint32_t blk[10];
+
+  if(!is_open()) {
+    return(-1);
+  }
+
+  blk[0] = NG_ISB;
+  blk[1] = sizeof(blk);
+  blk[2] = id;
+  blk[3] = static_cast<uint32_t>(stamp >> 32);
+  blk[4] = static_cast<uint32_t>(stamp);
+  blk[5] = NG_OPT_ISB_IFDROP | (8U << 16);
+  std::memcpy(&blk[6], &drops, sizeof(drops));
+  blk[8] = NG_OPT_END;
+  blk[9] = sizeof(blk);
+
+  return(append(blk, sizeof(blk)));
+}
+
+int32_t mna::pcapng_sink::flush()
+{
+  size_t done = 0;
+
+  while(is_open() && done < m_buf.size()) {
+    ssize_t ret = ACE_OS::write(m_handle, m_buf.data() + done, m_buf.size() - done);
+
+    if(ret <= 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l write of capture failed for handle %d\n"), m_handle));
+      m_buf.clear();
+      return(-1);
+    }
+
+    done += ret;
+  }
+
+  m_buf.clear();
+  return(0);
+}
+
+void mna::pcapng_sink::close()
+{
+  if(!is_open()) {
+    return;
+  }
+
+  flush();
+  ACE_OS::close(m_handle);
+  m_handle = ACE_INVALID_HANDLE;
+}
+
+#endif /*__CAPTURE_CC__*/
@@ -0,0 +1,183 @@
+#ifndef __EPOCH_CC__
+#define __EPOCH_CC__
+
+#include "epoch.h"
+
+struct mna::epoch::thread_slot_t {
+  uint32_t m_slot;
+  /* read sections the thread is inside of. */
+  uint32_t m_depth;
+
+  thread_slot_t()
+  {
+    m_slot = MAX_READERS;
+    m_depth = 0;
+  }
+
+  ~thread_slot_t()
+  {
+    if(m_slot < MAX_READERS) {
+      mna::epoch::instance().detach(m_slot);
+    }
+  }
+};
+
+thread_local mna::epoch::thread_slot_t mna::epoch::m_thread;
+
+mna::epoch& mna::epoch::instance()
+{
+  static mna::epoch domain;
+  return(domain);
+}
+
+mna::epoch::epoch()
+{
+  m_epoch = 1;
+  m_attached = 0;
+
+  for(reader_t& rd : m_readers) {
+    rd.m_epoch = QUIESCENT;
+    rd.m_used = false;
+  }
+}
+
+uint32_t mna::epoch::attach()
+{
+  for(uint32_t slot = 0; slot < MAX_READERS; ++slot) {
+    bool used = false;
+
+    if(!m_readers[slot].m_used.load(std::memory_order_relaxed) &&
+       m_readers[slot].m_used.compare_exchange_strong(used, true)) {
+      m_attached.fetch_add(1);
+      return(slot);
+    }
+  }
+
+  return(MAX_READERS);
+}
+
+void mna::epoch::detach(uint32_t slot)
+{
+  m_readers[slot].m_epoch.store(QUIESCENT);
+  m_readers[slot].m_used.store(false);
+  m_attached.fetch_sub(1);
+}
+
+bool mna::epoch::enter()
+{
+  reader_t* rd = nullptr;
+
+  if(m_thread.m_slot >= MAX_READERS && (m_thread.m_slot = attach()) >= MAX_READERS) {
+    return(false);
+  }
+
+  if(m_thread.m_depth++) {
+    return(true);
+  }
+
+  rd = &m_readers[m_thread.m_slot];
+  /* a seq_cst store is ordered before the loads of the section, pairing with safe. */
+  rd->m_epoch.store(m_epoch.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+  return(true);
+}
+
+void mna::epoch::leave()
+{
+  if(!--m_thread.m_depth) {
+    m_readers[m_thread.m_slot].m_epoch.store(QUIESCENT, std::memory_order_release);
+  }
+}
+
+uint64_t mna::epoch::safe()
+{
+  /* readers entering from now on announce a later epoch than anything retired so far. */
+  uint64_t oldest = m_epoch.fetch_add(1) + 1;
+
+  for(const reader_t& rd : m_readers) {
+    uint64_t announced = rd.m_epoch.load(std::memory_order_seq_cst);
+
+    if(announced != QUIESCENT && announced < oldest) {
+      oldest = announced;
+    }
+  }
+
+  return(oldest);
+}
+
+void mna::epoch::synchronize()
+{
+  uint64_t oldest = m_epoch.fetch_add(1) + 1;
+
+  for(const reader_t& rd : m_readers) {
+    uint64_t announced = rd.m_epoch.load(std::memory_order_seq_cst);
+
+    while(announced != QUIESCENT && announced < oldest) {
+      std::this_thread::yield();
+      announced = rd.m_epoch.load(std::memory_order_seq_cst);
+    }
+  }
+}
+
+void mna::limbo::retire(reclaim_t reclaim, uintptr_t arg)
+{
+  /* the stores unlinking the object are seen by any reader before its epoch or absence is. */
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  if(!mna::epoch::instance().readers()) {
+    reclaim(arg);
+    ++m_reclaimed;
+    ++m_retired;
+    return;
+  }
+
+  m_items.push_back(item_t{mna::epoch::instance().now(), reclaim, arg});
+  ++m_retired;
+
+  if(!(pending() % BATCH)) {
+    this->reclaim();
+  }
+}
+
+uint32_t mna::limbo::reclaim()
+{
+  uint64_t safe = 0;
+  uint32_t freed = 0;
+
+  if(m_head == m_items.size()) {
+    return(0);
+  }
+
+  safe = mna::epoch::instance().safe();
+
+  /* retired in order of epoch, the first one too recent ends the walk. */
+  while(m_head < m_items.size() && m_items[m_head].m_epoch < safe) {
+    item_t& item = m_items[m_head++];
+    item.m_reclaim(item.m_arg);
+    ++freed;
+  }
+
+  if(m_head == m_items.size()) {
+    m_items.clear();
+    m_head = 0;
+  } else if(m_head > (m_items.size() / 2)) {
+    m_items.erase(m_items.begin(), m_items.begin() + m_head);
+    m_head = 0;
+  }
+
+  m_reclaimed += freed;
+  return(freed);
+}
+
+void mna::limbo::drain()
+{
+  while(m_head < m_items.size()) {
+    item_t& item = m_items[m_head++];
+    item.m_reclaim(item.m_arg);
+    ++m_reclaimed;
+  }
+
+  m_items.clear();
+  m_head = 0;
+}
+
+#endif /*__EPOCH_CC__*/
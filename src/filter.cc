@@ -0,0 +1,212 @@
+#ifndef __FILTER_CC__
+#define __FILTER_CC__
+
+#include <algorithm>
+#include <sys/socket.h>
+
+#include "ace/Log_Msg.h"
+#include "ace/OS_NS_sys_socket.h"
+
+#include "filter.h"
+#include "protocol.h"
+
+bool mna::filter::enable(const match_t& m)
+{
+  if(std::find(m_handlers.begin(), m_handlers.end(), m) != m_handlers.end()) {
+    return(false);
+  }
+
+  m_handlers.push_back(m);
+  return(true);
+}
+
+bool mna::filter::disable(const match_t& m)
+{
+  std::vector<match_t>::iterator it = std::find(m_handlers.begin(), m_handlers.end(), m);
+
+  if(it == m_handlers.end()) {
+    return(false);
+  }
+
+  m_handlers.erase(it);
+  return(true);
+}
+
+/**
+ * @brief This member function generates one block of instructions per handler. A block which
+ *        does not match falls through to the next one, the last block falls through to reject.
+ *        Ports are only looked at in the first fragment of an IPv4 datagram.
+ * @param none
+ * @return none
+ * */
+void mna::filter::generate()
+{
+  /* jump which is resolved once the layout is known. */
+  struct fixup_t {
+    size_t m_pc;
+    bool m_jt;
+    int32_t m_target;
+  };
+
+  /* Placeholder targets, end of current block and accept. */
+  const int32_t NEXT = -2;
+  const int32_t ACCEPT = -1;
+  std::vector<fixup_t> fixups;
+  size_t first = 0;
+
+  m_program.clear();
+
+  for(std::vector<match_t>::const_iterator it = m_handlers.begin(); it != m_handlers.end(); ++it) {
+    const match_t& m = *it;
+    first = fixups.size();
+
+    m_program.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12));
+
+    if(!m.m_proto || m.m_ethertype != mna::eth::IPv4) {
+      m_program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, m.m_ethertype, 0, 0));
+      fixups.push_back({m_program.size() - 1, true, ACCEPT});
+      fixups.push_back({m_program.size() - 1, false, NEXT});
+
+    } else {
+      m_program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, mna::eth::IPv4, 0, 0));
+      fixups.push_back({m_program.size() - 1, false, NEXT});
+
+      /* IP protocol */
+      m_program.push_back(BPF_STMT(BPF_LD | BPF_B | BPF_ABS, sizeof(mna::eth::ETH) + 9));
+      m_program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, m.m_proto, 0, 0));
+      fixups.push_back({m_program.size() - 1, false, NEXT});
+
+      if(!m.m_port) {
+        fixups.push_back({m_program.size() - 1, true, ACCEPT});
+
+      } else {
+        /* fragment offset must be zero for the transport header to be present. */
+        m_program.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_ABS, sizeof(mna::eth::ETH) + 6));
+        m_program.push_back(BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1FFF, 0, 0));
+        fixups.push_back({m_program.size() - 1, true, NEXT});
+        /* X = IP header length */
+        m_program.push_back(BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, sizeof(mna::eth::ETH)));
+        /* destination port */
+        m_program.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_IND, sizeof(mna::eth::ETH) + 2));
+        m_program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, m.m_port, 0, 0));
+        fixups.push_back({m_program.size() - 1, true, ACCEPT});
+        fixups.push_back({m_program.size() - 1, false, NEXT});
+      }
+    }
+
+    /* A block which does not match falls through to the next one. */
+    for(size_t idx = first; idx < fixups.size(); ++idx) {
+      if(NEXT == fixups[idx].m_target) {
+        fixups[idx].m_target = static_cast<int32_t>(m_program.size());
+      }
+    }
+  }
+
+  /* reject followed by accept */
+  m_program.push_back(BPF_STMT(BPF_RET | BPF_K, 0));
+  m_program.push_back(BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF));
+
+  for(std::vector<fixup_t>::const_iterator fx = fixups.begin(); fx != fixups.end(); ++fx) {
+    size_t target = (ACCEPT == fx->m_target) ? (m_program.size() - 1) : static_cast<size_t>(fx->m_target);
+    uint8_t offset = static_cast<uint8_t>(target - (fx->m_pc + 1));
+
+    if(fx->m_jt) {
+      m_program[fx->m_pc].jt = offset;
+    } else {
+      m_program[fx->m_pc].jf = offset;
+    }
+  }
+}
+
+int32_t mna::filter::attach(ACE_HANDLE handle)
+{
+  struct sock_fprog prog;
+
+  generate();
+
+  prog.len = m_program.size();
+  prog.filter = m_program.data();
+
+  if(ACE_OS::setsockopt(handle, SOL_SOCKET, SO_ATTACH_FILTER, (const char *)&prog, sizeof(prog)) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l SO_ATTACH_FILTER failed for handle %d\n"), handle));
+    return(-1);
+  }
+
+  ++m_stats.m_attached;
+  return(0);
+}
+
+/**
+ * @brief The fanout program mirrors mna::lease_store::shard_of, members being a power of two so
+ *        that the member is the shard of the client; a frame too short to carry chaddr aborts
+ *        the program and lands on the first member. Unlike the socket filter, kernel
+ *        runs fanout program on received frames with data pointing at the IP header.
+ * */
+int32_t mna::filter::fanout(ACE_HANDLE handle, uint16_t group, uint32_t members)
+{
+  /* chaddr past the IP header, udp header followed by chaddr offset in dhcp header. */
+  const uint32_t chaddr = sizeof(mna::transport::UDP) + mna::dhcp::CHADDR_OFFSET;
+  int32_t arg = group | (PACKET_FANOUT_CBPF << 16);
+  struct sock_fprog prog;
+  struct sock_filter code[] = {
+    /* X = IP header length */
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+    /* chaddr[0..3] */
+    BPF_STMT(BPF_LD | BPF_W | BPF_IND, chaddr),
+    BPF_STMT(BPF_ST, 0),
+    /* chaddr[4..5] */
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, chaddr + 4),
+    BPF_STMT(BPF_LDX | BPF_MEM, 0),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x9E3779B1U),
+    BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+    BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+    BPF_STMT(BPF_ALU | BPF_AND | BPF_K, members - 1),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+
+  if(!members || (members & (members - 1))) {
+    return(-1);
+  }
+
+  if(ACE_OS::setsockopt(handle, SOL_PACKET, PACKET_FANOUT, (const char *)&arg, sizeof(arg)) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l PACKET_FANOUT group %u failed for handle %d\n"), group, handle));
+    return(-1);
+  }
+
+  prog.len = sizeof(code) / sizeof(code[0]);
+  prog.filter = code;
+
+  if(ACE_OS::setsockopt(handle, SOL_PACKET, PACKET_FANOUT_DATA, (const char *)&prog, sizeof(prog)) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l PACKET_FANOUT_DATA failed for handle %d\n"), handle));
+    return(-1);
+  }
+
+  return(0);
+}
+
+const mna::filter_stats_t& mna::filter::update(ACE_HANDLE handle)
+{
+  struct tpacket_stats_v3 st;
+  int len = sizeof(st);
+
+  std::memset((void *)&st, 0, sizeof(st));
+
+  if(ACE_OS::getsockopt(handle, SOL_PACKET, PACKET_STATISTICS, (char *)&st, &len) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l PACKET_STATISTICS failed for handle %d\n"), handle));
+    return(m_stats);
+  }
+
+  /* tp_packets includes the frames which were dropped. */
+  m_stats.m_delivered += (st.tp_packets - st.tp_drops);
+  m_stats.m_dropped += st.tp_drops;
+
+  if(len >= static_cast<int>(sizeof(struct tpacket_stats_v3))) {
+    m_stats.m_freeze += st.tp_freeze_q_cnt;
+  }
+
+  return(m_stats);
+}
+
+#endif /*__FILTER_CC__*/
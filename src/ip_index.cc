@@ -0,0 +1,195 @@
+#ifndef __IP_INDEX_CC__
+#define __IP_INDEX_CC__
+
+#include "ip_index.h"
+
+int32_t mna::ip_index::setup(uint32_t subnet, uint32_t prefixLen)
+{
+  uint64_t pages = 0;
+
+  if(prefixLen < MIN_PREFIX || prefixLen > 32) {
+    return(-1);
+  }
+
+  m_count = 1ULL << (32 - prefixLen);
+  m_subnet = subnet & static_cast<uint32_t>(~(m_count - 1));
+  m_size = 0;
+  m_pages_used = 0;
+
+  pages = (m_count + PAGE - 1) / PAGE;
+  clear();
+  m_pages.resize(pages, nullptr);
+  m_live.assign(pages, 0);
+  m_blocks.assign((m_count + BLOCK - 1) / BLOCK, 0);
+  m_used.assign((pages + WORD_BITS - 1) / WORD_BITS, 0);
+
+  return(0);
+}
+
+int32_t mna::ip_index::insert(uint32_t ip, uint32_t value)
+{
+  uint32_t idx = ip - m_subnet;
+  page_t* page = nullptr;
+
+  if(ip < m_subnet || idx >= m_count || NIL == value) {
+    return(-1);
+  }
+
+  if(!(page = m_pages[idx / PAGE])) {
+    page = new page_t;
+
+    for(uint32_t word = 0; word < PAGE / WORD_BITS; ++word) {
+      page->m_bits[word] = 0;
+    }
+
+    for(uint32_t off = 0; off < PAGE; ++off) {
+      page->m_value[off] = NIL;
+    }
+
+    /* filled in before a reader may see it. */
+    __atomic_store_n(&m_pages[idx / PAGE], page, __ATOMIC_RELEASE);
+    m_used[(idx / PAGE) / WORD_BITS] |= 1ULL << ((idx / PAGE) % WORD_BITS);
+    ++m_pages_used;
+  } else if(page->m_value[idx % PAGE] != NIL) {
+    return(-1);
+  }
+
+  page->m_value[idx % PAGE] = value;
+  page->m_bits[(idx % PAGE) / WORD_BITS] |= 1ULL << (idx % WORD_BITS);
+  ++m_live[idx / PAGE];
+  ++m_blocks[idx / BLOCK];
+  ++m_size;
+
+  return(0);
+}
+
+int32_t mna::ip_index::erase(uint32_t ip)
+{
+  uint32_t idx = ip - m_subnet;
+  page_t* page = nullptr;
+
+  if(find(ip) == NIL) {
+    return(-1);
+  }
+
+  page = m_pages[idx / PAGE];
+  page->m_value[idx % PAGE] = NIL;
+  page->m_bits[(idx % PAGE) / WORD_BITS] &= ~(1ULL << (idx % WORD_BITS));
+  --m_blocks[idx / BLOCK];
+  --m_size;
+
+  if(!--m_live[idx / PAGE]) {
+    __atomic_store_n(&m_pages[idx / PAGE], static_cast<page_t*>(nullptr), __ATOMIC_RELEASE);
+    m_used[(idx / PAGE) / WORD_BITS] &= ~(1ULL << ((idx / PAGE) % WORD_BITS));
+    --m_pages_used;
+
+    if(m_limbo) {
+      m_limbo->retire(limbo::reclaim_t::from<mna::ip_index, &mna::ip_index::free_page>(*this),
+                      reinterpret_cast<uintptr_t>(page));
+    } else {
+      delete page;
+    }
+  }
+
+  return(0);
+}
+
+uint64_t mna::ip_index::count(uint32_t prefix, uint32_t prefixLen) const
+{
+  uint64_t len = 0;
+  uint64_t first = 0;
+  uint64_t idx = 0;
+  uint64_t sum = 0;
+  const page_t* page = nullptr;
+
+  if(prefixLen > 32 || !m_count) {
+    return(0);
+  }
+
+  len = 1ULL << (32 - prefixLen);
+  first = prefix & ~(len - 1);
+
+  if(len >= m_count) {
+    /* prefix covers the whole subnet or lies beside it. */
+    return(((m_subnet & ~(len - 1)) == first) ? m_size : 0);
+  }
+
+  if(first < m_subnet || (first - m_subnet) >= m_count) {
+    return(0);
+  }
+
+  idx = first - m_subnet;
+
+  if(len >= BLOCK) {
+    for(uint64_t blk = idx / BLOCK; blk < (idx + len) / BLOCK; ++blk) {
+      sum += m_blocks[blk];
+    }
+
+    return(sum);
+  }
+
+  if(len >= PAGE) {
+    for(uint64_t pg = idx / PAGE; pg < (idx + len) / PAGE; ++pg) {
+      sum += m_live[pg];
+    }
+
+    return(sum);
+  }
+
+  if(!(page = m_pages[idx / PAGE])) {
+    return(0);
+  }
+
+  if(len >= WORD_BITS) {
+    for(uint64_t word = (idx % PAGE) / WORD_BITS; word < ((idx % PAGE) + len) / WORD_BITS; ++word) {
+      sum += __builtin_popcountll(page->m_bits[word]);
+    }
+
+    return(sum);
+  }
+
+  /* less than a word, aligned to its own length within it. */
+  return(__builtin_popcountll((page->m_bits[(idx % PAGE) / WORD_BITS] >> (idx % WORD_BITS)) & ((1ULL << len) - 1)));
+}
+
+void mna::ip_index::free_page(uintptr_t page)
+{
+  delete reinterpret_cast<page_t*>(page);
+}
+
+void mna::ip_index::clear()
+{
+  for(page_t* page : m_pages) {
+    delete page;
+  }
+
+  m_pages.clear();
+}
+
+uint64_t mna::ip_index::next_page(uint64_t idx) const
+{
+  uint64_t pg = idx / PAGE;
+  uint64_t bits = 0;
+
+  if(idx >= m_count) {
+    return(m_count);
+  }
+
+  bits = m_used[pg / WORD_BITS] & (~0ULL << (pg % WORD_BITS));
+
+  for(uint64_t word = pg / WORD_BITS; ; ) {
+    if(bits) {
+      pg = (word * WORD_BITS) + __builtin_ctzll(bits);
+      /* within the page of idx the walk goes on from idx. */
+      return((pg == idx / PAGE) ? idx : (pg * PAGE));
+    }
+
+    if(++word >= m_used.size()) {
+      return(m_count);
+    }
+
+    bits = m_used[word];
+  }
+}
+
+#endif /*__IP_INDEX_CC__*/
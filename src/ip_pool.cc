@@ -0,0 +1,235 @@
+#ifndef __IP_POOL_CC__
+#define __IP_POOL_CC__
+
+#include "ip_pool.h"
+
+int32_t mna::ip_pool::setup(uint32_t subnet, uint32_t prefixLen)
+{
+  uint64_t words = 0;
+
+  if(prefixLen < MIN_PREFIX || prefixLen > 32) {
+    return(-1);
+  }
+
+  m_count = 1ULL << (32 - prefixLen);
+  m_subnet = subnet & static_cast<uint32_t>(~(m_count - 1));
+  m_size = 0;
+  m_free = 0;
+  m_reserved.clear();
+  m_levels.clear();
+
+  words = (m_count + WORD_BITS - 1) / WORD_BITS;
+  m_dynamic.assign(words, 0);
+  m_fixed.assign(words, 0);
+
+  /* levels are added until one word covers the whole subnet. */
+  do {
+    m_levels.push_back(std::vector<uint64_t>(words, 0));
+    words = (words + WORD_BITS - 1) / WORD_BITS;
+  } while(m_levels.back().size() > 1);
+
+  return(0);
+}
+
+bool mna::ip_pool::set_free(uint32_t idx)
+{
+  uint64_t bit = 1ULL << (idx % WORD_BITS);
+  uint64_t old = fetch_or(m_levels.front()[idx / WORD_BITS], bit);
+
+  if(old & bit) {
+    return(false);
+  }
+
+  for(uint32_t level = 1; !old && level < m_levels.size(); ++level) {
+    idx /= WORD_BITS;
+    old = fetch_or(m_levels[level][idx / WORD_BITS], 1ULL << (idx % WORD_BITS));
+  }
+
+  return(true);
+}
+
+bool mna::ip_pool::take(uint32_t idx)
+{
+  uint64_t bit = 1ULL << (idx % WORD_BITS);
+  uint64_t old = fetch_and(m_levels.front()[idx / WORD_BITS], ~bit);
+
+  if(!(old & bit)) {
+    return(false);
+  }
+
+  if(!(old & ~bit)) {
+    clear_summary(idx / WORD_BITS);
+  }
+
+  count_free(-1);
+  return(true);
+}
+
+void mna::ip_pool::clear_summary(uint32_t idx)
+{
+  for(uint32_t level = 1; level < m_levels.size(); ++level) {
+    uint64_t bit = 1ULL << (idx % WORD_BITS);
+    uint64_t& word = m_levels[level][idx / WORD_BITS];
+    uint64_t old = fetch_and(word, ~bit);
+
+    /* a release may have filled the word below after it was seen empty, its bit is put back. */
+    if(__atomic_load_n(&m_levels[level - 1][idx], __ATOMIC_SEQ_CST)) {
+      fetch_or(word, bit);
+      break;
+    }
+
+    if(old & ~bit) {
+      break;
+    }
+
+    idx /= WORD_BITS;
+  }
+}
+
+int32_t mna::ip_pool::add_range(uint32_t first, uint32_t last)
+{
+  if(first > last || first < m_subnet || (last - m_subnet) >= m_count) {
+    return(-1);
+  }
+
+  for(uint32_t idx = first - m_subnet; idx <= (last - m_subnet); ++idx) {
+    if(test(m_dynamic, idx) || test(m_fixed, idx)) {
+      continue;
+    }
+
+    m_dynamic[idx / WORD_BITS] |= 1ULL << (idx % WORD_BITS);
+    set_free(idx);
+    ++m_size;
+    ++m_free;
+  }
+
+  return(0);
+}
+
+int32_t mna::ip_pool::exclude(uint32_t first, uint32_t last)
+{
+  if(first > last || first < m_subnet || (last - m_subnet) >= m_count) {
+    return(-1);
+  }
+
+  for(uint32_t idx = first - m_subnet; idx <= (last - m_subnet); ++idx) {
+    if(!test(m_dynamic, idx)) {
+      continue;
+    }
+
+    take(idx);
+
+    m_dynamic[idx / WORD_BITS] &= ~(1ULL << (idx % WORD_BITS));
+    --m_size;
+  }
+
+  return(0);
+}
+
+int32_t mna::ip_pool::reserve(const uint8_t* mac, uint32_t ip)
+{
+  uint32_t idx = ip - m_subnet;
+
+  if(ip < m_subnet || idx >= m_count || test(m_fixed, idx)) {
+    return(-1);
+  }
+
+  if(m_reserved.find(mac_index::key_of(mac)) != mac_index::NIL) {
+    return(-1);
+  }
+
+  if(test(m_dynamic, idx)) {
+    if(!take(idx)) {
+      /* handed out to some client already. */
+      return(-1);
+    }
+
+    m_dynamic[idx / WORD_BITS] &= ~(1ULL << (idx % WORD_BITS));
+    --m_size;
+  }
+
+  if(m_reserved.insert(mac_index::key_of(mac), idx) < 0) {
+    return(-1);
+  }
+
+  m_fixed[idx / WORD_BITS] |= 1ULL << (idx % WORD_BITS);
+  return(0);
+}
+
+uint32_t mna::ip_pool::allocate(const uint8_t* mac)
+{
+  uint32_t idx = 0;
+
+  if(m_reserved.size() && (idx = m_reserved.find(mac_index::key_of(mac))) != mac_index::NIL) {
+    return(m_subnet + idx);
+  }
+
+  /* a word seen through a stale summary bit, or taken by another thread first, starts over. */
+  while(__atomic_load_n(&m_free, __ATOMIC_RELAXED)) {
+    uint64_t word = 0;
+
+    /* one count of trailing zeros per level from the top down. */
+    idx = 0;
+    for(uint32_t level = m_levels.size(); level > 0; --level) {
+      if(!(word = __atomic_load_n(&m_levels[level - 1][idx], __ATOMIC_SEQ_CST))) {
+        break;
+      }
+
+      idx = (idx * WORD_BITS) + __builtin_ctzll(word);
+    }
+
+    if(word && take(idx)) {
+      return(m_subnet + idx);
+    }
+  }
+
+  return(0);
+}
+
+int32_t mna::ip_pool::claim(const uint8_t* mac, uint32_t ip)
+{
+  uint32_t idx = ip - m_subnet;
+
+  if(ip < m_subnet || idx >= m_count) {
+    return(-1);
+  }
+
+  if(test(m_fixed, idx)) {
+    return((m_reserved.find(mac_index::key_of(mac)) == idx) ? 0 : -1);
+  }
+
+  return(take(idx) ? 0 : -1);
+}
+
+int32_t mna::ip_pool::release(uint32_t ip)
+{
+  uint32_t idx = ip - m_subnet;
+
+  if(ip < m_subnet || idx >= m_count || !test(m_dynamic, idx)) {
+    return(-1);
+  }
+
+  /* counted first, an allocator may take the address as soon as its bit is set. */
+  count_free(1);
+
+  if(!set_free(idx)) {
+    /* free already. */
+    count_free(-1);
+    return(-1);
+  }
+
+  return(0);
+}
+
+uint64_t mna::ip_pool::bytes() const
+{
+  uint64_t bytes = (m_dynamic.capacity() + m_fixed.capacity()) * sizeof(uint64_t);
+
+  for(const std::vector<uint64_t>& level : m_levels) {
+    bytes += level.capacity() * sizeof(uint64_t);
+  }
+
+  return(bytes + m_reserved.bytes());
+}
+
+#endif /*__IP_POOL_CC__*/
@@ -0,0 +1,644 @@
+#ifndef __JOURNAL_CC__
+#define __JOURNAL_CC__
+
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#include "ace/Log_Msg.h"
+#include "ace/OS_NS_fcntl.h"
+#include "ace/OS_NS_stdio.h"
+#include "ace/OS_NS_sys_mman.h"
+#include "ace/OS_NS_sys_stat.h"
+#include "ace/OS_NS_sys_time.h"
+#include "ace/OS_NS_unistd.h"
+#include "ace/Time_Value.h"
+
+#include "journal.h"
+
+namespace {
+
+  /**
+   * @brief Header at the start of the journal and of the snapshot.
+   * */
+  struct journal_hdr_t {
+    uint32_t m_magic;
+    uint32_t m_version;
+    uint32_t m_record_len;
+    uint32_t m_rsvd;
+  };
+
+}
+
+uint32_t mna::lease_journal::crc32c(const void* data, size_t len)
+{
+  const uint8_t* in = static_cast<const uint8_t*>(data);
+  uint32_t crc = 0xFFFFFFFFU;
+
+#if defined(__SSE4_2__)
+  uint64_t crc64 = crc;
+
+  while(len >= sizeof(uint64_t)) {
+    uint64_t v = 0;
+    std::memcpy(&v, in, sizeof(v));
+    crc64 = _mm_crc32_u64(crc64, v);
+    in += sizeof(v);
+    len -= sizeof(v);
+  }
+
+  crc = static_cast<uint32_t>(crc64);
+
+  while(len--) {
+    crc = _mm_crc32_u8(crc, *in++);
+  }
+#else
+  /* reflected Castagnoli polynomial, table is built upon first use. */
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> t;
+
+    for(uint32_t idx = 0; idx < 256; ++idx) {
+      uint32_t v = idx;
+
+      for(uint32_t bit = 0; bit < 8; ++bit) {
+        v = (v & 1) ? ((v >> 1) ^ 0x82F63B78U) : (v >> 1);
+      }
+
+      t[idx] = v;
+    }
+
+    return(t);
+  }();
+
+  while(len--) {
+    crc = table[(crc ^ *in++) & 0xFF] ^ (crc >> 8);
+  }
+#endif
+
+  return(crc ^ 0xFFFFFFFFU);
+}
+
+int32_t mna::journal_ring::setup(uint32_t slots)
+{
+  uint64_t count = 1;
+
+  while(count < slots) {
+    count <<= 1;
+  }
+
+  m_slots.reset(new (std::nothrow) lease_record_t[count]);
+
+  if(!m_slots) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l allocation of %Q journal slots failed\n"), count));
+    return(-1);
+  }
+
+  m_mask = count - 1;
+  return(0);
+}
+
+bool mna::journal_ring::push(const lease_record_t& rec)
+{
+  uint64_t head = m_head.load(std::memory_order_relaxed);
+
+  if((head - m_tail_cache) > m_mask) {
+    /* consumer position is read again only when the ring looks full. */
+    m_tail_cache = m_tail.load(std::memory_order_acquire);
+
+    if((head - m_tail_cache) > m_mask) {
+      return(false);
+    }
+  }
+
+  m_slots[head & m_mask] = rec;
+  m_head.store(head + 1, std::memory_order_release);
+  return(true);
+}
+
+uint64_t mna::journal_ring::append(lease_record_t& rec)
+{
+  rec.m_crc = mna::lease_journal::crc32c(&rec.m_type, sizeof(rec) - sizeof(rec.m_crc));
+
+  /* parked records go first, order of changes of one client is kept. */
+  retry();
+
+  if(!m_parked.empty() || !push(rec)) {
+    m_parked.push_back(rec);
+    m_overflows.store(m_overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  return(++m_appended);
+}
+
+void mna::journal_ring::retry()
+{
+  size_t done = 0;
+
+  while(done < m_parked.size() && push(m_parked[done])) {
+    ++done;
+  }
+
+  if(done) {
+    m_parked.erase(m_parked.begin(), m_parked.begin() + done);
+  }
+}
+
+const mna::lease_record_t* mna::journal_ring::front()
+{
+  if(m_tail_local == m_head_cache) {
+    m_head_cache = m_head.load(std::memory_order_acquire);
+
+    if(m_tail_local == m_head_cache) {
+      return(nullptr);
+    }
+  }
+
+  return(&m_slots[m_tail_local & m_mask]);
+}
+
+mna::lease_journal& mna::lease_journal::instance()
+{
+  static mna::lease_journal journal;
+  return(journal);
+}
+
+int64_t mna::lease_journal::replay(const std::string& path, uint32_t magic, record_delegate_t apply, uint64_t& end)
+{
+  ACE_HANDLE handle = ACE_INVALID_HANDLE;
+  struct stat st;
+  void* base = MAP_FAILED;
+  int64_t count = -1;
+  journal_hdr_t hdr;
+
+  end = 0;
+
+  do {
+
+    if((handle = ACE_OS::open(path.c_str(), O_RDONLY)) == ACE_INVALID_HANDLE) {
+      break;
+    }
+
+    if(ACE_OS::fstat(handle, &st) < 0 || st.st_size < HDR_LEN) {
+      break;
+    }
+
+    base = ACE_OS::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, handle, 0);
+
+    if(MAP_FAILED == base) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l mmap of journal %s failed\n"), path.c_str()));
+      break;
+    }
+
+    std::memcpy(&hdr, base, sizeof(hdr));
+
+    if(magic != hdr.m_magic || VERSION != hdr.m_version || sizeof(lease_record_t) != hdr.m_record_len) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l %s is not a lease journal or snapshot\n"), path.c_str()));
+      break;
+    }
+
+    count = 0;
+    end = HDR_LEN;
+
+    /* records past the first torn or corrupt one are never trusted. */
+    while((end + sizeof(lease_record_t)) <= static_cast<uint64_t>(st.st_size)) {
+      lease_record_t rec;
+
+      std::memcpy(&rec, static_cast<const uint8_t*>(base) + end, sizeof(rec));
+
+      if(rec.m_crc != crc32c(&rec.m_type, sizeof(rec) - sizeof(rec.m_crc))) {
+        break;
+      }
+
+      apply(rec);
+      end += sizeof(rec);
+      ++count;
+    }
+
+  } while(0);
+
+  if(MAP_FAILED != base) {
+    ACE_OS::munmap(base, st.st_size);
+  }
+
+  if(ACE_INVALID_HANDLE != handle) {
+    ACE_OS::close(handle);
+  }
+
+  return(count);
+}
+
+void mna::lease_journal::fold(const lease_record_t& rec)
+{
+  uint64_t key = mna::mac_index::key_of(rec.m_chaddr);
+  uint32_t idx = m_folded.find(key);
+
+  if(lease_record_t::BIND == rec.m_type) {
+
+    if(mna::mac_index::NIL == idx) {
+      m_folded.insert(key, static_cast<uint32_t>(m_leases.size()));
+      m_leases.push_back(rec);
+    } else {
+      m_leases[idx] = rec;
+    }
+
+    return;
+  }
+
+  if(mna::mac_index::NIL == idx) {
+    return;
+  }
+
+  /* last binding takes the place of the one gone. */
+  if((idx + 1) != m_leases.size()) {
+    uint64_t lastKey = mna::mac_index::key_of(m_leases.back().m_chaddr);
+
+    m_leases[idx] = m_leases.back();
+    m_folded.erase(lastKey);
+    m_folded.insert(lastKey, idx);
+  }
+
+  m_leases.pop_back();
+  m_folded.erase(key);
+}
+
+int32_t mna::lease_journal::setup(const std::string& path, uint32_t slots, uint32_t syncUs, uint64_t compact)
+{
+  struct stat st;
+  uint64_t end = 0;
+  int64_t count = 0;
+  int64_t snapped = 0;
+  std::string snap(path + ".snap");
+  journal_hdr_t hdr;
+
+  if(path.empty() || !slots || ACE_INVALID_HANDLE != m_handle) {
+    return(-1);
+  }
+
+  m_leases.clear();
+  m_folded.clear();
+
+  /* a snapshot is renamed into place once it is complete, one present is whole. */
+  if(!ACE_OS::stat(snap.c_str(), &st)) {
+
+    if(st.st_size > HDR_LEN) {
+      m_leases.reserve((st.st_size - HDR_LEN) / sizeof(lease_record_t));
+      m_folded.reserve((st.st_size - HDR_LEN) / sizeof(lease_record_t));
+    }
+
+    snapped = replay(snap, SNAP_MAGIC, record_delegate_t::from<mna::lease_journal, &mna::lease_journal::fold>(*this), end);
+
+    if(snapped < 0) {
+      return(-1);
+    }
+  }
+
+  if((m_handle = ACE_OS::open(path.c_str(), O_RDWR | O_CREAT, 0644)) == ACE_INVALID_HANDLE ||
+     ACE_OS::fstat(m_handle, &st) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l open of journal %s failed\n"), path.c_str()));
+    return(-1);
+  }
+
+  if(st.st_size) {
+    count = replay(path, MAGIC, record_delegate_t::from<mna::lease_journal, &mna::lease_journal::fold>(*this), end);
+
+    if(count < 0) {
+      ACE_OS::close(m_handle);
+      m_handle = ACE_INVALID_HANDLE;
+      return(-1);
+    }
+
+    if(end < static_cast<uint64_t>(st.st_size)) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l journal %s is cut to %Q bytes past a torn record\n"),
+                 path.c_str(), end));
+      ACE_OS::ftruncate(m_handle, end);
+    }
+
+  } else {
+    hdr.m_magic = MAGIC;
+    hdr.m_version = VERSION;
+    hdr.m_record_len = sizeof(lease_record_t);
+    hdr.m_rsvd = 0;
+
+    if(ACE_OS::write(m_handle, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+      ACE_OS::close(m_handle);
+      m_handle = ACE_INVALID_HANDLE;
+      return(-1);
+    }
+
+    end = HDR_LEN;
+  }
+
+  ACE_OS::lseek(m_handle, end, SEEK_SET);
+  m_end = end;
+  m_failing = false;
+  ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l journal %s replayed, %q snapshot %q journal records %Q bindings\n"),
+             path.c_str(), snapped, count, m_leases.size()));
+
+  m_path = path;
+  m_slots = slots;
+  m_sync_us = syncUs;
+  m_compact = compact;
+  m_tail.store(count);
+  m_bindings.store(m_leases.size());
+  m_buf.reserve(WRITE_CHUNK * sizeof(lease_record_t));
+  return(0);
+}
+
+mna::journal_ring* mna::lease_journal::attach()
+{
+  uint32_t idx = m_count.load(std::memory_order_relaxed);
+
+  if(ACE_INVALID_HANDLE == m_handle || idx >= MAX_RINGS) {
+    return(nullptr);
+  }
+
+  if(m_rings[idx].setup(m_slots) < 0) {
+    return(nullptr);
+  }
+
+  /* ring is set up before writer thread gets to see it. */
+  m_count.store(idx + 1, std::memory_order_release);
+  return(&m_rings[idx]);
+}
+
+int mna::lease_journal::open(void* args)
+{
+  (void)args;
+
+  if(ACE_INVALID_HANDLE == m_handle || m_running) {
+    return(-1);
+  }
+
+  m_done.store(false);
+
+  if(activate(THR_NEW_LWP | THR_JOINABLE | THR_INHERIT_SCHED) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l writer thread of lease journal is not spawned\n")));
+    return(-1);
+  }
+
+  m_running = true;
+  return(0);
+}
+
+int mna::lease_journal::svc(void)
+{
+  while(!m_done.load(std::memory_order_acquire)) {
+    uint32_t written = drain();
+
+    if(m_compact && m_tail.load(std::memory_order_relaxed) >= m_compact && snapshot() < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l snapshot of journal %s failed, journal is no longer compacted\n"),
+                 m_path.c_str()));
+      m_compact = 0;
+    }
+
+    if(!written) {
+      ACE_OS::sleep(ACE_Time_Value(0, m_sync_us ? m_sync_us : 1));
+    }
+  }
+
+  while(drain()) {
+    ;
+  }
+
+  return(0);
+}
+
+void mna::lease_journal::stop()
+{
+  if(m_running) {
+    m_done.store(true, std::memory_order_release);
+    wait();
+    m_running = false;
+  }
+
+  if(ACE_INVALID_HANDLE != m_handle) {
+    ACE_OS::close(m_handle);
+    m_handle = ACE_INVALID_HANDLE;
+  }
+}
+
+mna::journal_stats_t mna::lease_journal::stats() const
+{
+  journal_stats_t st;
+  uint32_t count = m_count.load(std::memory_order_acquire);
+
+  st.m_records = m_records.load(std::memory_order_relaxed);
+  st.m_syncs = m_syncs.load(std::memory_order_relaxed);
+  st.m_max_batch = m_max_batch.load(std::memory_order_relaxed);
+  st.m_overflows = 0;
+  st.m_snapshots = m_snapshots.load(std::memory_order_relaxed);
+  st.m_tail = m_tail.load(std::memory_order_relaxed);
+  st.m_bindings = m_bindings.load(std::memory_order_relaxed);
+
+  for(uint32_t idx = 0; idx < count; ++idx) {
+    st.m_overflows += m_rings[idx].overflows();
+  }
+
+  return(st);
+}
+
+int32_t mna::lease_journal::write_out(ACE_HANDLE handle)
+{
+  size_t done = 0;
+
+  while(done < m_buf.size()) {
+    ssize_t ret = ACE_OS::write(handle, m_buf.data() + done, m_buf.size() - done);
+
+    if(ret <= 0) {
+      return(-1);
+    }
+
+    done += ret;
+  }
+
+  return(0);
+}
+
+int32_t mna::lease_journal::snapshot()
+{
+  std::string snap(m_path + ".snap");
+  std::string tmp(m_path + ".snap.tmp");
+  std::string::size_type slash = m_path.find_last_of('/');
+  std::string dir((std::string::npos == slash) ? std::string(".") : m_path.substr(0, slash + 1));
+  ACE_Time_Value start = ACE_OS::gettimeofday();
+  uint64_t now = start.sec();
+  ACE_HANDLE handle = ACE_INVALID_HANDLE;
+  ACE_HANDLE dirHandle = ACE_INVALID_HANDLE;
+  int32_t ret = -1;
+  bool written = true;
+  journal_hdr_t hdr;
+
+  /* a lease which ran out with no EXPIRE recorded, across a restart, is not carried over. */
+  for(size_t idx = m_leases.size(); idx > 0; --idx) {
+    if(m_leases[idx - 1].m_expiry <= now) {
+      lease_record_t rec = m_leases[idx - 1];
+      rec.m_type = lease_record_t::EXPIRE;
+      fold(rec);
+    }
+  }
+
+  hdr.m_magic = SNAP_MAGIC;
+  hdr.m_version = VERSION;
+  hdr.m_record_len = sizeof(lease_record_t);
+  hdr.m_rsvd = 0;
+
+  do {
+
+    if((handle = ACE_OS::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) == ACE_INVALID_HANDLE) {
+      break;
+    }
+
+    m_buf.clear();
+    m_buf.insert(m_buf.end(), reinterpret_cast<const uint8_t*>(&hdr), reinterpret_cast<const uint8_t*>(&hdr) + sizeof(hdr));
+
+    for(const lease_record_t& rec : m_leases) {
+      const uint8_t* in = reinterpret_cast<const uint8_t*>(&rec);
+
+      if(m_buf.size() >= (WRITE_CHUNK * sizeof(lease_record_t))) {
+
+        if(write_out(handle) < 0) {
+          written = false;
+          break;
+        }
+
+        m_buf.clear();
+      }
+
+      m_buf.insert(m_buf.end(), in, in + sizeof(rec));
+    }
+
+    if(!written || write_out(handle) < 0 || ::fdatasync(handle) < 0) {
+      break;
+    }
+
+    ACE_OS::close(handle);
+    handle = ACE_INVALID_HANDLE;
+
+    if(ACE_OS::rename(tmp.c_str(), snap.c_str()) < 0) {
+      break;
+    }
+
+    /* rename is durable once the directory is synced. */
+    if((dirHandle = ACE_OS::open(dir.c_str(), O_RDONLY)) != ACE_INVALID_HANDLE) {
+      ACE_OS::fsync(dirHandle);
+      ACE_OS::close(dirHandle);
+    }
+
+    /* a crash before the cut replays the covered records on top of the snapshot, to the same bindings. */
+    if(ACE_OS::ftruncate(m_handle, HDR_LEN) < 0 || ACE_OS::lseek(m_handle, HDR_LEN, SEEK_SET) < 0 ||
+       ::fdatasync(m_handle) < 0) {
+      break;
+    }
+
+    m_end = HDR_LEN;
+    ret = 0;
+  } while(0);
+
+  m_buf.clear();
+
+  if(ACE_INVALID_HANDLE != handle) {
+    ACE_OS::close(handle);
+    ACE_OS::unlink(tmp.c_str());
+  }
+
+  if(ret < 0) {
+    return(ret);
+  }
+
+  m_tail.store(0, std::memory_order_relaxed);
+  m_bindings.store(m_leases.size(), std::memory_order_relaxed);
+  m_snapshots.fetch_add(1, std::memory_order_relaxed);
+  ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l snapshot of %Q bindings written in %Q ms\n"),
+             m_leases.size(), static_cast<uint64_t>((ACE_OS::gettimeofday() - start).msec())));
+  return(0);
+}
+
+uint32_t mna::lease_journal::drain()
+{
+  uint32_t count = m_count.load(std::memory_order_acquire);
+  uint32_t written = 0;
+
+  if(ACE_INVALID_HANDLE == m_handle) {
+    return(0);
+  }
+
+  m_buf.clear();
+
+  for(uint32_t idx = 0; idx < count && written < WRITE_CHUNK; ++idx) {
+    journal_ring& ring = m_rings[idx];
+    const lease_record_t* rec = nullptr;
+
+    while(written < WRITE_CHUNK && (rec = ring.front())) {
+      const uint8_t* in = reinterpret_cast<const uint8_t*>(rec);
+      m_buf.insert(m_buf.end(), in, in + sizeof(*rec));
+      ring.pop();
+      ++written;
+    }
+  }
+
+  if(!written) {
+    return(0);
+  }
+
+  /* whatever piled up while the previous sync was running is committed by this one. */
+  if(write_out(m_handle) < 0 || ::fdatasync(m_handle) < 0) {
+    if(!m_failing) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l commit of %u journal records failed, retried until it succeeds\n"), written));
+      m_failing = true;
+    }
+
+    /* records stay in their rings, which fill up and park what comes next rather than losing it. */
+    for(uint32_t idx = 0; idx < count; ++idx) {
+      m_rings[idx].rewind();
+    }
+
+    /* bytes of a short write are cut off, a record appended behind a torn one is never replayed. */
+    if(ACE_OS::ftruncate(m_handle, m_end) < 0 || ACE_OS::lseek(m_handle, m_end, SEEK_SET) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l journal %s can not be cut back to %Q bytes, lease changes are no longer journaled\n"),
+                 m_path.c_str(), m_end));
+      ACE_OS::close(m_handle);
+      m_handle = ACE_INVALID_HANDLE;
+    }
+
+    return(0);
+  }
+
+  if(m_failing) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l journal %s is committed again\n"), m_path.c_str()));
+    m_failing = false;
+  }
+
+  m_end += m_buf.size();
+
+  /* slots are handed back to producers only once their records are on disk. */
+  for(uint32_t idx = 0; idx < count; ++idx) {
+    m_rings[idx].commit();
+    m_rings[idx].synced(m_rings[idx].consumed());
+  }
+
+  /* table of bindings follows what is on disk, a snapshot never holds an uncommitted record. */
+  for(size_t off = 0; off < m_buf.size(); off += sizeof(lease_record_t)) {
+    lease_record_t rec;
+
+    std::memcpy(&rec, m_buf.data() + off, sizeof(rec));
+    fold(rec);
+  }
+
+  m_tail.fetch_add(written, std::memory_order_relaxed);
+  m_bindings.store(m_leases.size(), std::memory_order_relaxed);
+  m_records.fetch_add(written, std::memory_order_relaxed);
+  m_syncs.fetch_add(1, std::memory_order_relaxed);
+
+  if(written > m_max_batch.load(std::memory_order_relaxed)) {
+    m_max_batch.store(written, std::memory_order_relaxed);
+  }
+
+  return(written);
+}
+
+#endif /*__JOURNAL_CC__*/
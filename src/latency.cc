@@ -0,0 +1,76 @@
+#ifndef __LATENCY_CC__
+#define __LATENCY_CC__
+
+#include "latency.h"
+
+/**
+ * @brief Values below SUB_BUCKETS land in the first linear group as is, every greater value is
+ *        placed by its most significant bit and the SUB_BITS bits following it.
+ * */
+uint32_t mna::latency_histogram::bucket(uint64_t ns)
+{
+  if(ns < SUB_BUCKETS) {
+    return(static_cast<uint32_t>(ns));
+  }
+
+  uint32_t msb = 63 - __builtin_clzll(ns);
+  uint32_t shift = msb - SUB_BITS;
+  uint32_t sub = static_cast<uint32_t>((ns >> shift) & (SUB_BUCKETS - 1));
+
+  return(((shift + 1) * SUB_BUCKETS) + sub);
+}
+
+uint64_t mna::latency_histogram::upper(uint32_t idx)
+{
+  if(idx < SUB_BUCKETS) {
+    return(idx);
+  }
+
+  uint32_t shift = (idx / SUB_BUCKETS) - 1;
+  uint64_t sub = idx % SUB_BUCKETS;
+
+  return((((SUB_BUCKETS + sub + 1) << shift)) - 1);
+}
+
+void mna::latency_histogram::record(uint64_t ns)
+{
+  ++m_buckets[bucket(ns)];
+  ++m_count;
+
+  if(ns > m_max) {
+    m_max = ns;
+  }
+}
+
+uint64_t mna::latency_histogram::percentile(double p) const
+{
+  uint64_t rank = 0;
+  uint64_t seen = 0;
+
+  if(!m_count) {
+    return(0);
+  }
+
+  rank = static_cast<uint64_t>((p / 100.0) * m_count);
+  rank = (rank < 1) ? 1 : ((rank > m_count) ? m_count : rank);
+
+  for(uint32_t idx = 0; idx < BUCKETS; ++idx) {
+    seen += m_buckets[idx];
+
+    if(seen >= rank) {
+      uint64_t value = upper(idx);
+      return((value < m_max) ? value : m_max);
+    }
+  }
+
+  return(m_max);
+}
+
+void mna::latency_histogram::reset()
+{
+  m_buckets.fill(0);
+  m_count = 0;
+  m_max = 0;
+}
+
+#endif /*__LATENCY_CC__*/
@@ -0,0 +1,77 @@
+#ifndef __LEASE_STORE_CC__
+#define __LEASE_STORE_CC__
+
+#include "lease_store.h"
+#include "protocol.h"
+
+mna::lease_store& mna::lease_store::instance()
+{
+  static mna::lease_store store;
+  return(store);
+}
+
+int32_t mna::lease_store::setup(uint32_t shards)
+{
+  if(!shards || shards > MAX_SHARDS || (shards & (shards - 1))) {
+    return(-1);
+  }
+
+  m_shards = shards;
+  m_pool.share(shards > 1);
+  return(0);
+}
+
+uint32_t mna::lease_store::shard_of(const uint8_t* chaddr) const
+{
+  return(mna::dhcp::chaddr_hash(chaddr) & (m_shards - 1));
+}
+
+bool mna::lease_store::read_by_mac(const uint8_t* chaddr, mna::dhcp::lease_view_t& view) const
+{
+  /* the server is not destroyed while a reader holds it, see dhcp::server::~server. */
+  mna::epoch::guard guard;
+  const mna::dhcp::server* srv = server(shard_of(chaddr));
+
+  return(guard && srv && srv->read_by_mac(chaddr, view));
+}
+
+bool mna::lease_store::read_by_ip(uint32_t ip, mna::dhcp::lease_view_t& view) const
+{
+  mna::epoch::guard guard;
+
+  if(!guard) {
+    return(false);
+  }
+
+  for(uint32_t idx = 0; idx < m_shards; ++idx) {
+    const mna::dhcp::server* srv = server(idx);
+
+    if(srv && srv->read_by_ip(ip, view)) {
+      return(true);
+    }
+  }
+
+  return(false);
+}
+
+mna::lease_store_stats_t mna::lease_store::stats() const
+{
+  lease_store_stats_t st;
+
+  st.m_shards = m_shards;
+  st.m_leases = 0;
+  st.m_bound = 0;
+  st.m_cold = 0;
+
+  for(uint32_t idx = 0; idx < m_shards; ++idx) {
+    st.m_leases += m_shard[idx].m_leases.load(std::memory_order_relaxed);
+    st.m_bound += m_shard[idx].m_bound.load(std::memory_order_relaxed);
+    st.m_cold += m_shard[idx].m_cold.load(std::memory_order_relaxed);
+  }
+
+  st.m_pool_free = m_pool.free_count();
+  st.m_pool_size = m_pool.size();
+  return(st);
+}
+
+#endif /*__LEASE_STORE_CC__*/
@@ -0,0 +1,449 @@
+#ifndef __LEASEQUERY_CC__
+#define __LEASEQUERY_CC__
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "ace/Log_Msg.h"
+#include "ace/OS_NS_sys_socket.h"
+#include "ace/OS_NS_unistd.h"
+
+#include "latency.h"
+#include "leasequery.h"
+
+mna::leasequery_session::leasequery_session(leasequery& parent, ACE_HANDLE handle) : m_parent(parent)
+{
+  m_handle = handle;
+  m_sent = 0;
+  m_active = false;
+  m_eof = false;
+  m_query = QUERY_NONE;
+  m_xid = 0;
+  std::memset(m_chaddr, 0, sizeof(m_chaddr));
+  m_shard = 0;
+  m_cursor = 0;
+  m_now = 0;
+}
+
+mna::leasequery_session::~leasequery_session()
+{
+  if(ACE_INVALID_HANDLE != m_handle) {
+    ACE_OS::close(m_handle);
+  }
+}
+
+ACE_INT32 mna::leasequery_session::handle_input(ACE_HANDLE handle)
+{
+  uint8_t buf[2048];
+  ssize_t received = ACE_OS::recv(handle, (char *)buf, sizeof(buf), MSG_DONTWAIT);
+
+  if(received < 0) {
+    return((EAGAIN == errno || EWOULDBLOCK == errno) ? 0 : -1);
+  }
+
+  if(!received) {
+    /* requestor has sent its last query, what is left to stream is still written out. */
+    m_eof = true;
+    reactor()->cancel_wakeup(this, ACE_Event_Handler::READ_MASK);
+    return(busy() ? 0 : -1);
+  }
+
+  if((m_in.size() + received) > MAX_PENDING) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l leasequery requestor on handle %d queued too many queries\n"), handle));
+    return(-1);
+  }
+
+  m_in.insert(m_in.end(), buf, buf + received);
+  return(next_query());
+}
+
+ACE_INT32 mna::leasequery_session::handle_output(ACE_HANDLE handle)
+{
+  ssize_t sent = 0;
+  uint32_t chunks = 0;
+
+  for(;;) {
+    while(m_sent < m_out.size()) {
+      sent = ACE_OS::send(handle, (const char *)&m_out[m_sent], m_out.size() - m_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+      if(sent < 0) {
+        if(EAGAIN == errno || EWOULDBLOCK == errno) {
+          /* reactor comes back once the requestor has read some. */
+          ++m_parent.stats().m_blocked;
+          return(0);
+        }
+
+        return(-1);
+      }
+
+      m_sent += sent;
+      m_parent.stats().m_bytes += sent;
+    }
+
+    if(!m_active) {
+      break;
+    }
+
+    if(++chunks > BURST) {
+      /* socket is still writable, packets are served before the reactor comes back. */
+      return(0);
+    }
+
+    refill();
+  }
+
+  m_out.clear();
+  m_sent = 0;
+
+  if(next_query() < 0) {
+    return(-1);
+  }
+
+  if(!busy()) {
+    if(m_eof) {
+      return(-1);
+    }
+
+    reactor()->cancel_wakeup(this, ACE_Event_Handler::WRITE_MASK);
+  }
+
+  return(0);
+}
+
+ACE_INT32 mna::leasequery_session::handle_close(ACE_HANDLE handle, ACE_Reactor_Mask mask)
+{
+  (void)handle;
+  (void)mask;
+  /* the reactor unbinds only the mask whose upcall failed, the other one may still be
+     registered and must not outlive the session. */
+  reactor()->remove_handler(this, ACE_Event_Handler::ALL_EVENTS_MASK | ACE_Event_Handler::DONT_CALL);
+  m_parent.closed(this);
+  return(0);
+}
+
+int32_t mna::leasequery_session::next_query()
+{
+  size_t offset = 0;
+  uint32_t len = 0;
+
+  while(!busy() && (m_in.size() - offset) >= 2) {
+    len = (static_cast<uint32_t>(m_in[offset]) << 8) | m_in[offset + 1];
+
+    if((m_in.size() - offset - 2) < len) {
+      break;
+    }
+
+    start(&m_in[offset + 2], len);
+    offset += 2 + len;
+  }
+
+  m_in.erase(m_in.begin(), m_in.begin() + offset);
+
+  if(busy() && reactor()->schedule_wakeup(this, ACE_Event_Handler::WRITE_MASK) < 0) {
+    return(-1);
+  }
+
+  return(0);
+}
+
+void mna::leasequery_session::start(const uint8_t* in, uint32_t inLen)
+{
+  const uint8_t cookie[] = {0x63, 0x82, 0x53, 0x63};
+  const mna::dhcp::dhcp_t* req = reinterpret_cast<const mna::dhcp::dhcp_t*>(in);
+  const uint8_t zero[6] = {0, 0, 0, 0, 0, 0};
+  mna::dhcp::options_t opts;
+  const uint8_t* id = nullptr;
+  uint8_t idLen = 0;
+  uint8_t relayLen = 0;
+  bool byMAC = false;
+
+  ++m_parent.stats().m_queries;
+  m_out.clear();
+  m_sent = 0;
+  m_xid = 0;
+  m_now = static_cast<uint32_t>(mna::clock_ns() / 1000000000ULL);
+
+  if(inLen < (sizeof(mna::dhcp::dhcp_t) + sizeof(cookie)) ||
+     std::memcmp(&in[sizeof(mna::dhcp::dhcp_t)], cookie, sizeof(cookie))) {
+    done(MALFORMED_QUERY, "message is not a DHCP message");
+    return;
+  }
+
+  m_xid = req->xid;
+  opts.parse(&in[sizeof(mna::dhcp::dhcp_t) + sizeof(cookie)], inLen - (sizeof(mna::dhcp::dhcp_t) + sizeof(cookie)));
+
+  if(!opts.has(mna::dhcp::MESSAGE_TYPE) || opts.message_type() != mna::dhcp::BULKLEASEQUERY) {
+    done(MALFORMED_QUERY, "message is not a DHCPBULKLEASEQUERY");
+    return;
+  }
+
+  byMAC = (6 == req->hlen) && std::memcmp(req->chaddr, zero, sizeof(zero));
+  id = opts.get(mna::dhcp::CLIENT_IDENTIFIER, idLen);
+
+  if(byMAC && id) {
+    done(MALFORMED_QUERY, "more than one query type");
+    return;
+  }
+
+  if(opts.get(mna::dhcp::RELAY_AGENT_INFO, relayLen)) {
+    /* relay-id and remote-id of relays are not kept with the lease. */
+    done(NOT_ALLOWED, "query by relay-id or remote-id is not supported");
+    return;
+  }
+
+  if(byMAC) {
+    m_query = QUERY_BY_MAC;
+    std::memcpy(m_chaddr, req->chaddr, sizeof(m_chaddr));
+  } else if(id) {
+    m_query = QUERY_BY_CLIENT_ID;
+    m_clientId.assign(reinterpret_cast<const char*>(id), idLen);
+  } else {
+    m_query = QUERY_ALL;
+  }
+
+  m_shard = 0;
+  m_cursor = 0;
+  m_active = true;
+}
+
+void mna::leasequery_session::refill()
+{
+  mna::lease_store& store = mna::lease_store::instance();
+  mna::dhcp::lease_view_t view;
+
+  m_out.clear();
+  m_sent = 0;
+
+  if(QUERY_BY_MAC == m_query) {
+    if(store.read_by_mac(m_chaddr, view)) {
+      encode(view);
+    }
+
+    m_shard = store.shards();
+  } else {
+    /* the server of the shard is held for as long as the guard is. */
+    mna::epoch::guard guard;
+    const mna::dhcp::server* srv = store.server(m_shard);
+
+    if(!guard) {
+      done(UNSPEC_FAIL, "no reader slot is left");
+      return;
+    }
+
+    m_cursor = !srv ? 0x100000000ULL : srv->read_leases(m_cursor, 0xFFFFFFFFU, CHUNK, [this](const mna::dhcp::lease_view_t& lease) {
+      encode(lease);
+    });
+
+    if(m_cursor > 0xFFFFFFFFULL) {
+      ++m_shard;
+      m_cursor = 0;
+    }
+  }
+
+  if(m_shard >= store.shards()) {
+    done(SUCCESS, nullptr);
+  }
+}
+
+void mna::leasequery_session::encode(const mna::dhcp::lease_view_t& lease)
+{
+  size_t at = 0;
+  uint32_t value = 0;
+  uint8_t state = STATE_ACTIVE;
+  mna::dhcp::dhcp_t* out = nullptr;
+
+  if(!lease.m_bound) {
+    /* an offer is not a lease yet. */
+    return;
+  }
+
+  if(QUERY_BY_CLIENT_ID == m_query && lease.m_clientId != m_clientId) {
+    return;
+  }
+
+  at = begin(mna::dhcp::LEASEACTIVE);
+  out = reinterpret_cast<mna::dhcp::dhcp_t*>(&m_out[at + 2]);
+  out->ciaddr = htonl(lease.m_ip);
+  std::memcpy(out->chaddr, lease.m_chaddr.data(), lease.m_chaddr.size());
+
+  value = htonl((lease.m_expiry > m_now) ? (lease.m_expiry - m_now) : 0);
+  put(mna::dhcp::IP_LEASE_TIME, &value, sizeof(value));
+
+  if(m_parent.server().get_server_id()) {
+    value = htonl(m_parent.server().get_server_id());
+    put(mna::dhcp::SERVER_IDENTIFIER, &value, sizeof(value));
+  }
+
+  if(!lease.m_clientId.empty()) {
+    put(mna::dhcp::CLIENT_IDENTIFIER, lease.m_clientId.data(), lease.m_clientId.length());
+  }
+
+  value = htonl(m_now);
+  put(mna::dhcp::BASE_TIME, &value, sizeof(value));
+  put(mna::dhcp::DHCP_STATE, &state, sizeof(state));
+  end(at);
+
+  ++m_parent.stats().m_records;
+}
+
+void mna::leasequery_session::done(uint8_t status, const char* text)
+{
+  size_t at = begin(mna::dhcp::LEASEQUERYDONE);
+  size_t len = text ? std::strlen(text) : 0;
+
+  if(SUCCESS != status) {
+    std::vector<uint8_t> code(1 + len);
+
+    code[0] = status;
+    std::memcpy(&code[1], text, len);
+    put(mna::dhcp::STATUS_CODE, code.data(), code.size());
+  }
+
+  end(at);
+  m_active = false;
+}
+
+size_t mna::leasequery_session::begin(uint8_t type)
+{
+  const uint8_t cookie[] = {0x63, 0x82, 0x53, 0x63};
+  size_t at = m_out.size();
+  mna::dhcp::dhcp_t* out = nullptr;
+
+  /* length, header and magic cookie, zeroed. */
+  m_out.resize(at + 2 + sizeof(mna::dhcp::dhcp_t) + sizeof(cookie), 0);
+  out = reinterpret_cast<mna::dhcp::dhcp_t*>(&m_out[at + 2]);
+  out->op = 2; /** Boot Reply. */
+  out->htype = 1;
+  out->hlen = 6;
+  out->xid = m_xid;
+  std::memcpy(&m_out[at + 2 + sizeof(mna::dhcp::dhcp_t)], cookie, sizeof(cookie));
+
+  put(mna::dhcp::MESSAGE_TYPE, &type, sizeof(type));
+  return(at);
+}
+
+void mna::leasequery_session::put(uint8_t tag, const void* value, uint8_t len)
+{
+  const uint8_t* bytes = static_cast<const uint8_t*>(value);
+
+  m_out.push_back(tag);
+  m_out.push_back(len);
+  m_out.insert(m_out.end(), bytes, bytes + len);
+}
+
+void mna::leasequery_session::end(size_t at)
+{
+  size_t len = 0;
+
+  m_out.push_back(mna::dhcp::END);
+  len = m_out.size() - at - 2;
+  m_out[at] = static_cast<uint8_t>(len >> 8);
+  m_out[at + 1] = static_cast<uint8_t>(len);
+}
+
+int32_t mna::leasequery::open(ACE_Reactor& rctr, uint16_t port)
+{
+  struct sockaddr_in addr;
+  int option = 1;
+
+  if((m_handle = ACE_OS::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Creation of handle for leasequery failed\n")));
+    return(-1);
+  }
+
+  ACE_OS::setsockopt(m_handle, SOL_SOCKET, SO_REUSEADDR, (const char *)&option, sizeof(option));
+  ACE_OS::memset((void *)&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  /* billing and captive portal run on the same host, nothing else may query. */
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if(ACE_OS::bind(m_handle, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+     ACE_OS::listen(m_handle, BACKLOG) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l leasequery can not listen on port %u\n"), port));
+    ACE_OS::close(m_handle);
+    m_handle = ACE_INVALID_HANDLE;
+    return(-1);
+  }
+
+  reactor(&rctr);
+
+  if(rctr.register_handler(this, ACE_Event_Handler::ACCEPT_MASK) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l registration of leasequery handle %d with reactor failed\n"), m_handle));
+    ACE_OS::close(m_handle);
+    m_handle = ACE_INVALID_HANDLE;
+    return(-1);
+  }
+
+  ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l leasequery listens on 127.0.0.1:%u\n"), port));
+  return(0);
+}
+
+void mna::leasequery::close()
+{
+  if(ACE_INVALID_HANDLE == m_handle) {
+    return;
+  }
+
+  for(std::unique_ptr<leasequery_session>& session : m_sessions) {
+    reactor()->remove_handler(session.get(), ACE_Event_Handler::ALL_EVENTS_MASK | ACE_Event_Handler::DONT_CALL);
+  }
+
+  m_sessions.clear();
+  reactor()->remove_handler(this, ACE_Event_Handler::ACCEPT_MASK | ACE_Event_Handler::DONT_CALL);
+  ACE_OS::close(m_handle);
+  m_handle = ACE_INVALID_HANDLE;
+}
+
+ACE_INT32 mna::leasequery::handle_input(ACE_HANDLE handle)
+{
+  ACE_HANDLE conn = ACE_INVALID_HANDLE;
+  leasequery_session* session = nullptr;
+
+  while((conn = ACE_OS::accept(handle, nullptr, nullptr)) >= 0) {
+    if(m_sessions.size() >= MAX_SESSIONS) {
+      ++m_stats.m_refused;
+      ACE_OS::close(conn);
+      continue;
+    }
+
+    ACE_NEW_RETURN(session, leasequery_session(*this, conn), 0);
+    session->reactor(reactor());
+
+    if(reactor()->register_handler(session, ACE_Event_Handler::READ_MASK) < 0) {
+      delete session;
+      continue;
+    }
+
+    m_sessions.emplace_back(session);
+    ++m_stats.m_connections;
+  }
+
+  return(0);
+}
+
+bool mna::leasequery::busy() const
+{
+  for(const std::unique_ptr<leasequery_session>& session : m_sessions) {
+    if(session->busy()) {
+      return(true);
+    }
+  }
+
+  return(false);
+}
+
+void mna::leasequery::closed(leasequery_session* session)
+{
+  std::vector<std::unique_ptr<leasequery_session> >::iterator it;
+
+  for(it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+    if(it->get() == session) {
+      m_sessions.erase(it);
+      break;
+    }
+  }
+}
+
+#endif /*__LEASEQUERY_CC__*/
@@ -0,0 +1,313 @@
+#ifndef __LOOP_CC__
+#define __LOOP_CC__
+
+#include <sys/socket.h>
+
+#include "ace/Log_Msg.h"
+#include "ace/OS_NS_Thread.h"
+#include "ace/OS_NS_sys_socket.h"
+#include "ace/OS_NS_sys_time.h"
+#include "ace/OS_NS_unistd.h"
+#include "ace/Select_Reactor.h"
+#include "ace/Dev_Poll_Reactor.h"
+#include "ace/Timer_Queue.h"
+
+#include "loop.h"
+
+ACE_Reactor* mna::event_loop::make_reactor(loop_t loop)
+{
+  ACE_Reactor* reactor = nullptr;
+  ACE_Reactor_Impl* impl = nullptr;
+
+  if(mna::LOOP_EPOLL == loop) {
+    ACE_NEW_NORETURN(impl, ACE_Dev_Poll_Reactor());
+  } else {
+    ACE_NEW_NORETURN(impl, ACE_Select_Reactor());
+  }
+
+  if(!impl) {
+    return(nullptr);
+  }
+
+  /* reactor deletes its implementation. */
+  ACE_NEW_NORETURN(reactor, ACE_Reactor(impl, true));
+  return(reactor);
+}
+
+int32_t mna::event_loop::run()
+{
+  m_reactor.owner(ACE_OS::thr_self());
+  m_report = ACE_OS::gettimeofday();
+
+  if(m_mw.config().m_leasequery_port && m_leasequery.open(m_reactor, m_mw.config().m_leasequery_port) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l leases are not served to leasequery\n")));
+  }
+
+  if(mna::LOOP_BUSY_POLL == m_mw.config().m_loop) {
+    return(run_busy_poll());
+  }
+
+  return(run_reactor());
+}
+
+void mna::event_loop::stop()
+{
+  m_reactor.end_reactor_event_loop();
+}
+
+int32_t mna::event_loop::run_reactor()
+{
+  if(m_reactor.register_handler(&m_mw, ACE_Event_Handler::READ_MASK) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l registration of handle %d with reactor failed\n"), m_mw.get_handle()));
+    return(-1);
+  }
+
+  m_mw.start_tick();
+
+  while(!m_reactor.reactor_event_loop_done()) {
+    /* wakes up at least once a second for the latency report, does not block while
+       expiries are left over so that sweeps and packets take turns. */
+    ACE_Time_Value to(m_mw.sweep_pending() ? 0 : 1);
+    m_reactor.handle_events(to);
+
+    if(m_mw.sweep_pending()) {
+      m_mw.sweep();
+    }
+
+    report();
+  }
+
+  m_mw.stop_tick();
+  m_leasequery.close();
+  m_reactor.remove_handler(&m_mw, ACE_Event_Handler::READ_MASK | ACE_Event_Handler::DONT_CALL);
+  return(0);
+}
+
+/**
+ * @brief Every iteration drains the socket and expires due timers. After m_busy_spin empty
+ *        iterations the loop yields, then sleeps for twice as long after every further empty
+ *        iteration up to m_busy_max_sleep_us. The first frame brings it back to spinning.
+ * */
+int32_t mna::event_loop::run_busy_poll()
+{
+  const mna::config_t& cfg = m_mw.config();
+  ACE_HANDLE handle = m_mw.get_handle();
+  int32_t busyPoll = cfg.m_busy_poll_us;
+  uint32_t idle = 0;
+  uint32_t sleepUs = 0;
+
+  /* timers of middleware are scheduled on this reactor although handle is not registered. */
+  m_mw.reactor(&m_reactor);
+  m_mw.start_tick();
+
+  if(busyPoll && ACE_OS::setsockopt(handle, SOL_SOCKET, SO_BUSY_POLL, (const char *)&busyPoll, sizeof(busyPoll)) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l SO_BUSY_POLL of %d us failed for handle %d\n"), busyPoll, handle));
+  }
+
+  while(!m_reactor.reactor_event_loop_done()) {
+    ++m_stats.m_polls;
+
+    if(m_mw.receive(handle) > 0) {
+      ++m_stats.m_busy;
+      idle = 0;
+      sleepUs = 0;
+
+    } else if(++idle > cfg.m_busy_spin) {
+      if(!sleepUs) {
+        ACE_OS::thr_yield();
+        sleepUs = 1;
+
+      } else {
+        ACE_OS::sleep(ACE_Time_Value(0, sleepUs));
+        ++m_stats.m_sleeps;
+        sleepUs = ((2 * sleepUs) < cfg.m_busy_max_sleep_us) ? (2 * sleepUs) : cfg.m_busy_max_sleep_us;
+      }
+    }
+
+    /* dispatches due timers, the tick of timing wheel among them, to middleware::handle_timeout. */
+    m_reactor.timer_queue()->expire();
+
+    if(m_mw.sweep_pending()) {
+      m_mw.sweep();
+    }
+
+    if(!(m_stats.m_polls & 0x3FF) || sleepUs) {
+      report();
+    }
+
+    /* leasequery connections are polled without blocking, every iteration while a stream is
+       going on else along with the report. */
+    if(m_leasequery.get_handle() != ACE_INVALID_HANDLE &&
+       (m_leasequery.busy() || !(m_stats.m_polls & 0x3FF) || sleepUs)) {
+      ACE_Time_Value to(ACE_Time_Value::zero);
+      m_reactor.handle_events(to);
+    }
+  }
+
+  m_mw.stop_tick();
+  m_leasequery.close();
+  m_mw.reactor(nullptr);
+  return(0);
+}
+
+void mna::event_loop::report()
+{
+  uint32_t interval = m_mw.config().m_latency_report;
+  ACE_Time_Value now;
+
+  if(!interval) {
+    return;
+  }
+
+  now = ACE_OS::gettimeofday();
+
+  if((now - m_report) < ACE_Time_Value(interval)) {
+    return;
+  }
+
+  /* named as given to -l, so that the runs of every loop are told apart in the log. */
+  static const char* const loops[] = {"select", "epoll", "busy"};
+  mna::latency_histogram& lat = m_mw.latency();
+  const mna::wheel_stats_t& tmr = m_mw.wheel_stats();
+  mna::loop_t loop = m_mw.config().m_loop;
+
+  ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M loop %s replies %Q p50 %Q ns p99 %Q ns p99.9 %Q ns max %Q ns\n"),
+             (loop <= mna::LOOP_BUSY_POLL) ? loops[loop] : "unknown", lat.count(), lat.percentile(50.0), lat.percentile(99.0),
+             lat.percentile(99.9), lat.max()));
+
+  if(m_mw.packet_socket()) {
+    const mna::filter_stats_t& flt = m_mw.filter_stats();
+
+    ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M socket delivered %Q dropped by kernel %Q freezes %Q filter attached %u times\n"),
+               flt.m_delivered, flt.m_dropped, flt.m_freeze, flt.m_attached));
+  }
+
+  if(m_mw.xdp_open()) {
+    const mna::xdp_stats_t& xdp = m_mw.xdp_stats();
+
+    ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M xdp rx %Q dropped by kernel %Q fill ring empty %Q tx %Q drops %Q kicks %Q\n"),
+               xdp.m_rx_frames, xdp.m_rx_dropped, xdp.m_fill_empty, xdp.m_tx_frames, xdp.m_tx_drops, xdp.m_kicks));
+  }
+
+  if(m_mw.rx_ring_attached()) {
+    const mna::rx_ring_stats_t& rx = m_mw.rx_ring_stats();
+
+    ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M rx ring wakeups %Q frames %Q per wakeup %Q max %u blocks %Q\n"),
+               rx.m_wakeups, rx.m_frames, rx.m_wakeups ? (rx.m_frames / rx.m_wakeups) : 0, rx.m_max_frames, rx.m_blocks));
+  }
+
+  if(m_mw.batch_enabled()) {
+    const mna::mmsg_stats_t& mm = m_mw.batch_stats();
+
+    ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M recvmmsg calls %Q frames %Q per call %Q max %u sendmmsg calls %Q frames %Q drops %Q\n"),
+               mm.m_rx_calls, mm.m_rx_frames, mm.m_rx_calls ? (mm.m_rx_frames / mm.m_rx_calls) : 0, mm.m_max_rx_batch,
+               mm.m_tx_calls, mm.m_tx_frames, mm.m_tx_drops));
+  }
+
+  if(m_mw.tx_ring_attached()) {
+    const mna::tx_ring_stats_t& tx = m_mw.tx_ring_stats();
+
+    ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M tx ring frames %Q drops %Q in flight %u kicks %Q per second %Q\n"),
+               tx.m_frames, tx.m_drops, tx.m_in_flight, tx.m_kicks, tx.m_kicks_per_sec));
+  }
+
+  /* the pool is shared by every worker, whichever reports sees the same counters. */
+  mna::pool_stats_t pl = m_mw.pool_stats();
+
+  ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M packet buffers %u in use %u high water %u exhausted %Q hugepage %u\n"),
+             pl.m_buffers, pl.m_in_use, pl.m_high_water, pl.m_exhausted, pl.m_hugepage ? 1U : 0U));
+
+  ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M timers %Q expired %Q backlog %Q sweep lag %Q ms max %Q ms throttled %Q\n"),
+             tmr.m_pending, tmr.m_expired, tmr.m_backlog, tmr.m_lag_ms, tmr.m_max_lag_ms, tmr.m_throttled));
+
+  mna::dhcp::lease_stats_t ls = m_mw.lease_stats();
+
+  ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M leases %Q bound %Q cold %Q bytes %Q per lease %Q\n"),
+             ls.m_leases, ls.m_bound, ls.m_cold, ls.m_bytes, ls.m_leases ? (ls.m_bytes / ls.m_leases) : 0));
+
+  report_utilization();
+
+  if(mna::lease_store::instance().shards() > 1) {
+    mna::lease_store_stats_t st = mna::lease_store::instance().stats();
+
+    ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M shards %u leases %Q bound %Q cold %Q pool free %Q of %Q\n"),
+               st.m_shards, st.m_leases, st.m_bound, st.m_cold, st.m_pool_free, st.m_pool_size));
+  }
+
+  mna::slab_stats_t sl = m_mw.entry_stats();
+
+  ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M slabs %u hugepage %u empty %u used %Q peak %Q capacity %Q fragmentation %u/1000\n"),
+             sl.m_slabs, sl.m_hugepage_slabs, sl.m_empty_slabs, sl.m_used, sl.m_peak, sl.m_capacity, sl.m_fragmentation));
+
+  if(!m_mw.config().m_journal.empty()) {
+    mna::journal_stats_t jr = mna::lease_journal::instance().stats();
+
+    ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M journal records %Q syncs %Q max batch %Q overflows %Q snapshots %Q tail %Q bindings %Q\n"),
+               jr.m_records, jr.m_syncs, jr.m_max_batch, jr.m_overflows, jr.m_snapshots, jr.m_tail, jr.m_bindings));
+  }
+
+  if(m_leasequery.get_handle() != ACE_INVALID_HANDLE) {
+    mna::leasequery_stats_t& lq = m_leasequery.stats();
+
+    ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M leasequery connections %Q refused %Q queries %Q records %Q bytes %Q blocked %Q\n"),
+               lq.m_connections, lq.m_refused, lq.m_queries, lq.m_records, lq.m_bytes, lq.m_blocked));
+  }
+
+  lat.reset();
+  m_report = now;
+}
+
+/**
+ * @brief The next leased address is looked up from the end of every prefix logged, so that
+ *        prefixes without leases cost nothing however finely the pool is broken down.
+ * */
+void mna::event_loop::report_utilization()
+{
+  const mna::config_t& cfg = m_mw.config();
+  const mna::dhcp::server& srv = m_mw.dhcp();
+  uint32_t len = cfg.m_pool_prefix;
+  uint32_t subnet = 0;
+  uint32_t prefix = 0;
+  uint32_t ip = 0;
+  uint32_t lines = 0;
+  uint64_t from = 0;
+  uint64_t last = 0;
+  bool found = false;
+
+  if(len > 32) {
+    return;
+  }
+
+  subnet = len ? (cfg.m_pool_subnet & (0xFFFFFFFFU << (32 - len))) : 0;
+  last = subnet + (1ULL << (32 - len)) - 1;
+
+  ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M subnet %x/%u leases %Q of %Q addresses\n"),
+             subnet, len, srv.count_leases(subnet, len), (1ULL << (32 - len))));
+
+  len = cfg.m_utilization_prefix;
+
+  if(len <= cfg.m_pool_prefix || len > 32) {
+    return;
+  }
+
+  for(from = subnet; from <= last && lines < MAX_PREFIXES; ++lines) {
+    found = false;
+    srv.scan_leases(from, static_cast<uint32_t>(last), 1, [&](const mna::dhcp::dhcpEntry& ent) {
+      ip = ent.get_client_ip();
+      found = true;
+    });
+
+    if(!found) {
+      break;
+    }
+
+    prefix = ip & (0xFFFFFFFFU << (32 - len));
+
+    ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M prefix %x/%u leases %Q of %Q addresses\n"),
+               prefix, len, srv.count_leases(prefix, len), (1ULL << (32 - len))));
+
+    from = static_cast<uint64_t>(prefix) + (1ULL << (32 - len));
+  }
+}
+
+#endif /*__LOOP_CC__*/
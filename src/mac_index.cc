@@ -0,0 +1,224 @@
+#ifndef __MAC_INDEX_CC__
+#define __MAC_INDEX_CC__
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "mac_index.h"
+
+uint32_t mna::mac_index::match(const table_t& tbl, uint64_t group, int8_t h2)
+{
+  const int8_t* ctrl = &tbl.m_ctrl[group * GROUP];
+
+#if defined(__SSE2__)
+  __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+  return(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(h2)))));
+#else
+  uint32_t bits = 0;
+
+  for(uint32_t idx = 0; idx < GROUP; ++idx) {
+    bits |= static_cast<uint32_t>(ctrl[idx] == h2) << idx;
+  }
+
+  return(bits);
+#endif
+}
+
+uint32_t mna::mac_index::match_empty(const table_t& tbl, uint64_t group)
+{
+  return(match(tbl, group, EMPTY));
+}
+
+uint32_t mna::mac_index::match_free(const table_t& tbl, uint64_t group)
+{
+  const int8_t* ctrl = &tbl.m_ctrl[group * GROUP];
+
+#if defined(__SSE2__)
+  /* EMPTY and DELETED are the only control bytes with the sign bit set. */
+  __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+  return(static_cast<uint32_t>(_mm_movemask_epi8(bytes)));
+#else
+  uint32_t bits = 0;
+
+  for(uint32_t idx = 0; idx < GROUP; ++idx) {
+    bits |= static_cast<uint32_t>(ctrl[idx] < 0) << idx;
+  }
+
+  return(bits);
+#endif
+}
+
+uint64_t mna::mac_index::locate(const table_t& tbl, uint64_t key)
+{
+  uint64_t h = hash(key);
+  int8_t h2 = static_cast<int8_t>(h & 0x7F);
+  uint64_t group = (h >> 7) & tbl.m_mask;
+
+  /* triangular probing over groups visits every group once. */
+  for(uint64_t probe = 0; probe <= tbl.m_mask; ++probe) {
+    uint32_t bits = match(tbl, group, h2);
+
+    while(bits) {
+      uint64_t idx = (group * GROUP) + __builtin_ctz(bits);
+
+      if(tbl.m_slots[idx].key() == key) {
+        return(idx);
+      }
+
+      bits &= bits - 1;
+    }
+
+    /* a group with an EMPTY slot never spilled a key into the next group. */
+    if(match_empty(tbl, group)) {
+      break;
+    }
+
+    group = (group + probe + 1) & tbl.m_mask;
+  }
+
+  return(NIL);
+}
+
+uint64_t mna::mac_index::free_slot(const table_t& tbl, uint64_t h)
+{
+  uint64_t group = (h >> 7) & tbl.m_mask;
+
+  for(uint64_t probe = 0; probe <= tbl.m_mask; ++probe) {
+    uint32_t bits = match_free(tbl, group);
+
+    if(bits) {
+      return((group * GROUP) + __builtin_ctz(bits));
+    }
+
+    group = (group + probe + 1) & tbl.m_mask;
+  }
+
+  /* not reached, growth_left keeps at least one slot free. */
+  return(NIL);
+}
+
+uint32_t mna::mac_index::find(uint64_t key) const
+{
+  const table_t* tbl = __atomic_load_n(&m_table, __ATOMIC_ACQUIRE);
+  uint64_t idx = NIL;
+
+  if(!tbl || (idx = locate(*tbl, key)) == NIL) {
+    return(NIL);
+  }
+
+  return(tbl->m_slots[idx].m_value);
+}
+
+int32_t mna::mac_index::insert(uint64_t key, uint32_t value)
+{
+  uint64_t h = hash(key);
+  uint64_t idx = 0;
+
+  if(m_table && locate(*m_table, key) != NIL) {
+    return(-1);
+  }
+
+  idx = m_table ? free_slot(*m_table, h) : static_cast<uint64_t>(NIL);
+
+  if(idx == NIL || (m_table->m_ctrl[idx] == EMPTY && !m_growth_left)) {
+    /* table is rebuilt at its size when it is mostly DELETED slots, else it doubles. */
+    rehash((m_size < (m_capacity * 7 / 16)) ? m_capacity : (m_capacity ? m_capacity * 2 : static_cast<uint64_t>(GROUP)));
+    idx = free_slot(*m_table, h);
+  }
+
+  if(m_table->m_ctrl[idx] == EMPTY) {
+    --m_growth_left;
+  }
+
+  m_table->m_slots[idx].set_key(key);
+  m_table->m_slots[idx].m_value = value;
+  /* the slot is filled in before a reader matches its control byte. */
+  __atomic_store_n(&m_table->m_ctrl[idx], static_cast<int8_t>(h & 0x7F), __ATOMIC_RELEASE);
+  ++m_size;
+  return(0);
+}
+
+int32_t mna::mac_index::erase(uint64_t key)
+{
+  uint64_t idx = m_table ? locate(*m_table, key) : static_cast<uint64_t>(NIL);
+
+  if(idx == NIL) {
+    return(-1);
+  }
+
+  /* slot turns EMPTY again only if no probe sequence can have passed through its group. */
+  if(match_empty(*m_table, idx / GROUP)) {
+    m_table->m_ctrl[idx] = EMPTY;
+    ++m_growth_left;
+  } else {
+    m_table->m_ctrl[idx] = DELETED;
+  }
+
+  --m_size;
+  return(0);
+}
+
+void mna::mac_index::reserve(uint64_t count)
+{
+  uint64_t capacity = GROUP;
+
+  while((capacity * 7 / 8) < count) {
+    capacity <<= 1;
+  }
+
+  if(capacity > m_capacity) {
+    rehash(capacity);
+  }
+}
+
+void mna::mac_index::clear()
+{
+  if(!m_table) {
+    return;
+  }
+
+  std::memset(m_table->m_ctrl.get(), EMPTY, m_capacity);
+  m_size = 0;
+  m_growth_left = m_capacity * 7 / 8;
+}
+
+void mna::mac_index::rehash(uint64_t capacity)
+{
+  table_t* tbl = new table_t(capacity);
+  table_t* old = m_table;
+
+  std::memset(tbl->m_ctrl.get(), EMPTY, capacity);
+
+  /* keys are known to be distinct, every one goes to the first free slot of its probe. */
+  for(uint64_t idx = 0; idx < m_capacity; ++idx) {
+    uint64_t to = 0;
+
+    if(old->m_ctrl[idx] < 0) {
+      continue;
+    }
+
+    to = free_slot(*tbl, hash(old->m_slots[idx].key()));
+    tbl->m_ctrl[to] = old->m_ctrl[idx];
+    tbl->m_slots[to] = old->m_slots[idx];
+  }
+
+  /* readers switch to the new table as a whole, the old one may still be read. */
+  __atomic_store_n(&m_table, tbl, __ATOMIC_RELEASE);
+  m_capacity = capacity;
+  m_growth_left = (capacity * 7 / 8) - m_size;
+
+  if(old && m_limbo) {
+    m_limbo->retire(limbo::reclaim_t::from<mna::mac_index, &mna::mac_index::free_table>(*this),
+                    reinterpret_cast<uintptr_t>(old));
+  } else {
+    delete old;
+  }
+}
+
+void mna::mac_index::free_table(uintptr_t tbl)
+{
+  delete reinterpret_cast<table_t*>(tbl);
+}
+
+#endif /*__MAC_INDEX_CC__*/
@@ -1,21 +1,262 @@
 #ifndef __MAIN_CC__
 #define __MAIN_CC__
 
+#include <cstdio>
+
+#include "ace/Get_Opt.h"
+#include "ace/OS_NS_string.h"
+#include "ace/OS_NS_stdlib.h"
+
+#include "ace/Thread_Manager.h"
+
 #include "protocol.h"
 #include "middleware.h"
+#include "worker.h"
+#include "loop.h"
 
-ACE_UINT8 loop_forever(void)
+/*
+ * @brief This function parses a dotted quad IPv4 address.
+ * @param text of address.
+ * @param address in host byte order to be updated.
+ * @param number of characters parsed to be updated.
+ * @return 0 upon success else < 0.
+ * */
+int32_t parse_ip(const char* in, uint32_t& ip, int& consumed)
 {
-  ACE_Time_Value to(5);
+  unsigned int octet[4];
+
+  if(std::sscanf(in, "%u.%u.%u.%u%n", &octet[0], &octet[1], &octet[2], &octet[3], &consumed) != 4 ||
+     octet[0] > 255 || octet[1] > 255 || octet[2] > 255 || octet[3] > 255) {
+    return(-1);
+  }
+
+  ip = (octet[0] << 24) | (octet[1] << 16) | (octet[2] << 8) | octet[3];
+  return(0);
+}
+
+/*
+ * @brief This function parses a range of addresses, first-last, a single address is a range of one.
+ * @param text of range.
+ * @param range to be updated.
+ * @return 0 upon success else < 0.
+ * */
+int32_t parse_range(const char* in, std::pair<uint32_t, uint32_t>& range)
+{
+  int consumed = 0;
+  int rest = 0;
+
+  if(parse_ip(in, range.first, consumed) < 0) {
+    return(-1);
+  }
+
+  range.second = range.first;
 
-  while(1)
-  {
-    ACE_Reactor::instance()->handle_events(to);
+  if('-' == in[consumed] && parse_ip(&in[consumed + 1], range.second, rest) < 0) {
+    return(-1);
   }
 
   return(0);
 }
 
+/*
+ * @brief This function populates the middleware configuration from command line.
+ *        -i <intf> interface name
+ *        -R        receive through the TPACKET_V3 ring
+ *        -b <n>    ring block size in bytes
+ *        -n <n>    number of ring blocks
+ *        -f <n>    ring frame size in bytes
+ *        -t <n>    ring block retire timeout in ms
+ *        -T        transmit through the PACKET_TX_RING
+ *        -m <n>    frames per recvmmsg/sendmmsg batch
+ *        -A        accept all frames, no socket filter
+ *        -w <n>    number of worker threads sharing one PACKET_FANOUT group, a power of two,
+ *                  each serving one shard of the lease table
+ *        -g <n>    PACKET_FANOUT group id
+ *        -X        receive and transmit through AF_XDP, generic mode, one worker
+ *        -q <n>    interface queue the AF_XDP socket is bound to
+ *        -P <n>    number of 2KB buffers in the packet pool
+ *        -H        back the packet pool with hugepages
+ *        -l <loop> event loop, select, epoll or busy
+ *        -L <n>    report request to reply latency every n seconds
+ *        -r <file> replay a pcap/pcapng file instead of opening the interface
+ *        -o <file> pcap file receiving the replies of replay
+ *        -s <x>    replay at capture timestamps scaled by x, as fast as possible if omitted
+ *        -c <path> capture frames to rotating files <path>.<n>.pcapng
+ *        -S <n>    bytes kept of every captured frame, 0 keeps whole frames
+ *        -z <n>    size in MB of one capture file
+ *        -k <n>    number of capture files kept, 0 keeps every file
+ *        -M <mac>  capture frames of this client only, aa:bb:cc:dd:ee:ff
+ *        -y <n>    resolution in ms of the timing wheel of lease timers
+ *        -e <n>    lease expiries dispatched per sweep, 0 for no limit
+ *        -E <n>    time in us one sweep of lease expiries may take, 0 for no limit
+ *        -p <net>  subnet of the address pool, a.b.c.d/len
+ *        -a <rng>  range of the pool handed out, a.b.c.d-e.f.g.h, whole subnet if omitted
+ *        -x <rng>  range of the pool never handed out
+ *        -u <rsv>  address kept for one client, aa:bb:cc:dd:ee:ff=a.b.c.d
+ *        -U <len>  report utilization of the pool per prefix of this length along with latency
+ *        -j <path> lease journal, replayed upon startup
+ *        -J <n>    time in us the journal writer idles when nothing is pending
+ *        -K <n>    journal records before the leases are snapshot and the journal is cut, 0 never
+ *        -B        back the slabs of leases with hugepages
+ *        -Q <port> bulk leasequery (RFC 6926) on 127.0.0.1:<port>, served by the first worker
+ * @param argument count
+ * @param argument vector
+ * @param interface name to be updated
+ * @param configuration to be updated
+ * @return none
+ * */
+void parse_config(int count, char* param[], std::string& intf, mna::config_t& cfg)
+{
+  ACE_Get_Opt opts(count, param, ACE_TEXT("i:Rb:n:f:t:Tm:Aw:g:Xq:P:Hl:L:r:o:s:c:S:z:k:M:y:e:E:p:a:x:u:U:j:J:K:BQ:"));
+  int c = 0;
+  int consumed = 0;
+  std::pair<uint32_t, uint32_t> range;
+  std::pair<std::array<uint8_t, 6>, uint32_t> rsv;
+
+  while((c = opts()) != -1) {
+    switch(c) {
+      case 'i':
+        intf = opts.opt_arg();
+        break;
+      case 'R':
+        cfg.m_rx_ring = true;
+        break;
+      case 'b':
+        cfg.m_rx_block_size = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'n':
+        cfg.m_rx_block_count = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'f':
+        cfg.m_rx_frame_size = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 't':
+        cfg.m_rx_block_timeout = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'T':
+        cfg.m_tx_ring = true;
+        break;
+      case 'm':
+        cfg.m_batch = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'A':
+        cfg.m_filter = false;
+        break;
+      case 'w':
+        cfg.m_workers = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'g':
+        cfg.m_fanout_group = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'X':
+        cfg.m_xdp = true;
+        break;
+      case 'q':
+        cfg.m_xdp_queue = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'P':
+        cfg.m_pool_buffers = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'H':
+        cfg.m_pool_hugepage = true;
+        break;
+      case 'l':
+        if(!ACE_OS::strcmp(opts.opt_arg(), "epoll")) {
+          cfg.m_loop = mna::LOOP_EPOLL;
+        } else if(!ACE_OS::strcmp(opts.opt_arg(), "busy")) {
+          cfg.m_loop = mna::LOOP_BUSY_POLL;
+        } else {
+          cfg.m_loop = mna::LOOP_SELECT;
+        }
+        break;
+      case 'L':
+        cfg.m_latency_report = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'r':
+        cfg.m_replay = opts.opt_arg();
+        break;
+      case 'o':
+        cfg.m_replay_out = opts.opt_arg();
+        break;
+      case 's':
+        cfg.m_replay_speed = ACE_OS::strtod(opts.opt_arg(), nullptr);
+        break;
+      case 'c':
+        cfg.m_tap = opts.opt_arg();
+        break;
+      case 'S':
+        cfg.m_tap_snaplen = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'z':
+        cfg.m_tap_file_mb = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'k':
+        cfg.m_tap_files = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'M':
+        if(std::sscanf(opts.opt_arg(), "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &cfg.m_tap_mac[0], &cfg.m_tap_mac[1],
+                       &cfg.m_tap_mac[2], &cfg.m_tap_mac[3], &cfg.m_tap_mac[4], &cfg.m_tap_mac[5]) != 6) {
+          cfg.m_tap_mac.fill(0);
+        }
+        break;
+      case 'y':
+        cfg.m_wheel_tick_ms = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'e':
+        cfg.m_sweep_budget = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'E':
+        cfg.m_sweep_budget_us = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'p':
+        if(parse_ip(opts.opt_arg(), cfg.m_pool_subnet, consumed) < 0 || '/' != opts.opt_arg()[consumed]) {
+          ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l subnet %s is invalid\n"), opts.opt_arg()));
+          break;
+        }
+        cfg.m_pool_prefix = ACE_OS::atoi(&opts.opt_arg()[consumed + 1]);
+        break;
+      case 'a':
+        if(!parse_range(opts.opt_arg(), range)) {
+          cfg.m_pool_ranges.push_back(range);
+        }
+        break;
+      case 'x':
+        if(!parse_range(opts.opt_arg(), range)) {
+          cfg.m_pool_exclusions.push_back(range);
+        }
+        break;
+      case 'u':
+        consumed = 0;
+        if(std::sscanf(opts.opt_arg(), "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx=%n", &rsv.first[0], &rsv.first[1],
+                       &rsv.first[2], &rsv.first[3], &rsv.first[4], &rsv.first[5], &consumed) == 6 &&
+           !parse_ip(&opts.opt_arg()[consumed], rsv.second, consumed)) {
+          cfg.m_pool_reservations.push_back(rsv);
+        }
+        break;
+      case 'U':
+        cfg.m_utilization_prefix = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'j':
+        cfg.m_journal = opts.opt_arg();
+        break;
+      case 'J':
+        cfg.m_journal_sync_us = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'K':
+        cfg.m_journal_compact = ACE_OS::atoi(opts.opt_arg());
+        break;
+      case 'B':
+        cfg.m_lease_hugepage = true;
+        break;
+      case 'Q':
+        cfg.m_leasequery_port = ACE_OS::atoi(opts.opt_arg());
+        break;
+      default:
+        break;
+    }
+  }
+}
+
 int main(int count, char* param[])
 {
 
@@ -46,13 +287,120 @@ int main(int count, char* param[])
 
 #endif /*__UT__*/
 
-  mna::middleware mw("enp0s9");
+  std::string intf("enp0s9");
+  mna::config_t cfg;
+  cfg.m_fanout_group = (ACE_OS::getpid() & 0xFFFF);
+  parse_config(count, param, intf, cfg);
+
+  /* Every packet buffer of the process is carved out here, before any socket is opened. */
+  if(mna::pkt_pool::instance().setup(cfg.m_pool_buffers, cfg.m_pool_hugepage) < 0) {
+    return(-1);
+  }
+
+  /* Rings are handed out to middlewares as they are instantiated, writer thread picks them up. */
+  if(!cfg.m_tap.empty() &&
+     (mna::capture_tap::instance().setup(cfg.m_tap, cfg.m_tap_slots, cfg.m_tap_snaplen,
+                                         cfg.m_tap_file_mb, cfg.m_tap_files, cfg.m_tap_mac) < 0 ||
+      mna::capture_tap::instance().open() < 0)) {
+    return(-1);
+  }
+
+  /* Bindings are replayed before any middleware is instantiated, every one of them picks them up.
+   * Writer thread is spawned once they are all instantiated, it folds into the same bindings. */
+  if(!cfg.m_journal.empty() &&
+     mna::lease_journal::instance().setup(cfg.m_journal, cfg.m_journal_slots, cfg.m_journal_sync_us,
+                                          cfg.m_journal_compact) < 0) {
+    return(-1);
+  }
+
+  if(!cfg.m_replay.empty()) {
+    /* one middleware on this thread, no socket and no reactor loop. */
+    mna::pcap_source src;
+    mna::middleware mw(intf, cfg);
+    int32_t ret = -1;
+
+    if(src.open(cfg.m_replay) < 0 || (!cfg.m_journal.empty() && mna::lease_journal::instance().open() < 0)) {
+      return(-1);
+    }
+
+    ret = mw.replay(src);
+    mna::capture_tap::instance().stop();
+    mna::lease_journal::instance().stop();
+    return(ret);
+  }
+
+  if(cfg.m_xdp && cfg.m_workers > 1) {
+    /* one program per interface redirects to one socket, fanout is a PF_PACKET feature. */
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l AF_XDP runs with one worker, %u requested\n"), cfg.m_workers));
+    cfg.m_workers = 1;
+  }
+
+  if(cfg.m_workers & (cfg.m_workers - 1)) {
+    /* shards of the lease table and members of the fanout group are a power of two. */
+    uint32_t workers = 1;
+
+    while((workers << 1) <= cfg.m_workers && (workers << 1) <= mna::lease_store::MAX_SHARDS) {
+      workers <<= 1;
+    }
+
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l %u workers run instead of %u, a power of two\n"), workers, cfg.m_workers));
+    cfg.m_workers = workers;
+  }
+
+  if(cfg.m_workers > 1) {
+    std::vector<mna::worker*> workers;
+
+    if(mna::lease_store::instance().setup(cfg.m_workers) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l lease table can not be split into %u shards\n"), cfg.m_workers));
+      return(-1);
+    }
+
+    /* every shard restores its bindings from the shared pool before any of them serves. */
+    for(uint32_t idx = 0; idx < cfg.m_workers; ++idx) {
+      mna::worker* w = nullptr;
+      ACE_NEW_RETURN(w, mna::worker(intf, cfg, idx), -1);
+      workers.push_back(w);
+    }
+
+    for(std::vector<mna::worker*>::iterator it = workers.begin(); it != workers.end(); ++it) {
+      (*it)->open();
+    }
+
+    if(!cfg.m_journal.empty() && mna::lease_journal::instance().open() < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l lease changes are not journaled\n")));
+    }
+
+    ACE_Thread_Manager::instance()->wait();
+
+    for(std::vector<mna::worker*>::iterator it = workers.begin(); it != workers.end(); ++it) {
+      delete *it;
+    }
+
+    mna::capture_tap::instance().stop();
+    mna::lease_journal::instance().stop();
+    return(0);
+  }
+
+  ACE_Reactor* reactor = mna::event_loop::make_reactor(cfg.m_loop);
+
+  if(!reactor) {
+    return(-1);
+  }
+
+  mna::middleware mw(intf, cfg);
   //mw.set_rx_dispatch(mw.eth().get_upstream());
 
-  ACE_Reactor::instance()->register_handler(&mw, ACE_Event_Handler::READ_MASK);
+  if(!cfg.m_journal.empty() && mna::lease_journal::instance().open() < 0) {
+    delete reactor;
+    return(-1);
+  }
 
-  loop_forever();
+  mna::event_loop loop(mw, *reactor);
+  loop.run();
 
+  mna::capture_tap::instance().stop();
+  mna::lease_journal::instance().stop();
+  delete reactor;
   return(0);
 }
 
@@ -14,35 +14,89 @@ mna::middleware* mna::middleware::m_instance = nullptr;
  */
 ACE_INT32 mna::middleware::handle_input(ACE_HANDLE handle)
 {
-  ACE_Message_Block *mb = nullptr;
-  ACE_INET_Addr peer;
-  size_t recv_len = -1;
+  if(mna::LOOP_EPOLL != m_config.m_loop) {
+    receive(handle);
+    return(0);
+  }
+
+  /* Handle is not reported again until re-armed, everything pending is drained now. */
+  while(receive(handle) > 0) {
+    ;
+  }
+
+  return(0);
+}
+
+int32_t mna::middleware::receive(ACE_HANDLE handle)
+{
+  uint8_t* buf = nullptr;
+  ssize_t recv_len = -1;
+  int32_t frames = 0;
+
+  if(m_xdp.is_open()) {
+    /* Frames are dispatched from UMEM and handed back through the fill ring. */
+    frames = m_xdp.poll(upstream_delegate_t::from<mna::middleware, &mna::middleware::rx>(*this));
+    flush();
+    return(frames);
+  }
+
+  if(m_rx_ring.is_attached()) {
+    /* Walk the retired blocks in place, no copy and no allocation per frame. */
+    frames = m_rx_ring.poll(upstream_delegate_t::from<mna::middleware, &mna::middleware::rx>(*this));
+    /* One kick for every response produced while walking the blocks. */
+    flush();
+    return(frames);
+  }
 
-  ACE_NEW_RETURN(mb, ACE_Message_Block(mna::SIZE_1MB), -1);
+  if(m_batch.is_enabled()) {
+    /* Drain up to batch size frames with one syscall, replies go out with one sendmmsg. */
+    frames = m_batch.recv(handle, upstream_delegate_t::from<mna::middleware, &mna::middleware::rx>(*this));
+    flush();
+    return((frames > 0) ? frames : 0);
+  }
+
+  /* Frame is received past the headroom so that a reply could be built in front of it. */
+  if(!(buf = mna::pkt_pool::instance().alloc())) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l packet pool exhausted, frame left in socket for handle %d\n"), handle));
+    return(0);
+  }
 
   do
   {
-    ACE_OS::memset((void *)mb->wr_ptr(), 0, mna::SIZE_1MB);
+    recv_len = ACE_OS::recv(handle, (char *)(buf + mna::pkt_pool::HEADROOM),
+                            (mna::pkt_pool::BUFFER_SIZE - mna::pkt_pool::HEADROOM), MSG_DONTWAIT);
 
-    if(!(recv_len = m_sock_dgram.recv(mb->wr_ptr(), mna::SIZE_1MB, peer)))
+    if(recv_len <= 0)
     {
-      ACE_ERROR((LM_ERROR, "Receive from peer 0x%X Failed\n", peer.get_port_number()));
+      if(EAGAIN != errno && EWOULDBLOCK != errno)
+      {
+        ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Receive failed for handle %d\n"), handle));
+      }
       break;
     }
 
     ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l recv_len is %u\n"), recv_len));
-    /*Update the length now.*/
-    mb->wr_ptr(recv_len);
 
-    /* dispatch packet to the upstream */
-    rx(reinterpret_cast<uint8_t*>(mb->rd_ptr()), (uint32_t)mb->length());
+    if(m_config.m_latency_report)
+    {
+      struct timespec ts;
+      /* kernel keeps the receive time of last frame read from socket. */
+      if(!ACE_OS::ioctl(handle, SIOCGSTAMPNS, &ts))
+      {
+        m_pkt_stamp = (static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+      }
+    }
 
-    /* Reclaim the heap memory now.*/
-    mb->release();
+    /* dispatch packet to the upstream */
+    rx(buf + mna::pkt_pool::HEADROOM, (uint32_t)recv_len);
+    frames = 1;
 
   }while(0);
 
-  return(0);
+  mna::pkt_pool::instance().free(buf);
+
+  flush();
+  return(frames);
 }
 
 /*
@@ -75,17 +129,28 @@ ACE_INT32 mna::middleware::handle_signal(int signum, siginfo_t *s, ucontext_t *u
 ACE_HANDLE mna::middleware::handle_timeout(const ACE_Time_Value &tv, const void *arg)
 {
   ACE_TRACE(("mna::middleware::handle_timeout"));
-  ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l Timer is expired\n")));
 
+  /* Frames sent upon timer expiry are not replies to a request. */
+  m_rx_stamp = 0;
+
+  if(arg == &m_wheel) {
+    /* periodic tick, timers due by now are dispatched to m_to_dispatch. */
+    sweep();
+    return(0);
+  }
+
+  ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l Timer is expired\n")));
   process_timeout(arg);
+  flush();
   return(0);
 }
 
 /*
- * @brief this member function is invoked to start the timer.
+ * @brief this member function is invoked to start the timer, the timer is armed in the
+ *        timing wheel which is advanced by one periodic reactor timer.
  * @param This is the duration for timer.
  * @param This is the argument passed by caller.
- * @param This is to denote the preodicity whether this timer is going to be periodic or not.
+ * @param This is the interval after which a periodic timer is started again, zero for one-shot.
  * @return timer_id is return.
  * */
 long mna::middleware::start_timer(ACE_UINT32 to,
@@ -93,16 +158,7 @@ long mna::middleware::start_timer(ACE_UINT32 to,
                                   ACE_Time_Value interval)
 {
   ACE_TRACE(("mna::middleware::start_timer"));
-  ACE_Time_Value delay(to);
-  long tid = 0;
-
-  tid = ACE_Reactor::instance()->schedule_timer(this,
-                                                act,
-                                                delay,
-                                                interval/*After this interval, timer will be started automatically.*/);
-
-  /*Timer Id*/
-  return(tid);
+  return(m_wheel.schedule(act, static_cast<uint64_t>(to) * 1000ULL, interval.msec()));
 }
 
 /*
@@ -117,21 +173,83 @@ long mna::middleware::start_timer(ACE_UINT32 to,
                                   bool periodicity)
 {
   ACE_TRACE(("mna::middleware::start_timer"));
-  ACE_Time_Value delay(to);
-  long tid = 0;
+  uint64_t delay = static_cast<uint64_t>(to) * 1000ULL;
 
-  tid = ACE_Reactor::instance()->schedule_timer(this,
-                                                act,
-                                                delay,
-                                                ACE_Time_Value::zero/*After this interval, timer will be started automatically.*/);
+  return(m_wheel.schedule(act, delay, periodicity ? delay : 0));
+}
 
-  /*Timer Id*/
-  return(tid);
+/*
+ * @brief this member function is invoked to start the timer of a lease, the token is carried
+ *        by value as act of the timer and handed back to timer dispatch upon expiry.
+ * @param This is the duration for timer.
+ * @param This is the slot and generation of the lease.
+ * @param This is to denote the preodicity whether this timer is going to be periodic or not.
+ * @return timer_id is return.
+ * */
+long mna::middleware::start_timer(ACE_UINT32 to,
+                                  timer_token_t token,
+                                  bool periodicity)
+{
+  ACE_TRACE(("mna::middleware::start_timer"));
+  return(start_timer(to, token.to_act(), periodicity));
 }
 
 void mna::middleware::stop_timer(long tId)
 {
-  ACE_Reactor::instance()->cancel_timer(tId);
+  m_wheel.cancel(tId);
+}
+
+int32_t mna::middleware::reset_timer(long tId, ACE_UINT32 to)
+{
+  return(m_wheel.rearm(tId, static_cast<uint64_t>(to) * 1000ULL));
+}
+
+int32_t mna::middleware::start_tick()
+{
+  ACE_Time_Value tick(0, m_wheel.tick_ms() * 1000);
+
+  if(m_tick_id >= 0) {
+    return(0);
+  }
+
+  /* the wheel itself is the act, telling the tick apart from any other timer. */
+  m_tick_id = get_reactor()->schedule_timer(this, &m_wheel, tick, tick);
+
+  if(m_tick_id < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l tick of timing wheel is not scheduled\n")));
+    return(-1);
+  }
+
+  return(0);
+}
+
+uint32_t mna::middleware::sweep()
+{
+  uint32_t fired = 0;
+
+  m_rx_stamp = 0;
+  fired = m_wheel.advance(mna::timing_wheel::now_ms(), m_to_dispatch, m_config.m_sweep_budget,
+                          static_cast<uint64_t>(m_config.m_sweep_budget_us) * 1000ULL);
+  flush();
+
+  if(m_journal) {
+    /* records parked while the journal ring was full. */
+    m_journal->retry();
+  }
+
+  /* leases freed while readers of other threads were attached. */
+  dhcp().reclaim();
+  return(fired);
+}
+
+void mna::middleware::stop_tick()
+{
+  if(m_tick_id < 0) {
+    return;
+  }
+
+  get_reactor()->cancel_timer(m_tick_id);
+  m_tick_id = -1;
 }
 
 long mna::middleware::process_timeout(const void *act)
@@ -166,6 +284,17 @@ ACE_HANDLE mna::middleware::open_and_bind_intf()
 
   do
   {
+    if(m_config.m_xdp)
+    {
+      if(!m_xdp.open(get_index(), m_config.m_xdp_queue, m_config.m_xdp_frames, 2 * mna::SIZE_1KB))
+      {
+        handle = m_xdp.handle();
+        break;
+      }
+
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l AF_XDP unavailable on queue %u, falling back to PF_PACKET\n"), m_config.m_xdp_queue));
+    }
+
     handle = ACE_OS::socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
 
     if(handle < 0)
@@ -206,6 +335,40 @@ ACE_HANDLE mna::middleware::open_and_bind_intf()
       break;
     }
 
+    if(m_config.m_filter)
+    {
+      /* DHCP server is the only handler enabled as of now. */
+      m_filter.enable(mna::match_t(mna::eth::IPv4, mna::ipv4::UDP, mna::transport::BOOTPS));
+
+      if(m_filter.attach(handle) < 0)
+      {
+        ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l socket filter not attached, every frame reaches handle %d\n"), handle));
+      }
+    }
+
+    /* Rings must be in place before bind so that no frame is received outside of it. */
+    if(m_config.m_rx_ring &&
+       m_rx_ring.setup(handle, m_config.m_rx_block_size, m_config.m_rx_block_count,
+                       m_config.m_rx_frame_size, m_config.m_rx_block_timeout) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l RX ring unavailable, falling back to recv for handle %d\n"), handle));
+    }
+
+    if(m_config.m_tx_ring &&
+       m_tx_ring.setup(handle, m_config.m_tx_block_size, m_config.m_tx_block_count, m_config.m_tx_frame_size) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l TX ring unavailable, falling back to send for handle %d\n"), handle));
+    }
+
+    if((m_config.m_rx_ring || m_config.m_tx_ring) && map_rings(handle) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Packet rings are not mapped, falling back to recv and send for handle %d\n"), handle));
+
+      /* the kernel would go on filling rings nobody reads, recv would never see a frame. */
+      if((m_rx_ring.size() && m_rx_ring.release(handle) < 0) || (m_tx_ring.size() && m_tx_ring.release(handle) < 0)) {
+        ACE_OS::close(handle);
+        handle = ACE_INVALID_HANDLE;
+        break;
+      }
+    }
+
     ACE_OS::memset((void *)&sa, 0, sizeof(sa));
     sa.sll_family = AF_PACKET;
     sa.sll_protocol = htons(ETH_P_ALL);
@@ -218,11 +381,163 @@ ACE_HANDLE mna::middleware::open_and_bind_intf()
       break;
     }
 
+    if(m_config.m_workers > 1 && m_filter.fanout(handle, m_config.m_fanout_group, m_config.m_workers) < 0)
+    {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l handle %d is not part of fanout group %u\n"), handle, m_config.m_fanout_group));
+    }
+
+    if(m_config.m_batch > 1 && m_batch.setup(m_config.m_batch, 2 * mna::SIZE_1KB) < 0)
+    {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l batch of %u frames unavailable for handle %d\n"), m_config.m_batch, handle));
+    }
+
   }while(0);
 
   return(handle);
 }
 
+ACE_HANDLE mna::middleware::open_capture()
+{
+  if(!m_config.m_replay_out.empty() && m_sink.open(m_config.m_replay_out) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l replies of replay are discarded\n")));
+  }
+
+  return(ACE_INVALID_HANDLE);
+}
+
+int32_t mna::middleware::replay(capture_source& src)
+{
+  const uint64_t SEC = 1000000000ULL;
+  const uint8_t* frame = nullptr;
+  uint32_t len = 0;
+  uint64_t stamp = 0;
+  uint64_t first = 0;
+  uint64_t start = mna::clock_ns();
+  uint64_t now = start;
+  uint64_t lastReport = start;
+  uint64_t lastFrames = 0;
+  double speed = m_config.m_replay_speed;
+  int32_t ret = 0;
+
+  std::memset(&m_replay_stats, 0, sizeof(m_replay_stats));
+  /* timers of leases keep expiring while replaying. */
+  start_tick();
+
+  while((ret = src.next(frame, len, stamp)) > 0) {
+
+    if(speed > 0 && stamp) {
+      first = first ? first : stamp;
+      uint64_t due = start + static_cast<uint64_t>((stamp > first ? (stamp - first) : 0) / speed);
+
+      /* timers keep running while waiting for the frame to be due. */
+      while((now = mna::clock_ns()) < due) {
+        get_reactor()->timer_queue()->expire();
+        ACE_OS::sleep(ACE_Time_Value(0, ((due - now) > 1000000ULL) ? 1000 : ((due - now) / 1000)));
+      }
+    }
+
+    m_capture_stamp = stamp ? stamp : mna::clock_ns();
+    rx(frame, len);
+    ++m_replay_stats.m_frames;
+
+    if(!(m_replay_stats.m_frames & 0x3FF)) {
+      get_reactor()->timer_queue()->expire();
+
+      if(sweep_pending()) {
+        sweep();
+      }
+
+      now = mna::clock_ns();
+
+      if((now - lastReport) >= SEC) {
+        ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M replay %Q frames %Q replies %Q pps\n"),
+                   m_replay_stats.m_frames, m_replay_stats.m_replies,
+                   ((m_replay_stats.m_frames - lastFrames) * SEC) / (now - lastReport)));
+        lastReport = now;
+        lastFrames = m_replay_stats.m_frames;
+      }
+    }
+  }
+
+  flush();
+  stop_tick();
+  m_sink.flush();
+  m_replay_stats.m_elapsed_ns = mna::clock_ns() - start;
+
+  ACE_DEBUG((LM_INFO, ACE_TEXT("%D %M replayed %Q frames %Q replies in %Q us, %Q pps\n"),
+             m_replay_stats.m_frames, m_replay_stats.m_replies, m_replay_stats.m_elapsed_ns / 1000,
+             m_replay_stats.m_elapsed_ns ? ((m_replay_stats.m_frames * SEC) / m_replay_stats.m_elapsed_ns) : 0));
+
+  return((ret < 0) ? -1 : 0);
+}
+
+ACE_INT32 mna::middleware::enable_handler(const match_t& m)
+{
+  if(!m_config.m_filter || m_xdp.is_open() || !m_filter.enable(m)) {
+    return(0);
+  }
+
+  return(m_filter.attach(m_handle));
+}
+
+ACE_INT32 mna::middleware::disable_handler(const match_t& m)
+{
+  if(!m_config.m_filter || m_xdp.is_open() || !m_filter.disable(m)) {
+    return(0);
+  }
+
+  return(m_filter.attach(m_handle));
+}
+
+/**
+ * @brief This member method maps the packet rings requested on socket into process address
+ *        space. Kernel expects one mapping covering every ring of the socket.
+ * @param handle of PF_PACKET socket.
+ * @return upon success 0 else < 0.
+ * */
+ACE_INT32 mna::middleware::map_rings(ACE_HANDLE handle)
+{
+  void* base = MAP_FAILED;
+  /* receive ring comes first followed by transmit ring. */
+  size_t len = m_rx_ring.size() + m_tx_ring.size();
+
+  if(!len) {
+    return(-1);
+  }
+
+  base = ACE_OS::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, handle, 0);
+
+  if(MAP_FAILED == base) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l mmap of %u bytes failed for handle %d\n"), len, handle));
+    return(-1);
+  }
+
+  m_ring_base = reinterpret_cast<uint8_t*>(base);
+  m_ring_len = len;
+
+  if(m_rx_ring.size()) {
+    m_rx_ring.attach(m_ring_base);
+  }
+
+  if(m_tx_ring.size()) {
+    m_tx_ring.attach(m_ring_base + m_rx_ring.size());
+  }
+
+  return(0);
+}
+
+void mna::middleware::unmap_rings()
+{
+  m_rx_ring.detach();
+  m_tx_ring.detach();
+
+  if(m_ring_base) {
+    ACE_OS::munmap(m_ring_base, m_ring_len);
+    m_ring_base = nullptr;
+    m_ring_len = 0;
+  }
+}
+
 /**
  * @brief This member method retrieves the eth device index based on eth device name.
  * @param none
@@ -265,6 +580,207 @@ ACE_INT32 mna::middleware::get_index()
   return(retStatus);
 }
 
+/**
+ * @brief This member method retrieves the MAC address of eth device.
+ * @param MAC address to be updated.
+ * @return upon success 0 else < 0.
+ * */
+ACE_INT32 mna::middleware::get_mac(std::array<uint8_t, 6>& mac)
+{
+  ACE_HANDLE handle = -1;
+  struct ifreq ifr;
+  ACE_INT32 retStatus = -1;
+
+  do
+  {
+    handle = ACE_OS::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if(handle < 0)
+    {
+      ACE_ERROR((LM_ERROR, "%Isocket creation failed\n"));
+      break;
+    }
+
+    ACE_OS::memset((void *)&ifr, 0, sizeof(struct ifreq));
+    ACE_OS::strncpy(ifr.ifr_name, (const char *)m_intf.c_str(), (IFNAMSIZ - 1));
+
+    if(ACE_OS::ioctl(handle, SIOCGIFHWADDR, &ifr) < 0)
+    {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Retrieval of MAC address failed for handle %d\n"), handle));
+      ACE_OS::close(handle);
+      break;
+    }
+
+    ACE_OS::close(handle);
+    std::copy(ifr.ifr_hwaddr.sa_data, ifr.ifr_hwaddr.sa_data + mna::ETH_ALEN, mac.begin());
+    retStatus = 0;
+
+  }while(0);
+
+  return(retStatus);
+}
+
+/**
+ * @brief This member method retrieves the IPv4 address of eth device.
+ * @param IP address in network byte order to be updated.
+ * @return upon success 0 else < 0.
+ * */
+ACE_INT32 mna::middleware::get_ip(uint32_t& ip)
+{
+  ACE_HANDLE handle = -1;
+  struct ifreq ifr;
+  ACE_INT32 retStatus = -1;
+
+  do
+  {
+    handle = ACE_OS::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if(handle < 0)
+    {
+      ACE_ERROR((LM_ERROR, "%Isocket creation failed\n"));
+      break;
+    }
+
+    ACE_OS::memset((void *)&ifr, 0, sizeof(struct ifreq));
+    ifr.ifr_addr.sa_family = AF_INET;
+    ACE_OS::strncpy(ifr.ifr_name, (const char *)m_intf.c_str(), (IFNAMSIZ - 1));
+
+    if(ACE_OS::ioctl(handle, SIOCGIFADDR, &ifr) < 0)
+    {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Retrieval of IP address failed for handle %d\n"), handle));
+      ACE_OS::close(handle);
+      break;
+    }
+
+    ACE_OS::close(handle);
+    ip = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr.s_addr;
+    retStatus = 0;
+
+  }while(0);
+
+  return(retStatus);
+}
+
+void mna::middleware::connect_downstream()
+{
+  std::array<uint8_t, 6> mac;
+  uint32_t addr = 0;
+
+  dhcp().set_downstream(mna::dhcp::server::downstream_t::from(udp(), &mna::transport::udp::tx));
+  dhcp().set_tx_buffer(mna::dhcp::server::tx_buffer_t::from(*this, &mna::middleware::tx_buffer));
+  udp().set_downstream(mna::transport::udp::downstream_t::from(ip(), &mna::ipv4::ip::tx));
+  ip().set_downstream(mna::ipv4::ip::downstream_t::from(eth(), &mna::eth::ether::tx));
+  eth().set_downstream(mna::eth::ether::downstream_t::from(*this, &mna::middleware::tx));
+
+  /* lease timers carry the token of their entry, resolved by dhcp server upon expiry. */
+  dhcp().set_start_timer(mna::dhcp::server::start_timer_t::from(*this, &mna::middleware::start_timer));
+  dhcp().set_stop_timer(mna::dhcp::server::stop_timer_t::from(*this, &mna::middleware::stop_timer));
+  dhcp().set_reset_timer(mna::dhcp::server::reset_timer_t::from(*this, &mna::middleware::reset_timer));
+  dhcp().set_journal(mna::dhcp::server::journal_t::from(*this, &mna::middleware::journal));
+  set_timer_dispatch(timer_delegate_t::from(dhcp(), &mna::dhcp::server::timedOut));
+
+  mac.fill(0);
+  if(!get_mac(mac)) {
+    eth().intf_mac(mac);
+  }
+
+  if(!get_ip(addr)) {
+    ip().local_ip(addr);
+  }
+
+  dhcp().setup_entries(mna::slab_base::DEFAULT_CELLS, m_config.m_lease_hugepage);
+  dhcp().attach(m_config.m_shard);
+  setup_pool(addr);
+}
+
+void mna::middleware::journal(uint8_t type, const uint8_t* chaddr, uint32_t ip, uint32_t lease)
+{
+  mna::lease_record_t rec;
+
+  if(!m_journal) {
+    return;
+  }
+
+  std::memset(&rec, 0, sizeof(rec));
+  rec.m_type = type;
+  std::memcpy(rec.m_chaddr, chaddr, sizeof(rec.m_chaddr));
+  rec.m_ip = ip;
+  rec.m_lease = lease;
+  rec.m_stamp = mna::clock_ns();
+  rec.m_expiry = (rec.m_stamp / 1000000000ULL) + lease;
+  m_journal->append(rec);
+}
+
+uint32_t mna::middleware::restore_leases()
+{
+  mna::lease_store& store = mna::lease_store::instance();
+  uint64_t now = mna::clock_ns() / 1000000000ULL;
+  uint32_t restored = 0;
+
+  for(const mna::lease_record_t& rec : mna::lease_journal::instance().leases()) {
+    /* a binding of another shard is restored by the worker its packets are fanned out to. */
+    if(store.shard_of(rec.m_chaddr) != m_config.m_shard) {
+      continue;
+    }
+
+    if(rec.m_expiry > now && !dhcp().restore(rec.m_chaddr, rec.m_ip, rec.m_expiry - now)) {
+      ++restored;
+    }
+  }
+
+  if(restored) {
+    ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l %u leases restored from journal\n"), restored));
+  }
+
+  return(restored);
+}
+
+int32_t mna::middleware::setup_pool(uint32_t localIP)
+{
+  mna::ip_pool& pool = dhcp().pool();
+  uint32_t size = 0;
+
+  if(!mna::lease_store::instance().claim_pool()) {
+    /* set up by the middleware of another shard. */
+    return(dhcp().m_dhcpIndexOnIP.setup(pool.subnet(), m_config.m_pool_prefix));
+  }
+
+  if(pool.setup(m_config.m_pool_subnet, m_config.m_pool_prefix) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l prefix length %u of address pool is invalid\n"), m_config.m_pool_prefix));
+    return(-1);
+  }
+
+  dhcp().m_dhcpIndexOnIP.setup(pool.subnet(), m_config.m_pool_prefix);
+
+  if(m_config.m_pool_ranges.empty() && m_config.m_pool_prefix < 31) {
+    /* subnet and broadcast address are left out. */
+    size = 1U << (32 - m_config.m_pool_prefix);
+    pool.add_range(pool.subnet() + 1, pool.subnet() + size - 2);
+  }
+
+  for(const std::pair<uint32_t, uint32_t>& range : m_config.m_pool_ranges) {
+    if(pool.add_range(range.first, range.second) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l range %x-%x is outside the address pool\n"), range.first, range.second));
+    }
+  }
+
+  for(const std::pair<uint32_t, uint32_t>& range : m_config.m_pool_exclusions) {
+    pool.exclude(range.first, range.second);
+  }
+
+  if(localIP) {
+    pool.exclude(ntohl(localIP), ntohl(localIP));
+  }
+
+  for(const std::pair<std::array<uint8_t, 6>, uint32_t>& rsv : m_config.m_pool_reservations) {
+    if(pool.reserve(rsv.first.data(), rsv.second) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l reservation of %x is rejected\n"), rsv.second));
+    }
+  }
+
+  return(0);
+}
+
 /**
  * @brief This is the main entry point to protocol interface, the ethernet packet is
  *        passed to ethernet handler with help of delegate.
@@ -277,6 +793,14 @@ int32_t mna::middleware::rx(const uint8_t* in, uint32_t inLen)
   /*Identify the packet type and connect the object of protocol layer by using delegate*/
   mna::eth::ETH* pEth = (mna::eth::ETH* )in;
 
+  if(m_config.m_latency_report) {
+    m_rx_stamp = rx_stamp();
+  }
+
+  if(m_tap) {
+    m_tap->push(in, inLen, mna::pcapng_sink::DIR_IN, m_rx_stamp ? m_rx_stamp : mna::clock_ns());
+  }
+
   do {
 
     if(!pEth) {
@@ -284,11 +808,37 @@ int32_t mna::middleware::rx(const uint8_t* in, uint32_t inLen)
       break;
     }
 
+    /* a frame cut short, on the wire or by the snaplen of a replayed capture, is dropped
+       before any header past its end is read. */
+    if(inLen < sizeof(mna::eth::ETH)) {
+      ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l runt frame of %u bytes is dropped\n"), inLen));
+      break;
+    }
+
     switch(ntohs(pEth->proto)) {
 
       case mna::eth::IPv4: {
 
         mna::ipv4::IP* pIP = (mna::ipv4::IP* )&in[sizeof(mna::eth::ETH)];
+        uint32_t hdrLen = 0;
+        uint32_t totLen = 0;
+
+        if(inLen < (sizeof(mna::eth::ETH) + sizeof(mna::ipv4::IP))) {
+          ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l runt IP packet of %u bytes is dropped\n"), inLen));
+          break;
+        }
+
+        hdrLen = pIP->len * 4;
+        totLen = ntohs(pIP->tot_len);
+
+        if(hdrLen < sizeof(mna::ipv4::IP) || totLen < hdrLen || (inLen - sizeof(mna::eth::ETH)) < totLen) {
+          ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l IP packet of %u bytes with header of %u and total length of %u is dropped\n"),
+                     inLen, hdrLen, totLen));
+          break;
+        }
+
+        /* padding of a short frame is not part of the datagram. */
+        inLen = sizeof(mna::eth::ETH) + totLen;
         eth().set_upstream(mna::ipv4::ip::upstream_t::from(ip(), &mna::ipv4::ip::rx));
 
         switch(pIP->proto) {
@@ -300,7 +850,11 @@ int32_t mna::middleware::rx(const uint8_t* in, uint32_t inLen)
 
           case mna::ipv4::TCP: {
 
-            mna::transport::TCP* pTCP = (mna::transport::TCP* )&pIP[sizeof(mna::transport::TCP)];
+            if((totLen - hdrLen) < sizeof(mna::transport::TCP)) {
+              break;
+            }
+
+            mna::transport::TCP* pTCP = (mna::transport::TCP* )&in[sizeof(mna::eth::ETH) + (pIP->len * 4)];
             //ip().set_upstream(mna::transport::tcp::upstream_t::from(tcp(), &mna::transport::tcp::rx));
             switch(ntohs(pTCP->dest_port)) {
               case mna::transport::HTTP: {
@@ -331,7 +885,17 @@ int32_t mna::middleware::rx(const uint8_t* in, uint32_t inLen)
           case mna::ipv4::UDP: {
             ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l the porotocol is UDP \n")));
             ip().set_upstream(mna::transport::udp::upstream_t::from(udp(), &mna::transport::udp::rx));
-            mna::transport::UDP* pUDP = (mna::transport::UDP* )&pIP[sizeof(mna::transport::UDP)];
+            mna::transport::UDP* pUDP = (mna::transport::UDP* )&in[sizeof(mna::eth::ETH) + hdrLen];
+
+            if((totLen - hdrLen) < sizeof(mna::transport::UDP) || ntohs(pUDP->len) < sizeof(mna::transport::UDP) ||
+               ntohs(pUDP->len) > (totLen - hdrLen)) {
+              ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l UDP datagram of %u bytes within IP payload of %u is dropped\n"),
+                         ((totLen - hdrLen) < sizeof(mna::transport::UDP)) ? 0U : ntohs(pUDP->len), (totLen - hdrLen)));
+              break;
+            }
+
+            /* every layer above is handed the datagram only, whatever trails it is cut off. */
+            inLen = sizeof(mna::eth::ETH) + hdrLen + ntohs(pUDP->len);
 
             switch(ntohs(pUDP->dest_port)) {
 
@@ -340,10 +904,6 @@ int32_t mna::middleware::rx(const uint8_t* in, uint32_t inLen)
                 ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l the DHCP dest_port is %u\n"), ntohs(pUDP->dest_port)));
                 udp().set_upstream(mna::dhcp::server::upstream_t::from(dhcp(), &mna::dhcp::server::rx));
 
-                /*Updating timers' member function.*/
-                dhcp().set_start_timer(mna::dhcp::server::start_timer_t::from(*this, &mna::middleware::start_timer));
-                dhcp().set_stop_timer(mna::dhcp::server::stop_timer_t::from(*this, &mna::middleware::stop_timer));
-
                 /*! Kick the processing of the request now.*/
                 eth().rx(in, inLen);
                 break;
@@ -393,9 +953,155 @@ int32_t mna::middleware::rx(const uint8_t* in, uint32_t inLen)
   return(0);
 }
 
+/**
+ * @brief This member method hands out the buffer in which a response is encoded. With transmit
+ *        ring in place it is the data area of next free slot so that no copy is needed later.
+ * @param capacity of the buffer after headroom is updated.
+ * @return pointer past the headroom for ethernet, IP and UDP header.
+ * */
+uint8_t* mna::middleware::tx_buffer(uint32_t& capacity)
+{
+  uint8_t* slot = nullptr;
+  uint32_t len = 0;
+
+  if(m_xdp.is_open() && (slot = m_xdp.acquire(len)) && len > mna::TX_HEADROOM) {
+    capacity = len - mna::TX_HEADROOM;
+    return(slot + mna::TX_HEADROOM);
+  }
+
+  if(m_tx_ring.is_attached() && (slot = m_tx_ring.acquire(len)) && len > mna::TX_HEADROOM) {
+    capacity = len - mna::TX_HEADROOM;
+    return(slot + mna::TX_HEADROOM);
+  }
+
+  if(m_batch.is_enabled()) {
+    if(!(slot = m_batch.acquire(len))) {
+      /* Every buffer of the batch is in use, send them now. */
+      m_batch.flush(m_handle);
+      slot = m_batch.acquire(len);
+    }
+
+    capacity = len - mna::TX_HEADROOM;
+    return(slot + mna::TX_HEADROOM);
+  }
+
+  /* Held until the frame is sent, handed out again if no frame came out of it. */
+  if(!m_tx_pkt && !(m_tx_pkt = mna::pkt_pool::instance().alloc())) {
+    return(nullptr);
+  }
+
+  capacity = mna::pkt_pool::BUFFER_SIZE - mna::pkt_pool::HEADROOM;
+  return(m_tx_pkt + mna::pkt_pool::HEADROOM);
+}
+
+/**
+ * @brief This member method is the bottom of transmit path. The frame is queued into the
+ *        transmit ring and sent with next flush, else it is sent right away.
+ * @param pointer to ethernet frame.
+ * @param length of ethernet frame.
+ * @return 0 upon success else < 0.
+ * */
 int32_t mna::middleware::tx(uint8_t* out, uint32_t inLen)
 {
-  return(0);
+  if(m_tap) {
+    m_tap->push(out, inLen, mna::pcapng_sink::DIR_OUT, mna::clock_ns());
+  }
+
+  if(m_rx_stamp) {
+    /* latency is recorded once the reply leaves with next flush. */
+    m_tx_stamps.push_back(m_rx_stamp);
+  }
+
+  if(m_xdp.is_open()) {
+    return(m_xdp.commit(out, inLen));
+  }
+
+  if(m_tx_ring.is_attached()) {
+    return(m_tx_ring.commit(out, inLen));
+  }
+
+  if(m_batch.is_enabled()) {
+    return(m_batch.queue(out, inLen));
+  }
+
+  int32_t retStatus = 0;
+
+  if(ACE_INVALID_HANDLE == m_handle) {
+    /* replaying, reply goes to output capture if any. */
+    ++m_replay_stats.m_replies;
+    retStatus = m_sink.is_open() ? m_sink.write(out, inLen, m_capture_stamp) : 0;
+
+  } else if(ACE_OS::send(m_handle, (const char *)out, inLen, 0) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l send of %u bytes failed for handle %d\n"), inLen, m_handle));
+    retStatus = -1;
+  }
+
+  if(m_tx_pkt && mna::pkt_pool::instance().owns(out)) {
+    mna::pkt_pool::instance().free(m_tx_pkt);
+    m_tx_pkt = nullptr;
+  }
+
+  record_latency();
+  return(retStatus);
+}
+
+/**
+ * @brief This member method kicks the transmit ring, or sends the batch, once for every frame
+ *        queued since the previous flush. It is invoked once per reactor iteration.
+ * @param none
+ * @return number of frames flushed.
+ * */
+uint32_t mna::middleware::flush()
+{
+  uint32_t flushed = 0;
+
+  if(m_xdp.is_open()) {
+    flushed = m_xdp.flush();
+
+  } else if(m_tx_ring.is_attached()) {
+    flushed = m_tx_ring.flush(m_handle);
+
+  } else if(m_batch.is_enabled()) {
+    flushed = m_batch.flush(m_handle);
+  }
+
+  record_latency();
+  return(flushed);
+}
+
+uint64_t mna::middleware::rx_stamp()
+{
+  uint64_t stamp = 0;
+
+  if(m_rx_ring.is_attached()) {
+    return(m_rx_ring.stamp());
+  }
+
+  if(m_pkt_stamp) {
+    stamp = m_pkt_stamp;
+    m_pkt_stamp = 0;
+    return(stamp);
+  }
+
+  /* recvmmsg and AF_XDP frames are stamped upon dispatch. */
+  return(mna::clock_ns());
+}
+
+void mna::middleware::record_latency()
+{
+  uint64_t now = 0;
+
+  if(m_tx_stamps.empty()) {
+    return;
+  }
+
+  now = mna::clock_ns();
+
+  for(std::vector<uint64_t>::const_iterator it = m_tx_stamps.begin(); it != m_tx_stamps.end(); ++it) {
+    m_latency.record((now > *it) ? (now - *it) : 0);
+  }
+
+  m_tx_stamps.clear();
 }
 
 
@@ -0,0 +1,148 @@
+#ifndef __POOL_CC__
+#define __POOL_CC__
+
+#include <sys/mman.h>
+
+#include "ace/Log_Msg.h"
+#include "ace/OS_NS_sys_mman.h"
+
+#include "pool.h"
+
+mna::pkt_pool& mna::pkt_pool::instance()
+{
+  static mna::pkt_pool pool;
+  return(pool);
+}
+
+int32_t mna::pkt_pool::setup(uint32_t count, bool hugepage)
+{
+  /* hugepage is 2MB on every platform of interest. */
+  const size_t HUGEPAGE = 2 * 1024 * 1024;
+  void* base = MAP_FAILED;
+
+  if(m_base) {
+    return(0);
+  }
+
+  if(!count || count >= NIL) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Invalid number of packet buffers %u\n"), count));
+    return(-1);
+  }
+
+  m_len = static_cast<size_t>(count) * BUFFER_SIZE;
+
+  if(hugepage) {
+    m_len = ((m_len + HUGEPAGE - 1) / HUGEPAGE) * HUGEPAGE;
+    base = ACE_OS::mmap(nullptr, m_len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, ACE_INVALID_HANDLE, 0);
+
+    if(MAP_FAILED == base) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l hugepages unavailable for %u packet buffers, using regular pages\n"), count));
+      m_len = static_cast<size_t>(count) * BUFFER_SIZE;
+    }
+  }
+
+  m_hugepage = (MAP_FAILED != base);
+
+  if(MAP_FAILED == base) {
+    base = ACE_OS::mmap(nullptr, m_len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, ACE_INVALID_HANDLE, 0);
+  }
+
+  if(MAP_FAILED == base) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l mmap of %u packet buffers failed\n"), count));
+    m_len = 0;
+    return(-1);
+  }
+
+  m_base = reinterpret_cast<uint8_t*>(base);
+  m_count = count;
+  m_next.reset(new std::atomic<uint32_t>[count]);
+
+  /* buffer 0 on top of the stack, each one linked to the next. */
+  for(uint32_t idx = 0; idx < count; ++idx) {
+    m_next[idx].store((idx + 1 < count) ? (idx + 1) : static_cast<uint32_t>(NIL), std::memory_order_relaxed);
+  }
+
+  m_head.store(0, std::memory_order_release);
+  return(0);
+}
+
+void mna::pkt_pool::release()
+{
+  if(m_base) {
+    ACE_OS::munmap(m_base, m_len);
+  }
+
+  m_base = nullptr;
+  m_len = 0;
+  m_count = 0;
+  m_next.reset();
+  m_head.store(NIL);
+}
+
+uint8_t* mna::pkt_pool::alloc()
+{
+  uint64_t head = m_head.load(std::memory_order_acquire);
+  uint64_t top = 0;
+  uint32_t idx = 0;
+
+  do {
+    idx = static_cast<uint32_t>(head);
+
+    if(NIL == idx) {
+      m_exhausted.fetch_add(1, std::memory_order_relaxed);
+      return(nullptr);
+    }
+
+    /* tag is bumped on every pop so that a stale head never compares equal. */
+    top = (((head >> 32) + 1) << 32) | m_next[idx].load(std::memory_order_relaxed);
+
+  } while(!m_head.compare_exchange_weak(head, top, std::memory_order_acq_rel, std::memory_order_acquire));
+
+  uint32_t inUse = m_in_use.fetch_add(1, std::memory_order_relaxed) + 1;
+  uint32_t high = m_high_water.load(std::memory_order_relaxed);
+
+  while(inUse > high && !m_high_water.compare_exchange_weak(high, inUse, std::memory_order_relaxed)) {
+    ;
+  }
+
+  return(m_base + (static_cast<size_t>(idx) * BUFFER_SIZE));
+}
+
+void mna::pkt_pool::free(const uint8_t* buf)
+{
+  uint64_t head = 0;
+  uint64_t top = 0;
+  uint32_t idx = 0;
+
+  if(!owns(buf)) {
+    return;
+  }
+
+  idx = static_cast<uint32_t>((buf - m_base) / BUFFER_SIZE);
+  head = m_head.load(std::memory_order_relaxed);
+
+  do {
+    m_next[idx].store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+    top = (((head >> 32) + 1) << 32) | idx;
+
+  } while(!m_head.compare_exchange_weak(head, top, std::memory_order_release, std::memory_order_relaxed));
+
+  m_in_use.fetch_sub(1, std::memory_order_relaxed);
+}
+
+mna::pool_stats_t mna::pkt_pool::stats() const
+{
+  mna::pool_stats_t st;
+
+  st.m_buffers = m_count;
+  st.m_in_use = m_in_use.load(std::memory_order_relaxed);
+  st.m_high_water = m_high_water.load(std::memory_order_relaxed);
+  st.m_exhausted = m_exhausted.load(std::memory_order_relaxed);
+  st.m_hugepage = m_hugepage;
+
+  return(st);
+}
+
+#endif /*__POOL_CC__*/
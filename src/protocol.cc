@@ -9,15 +9,12 @@ int32_t mna::dhcp::OnDiscover::receive(void* parent, const uint8_t* inPtr, uint3
   std::cout << "6.OnDiscover::receive ---> " << inPtr << "inLen " << inLen << std::endl;
   dhcpEntry *dEnt = reinterpret_cast<dhcpEntry*>(parent);
 
-  mna::dhcp::element_def_UMap_t::const_iterator it;
-  it = dEnt->m_elemDefUMap.find(mna::dhcp::MESSAGE_TYPE);
+  const mna::dhcp::options_t& opts = dEnt->options();
 
-  if(it != dEnt->m_elemDefUMap.end()) {
-
-    mna::dhcp::element_def_t elm = it->second;
+  if(opts.has(mna::dhcp::MESSAGE_TYPE)) {
 
     dEnt->buildAndSendResponse(inPtr, inLen);
-    switch(std::get<0>(elm.get_val())) {
+    switch(opts.message_type()) {
 
       case mna::dhcp::DISCOVER:
         std::cout << "DISCOVER Received " << std::endl;
@@ -32,9 +29,10 @@ int32_t mna::dhcp::OnDiscover::receive(void* parent, const uint8_t* inPtr, uint3
         break;
 
       case mna::dhcp::RELEASE:
+      case mna::dhcp::DECLINE:
         std::cout << "RELEASE Received " << std::endl;
-        /** move to Next State. */
-        dEnt->setState(OnDiscover::instance());
+        /* the entry is freed once the FSM is done with it. */
+        dEnt->release();
         break;
 
       case mna::dhcp::INFORM:
@@ -66,9 +64,7 @@ void mna::dhcp::OnRequest::onEntry(void* parent)
 {
   dhcpEntry *dEnt = reinterpret_cast<dhcpEntry*>(parent);
   std::cout << "5.OnRequest::onEntry is invoked & Timer is started" << std::endl;
-  std::string data((const char* )dEnt->get_chaddr().data(), 6);
-  //dEnt->set_tid(dEnt->startTimer(/*dEnt->get_lease()*/1, (const void* )dEnt->get_chaddr().data()));
-  dEnt->set_tid(dEnt->startTimer(/*dEnt->get_lease()*/1, (const void* )data.c_str()));
+  dEnt->set_tid(dEnt->startTimer(dEnt->get_lease_timer(), dEnt->get_token()));
 }
 
 void mna::dhcp::OnRequest::onExit(void* parent)
@@ -83,15 +79,13 @@ int32_t mna::dhcp::OnRequest::receive(void* parent, const uint8_t* inPtr, uint32
   std::cout << "OnRequest::receive ---> " << "inLen " << inLen << std::endl;
   dhcpEntry *dEnt = reinterpret_cast<dhcpEntry*>(parent);
 
-  mna::dhcp::element_def_UMap_t::const_iterator it;
-  it = dEnt->m_elemDefUMap.find(mna::dhcp::MESSAGE_TYPE);
+  const mna::dhcp::options_t& opts = dEnt->options();
 
-  if(it != dEnt->m_elemDefUMap.end()) {
+  if(opts.has(mna::dhcp::MESSAGE_TYPE)) {
 
-    mna::dhcp::element_def_t elm = it->second;
     dEnt->buildAndSendResponse(inPtr, inLen);
 
-    switch(std::get<0>(elm.get_val())) {
+    switch(opts.message_type()) {
 
       case mna::dhcp::DISCOVER:
         std::cout << "OnRequest::DISCOVER " <<std::endl;
@@ -106,8 +100,9 @@ int32_t mna::dhcp::OnRequest::receive(void* parent, const uint8_t* inPtr, uint32
         break;
 
       case mna::dhcp::RELEASE:
-        /** move to Next State. */
-        dEnt->setState(OnDiscover::instance());
+      case mna::dhcp::DECLINE:
+        /* the entry is freed once the FSM is done with it. */
+        dEnt->release();
         break;
 
       case mna::dhcp::INFORM:
@@ -128,10 +123,9 @@ void mna::dhcp::OnRelease::onEntry(void* parent)
 {
   dhcpEntry *dEnt = reinterpret_cast<dhcpEntry*>(parent);
   std::cout << "5.OnRelease::onEntry is invoked & timer is started" << std::endl;
-  std::string data((const char* )dEnt->get_chaddr().data(), 6);
-  //dEnt->set_tid(dEnt->startTimer(/*dEnt->get_lease()*/1, (const void* )dEnt->get_chaddr().data()));
-  dEnt->set_tid(dEnt->startTimer(/*dEnt->get_lease()*/1, (const void* )data.c_str()));
-  //dEnt->set_tid(dEnt->startTimer(dEnt->get_lease(), (const void* )dEnt->get_chaddr().data()));
+  dEnt->set_tid(dEnt->startTimer(dEnt->get_lease_timer(), dEnt->get_token()));
+  /* ACK is sent, the binding has to survive a restart. */
+  dEnt->journal(mna::lease_record_t::BIND);
 }
 
 void mna::dhcp::OnRelease::onExit(void* parent)
@@ -146,15 +140,13 @@ int32_t mna::dhcp::OnRelease::receive(void* parent, const uint8_t* inPtr, uint32
   std::cout << "Onrelease::receive ---> " << inPtr << "inLen " << inLen << std::endl;
   dhcpEntry *dEnt = reinterpret_cast<dhcpEntry*>(parent);
 
-  mna::dhcp::element_def_UMap_t::const_iterator it;
-  it = dEnt->m_elemDefUMap.find(mna::dhcp::MESSAGE_TYPE);
+  const mna::dhcp::options_t& opts = dEnt->options();
 
-  if(it != dEnt->m_elemDefUMap.end()) {
+  if(opts.has(mna::dhcp::MESSAGE_TYPE)) {
 
-    mna::dhcp::element_def_t elm = it->second;
     dEnt->buildAndSendResponse(inPtr, inLen);
 
-    switch(std::get<0>(elm.get_val())) {
+    switch(opts.message_type()) {
 
       case mna::dhcp::DISCOVER:
         /** move to Next State. */
@@ -162,13 +154,20 @@ int32_t mna::dhcp::OnRelease::receive(void* parent, const uint8_t* inPtr, uint32
         break;
 
       case mna::dhcp::REQUEST:
-        /** move to Next State. */
-        dEnt->setState(OnRelease::instance());
+        /* Renewal of the lease, its timer is moved in place rather than stopped and started
+           again by re-entering the state. */
+        if(dEnt->resetTimer(dEnt->get_tid(), dEnt->get_lease_timer()) < 0) {
+          /** move to Next State. */
+          dEnt->setState(OnRelease::instance());
+        } else {
+          dEnt->journal(mna::lease_record_t::BIND);
+        }
         break;
 
       case mna::dhcp::RELEASE:
-        /** move to Next State. */
-        dEnt->setState(OnDiscover::instance());
+      case mna::dhcp::DECLINE:
+        /* the entry is freed once the FSM is done with it. */
+        dEnt->release();
         break;
 
       case mna::dhcp::INFORM:
@@ -201,15 +200,13 @@ int32_t mna::dhcp::OnInform::receive(void* parent, const uint8_t* inPtr, uint32_
   std::cout << "OnInform::receive ---> " << inPtr << "inLen " << inLen << std::endl;
   dhcpEntry *dEnt = reinterpret_cast<dhcpEntry*>(parent);
 
-  mna::dhcp::element_def_UMap_t::const_iterator it;
-  it = dEnt->m_elemDefUMap.find(mna::dhcp::MESSAGE_TYPE);
+  const mna::dhcp::options_t& opts = dEnt->options();
 
-  if(it != dEnt->m_elemDefUMap.end()) {
+  if(opts.has(mna::dhcp::MESSAGE_TYPE)) {
 
-    mna::dhcp::element_def_t elm = it->second;
     dEnt->buildAndSendResponse(inPtr, inLen);
 
-    switch(std::get<0>(elm.get_val())) {
+    switch(opts.message_type()) {
 
       case mna::dhcp::DISCOVER:
         /** move to Next State. */
@@ -222,8 +219,9 @@ int32_t mna::dhcp::OnInform::receive(void* parent, const uint8_t* inPtr, uint32_
         break;
 
       case mna::dhcp::RELEASE:
-        /** move to Next State. */
-        dEnt->setState(OnDiscover::instance());
+      case mna::dhcp::DECLINE:
+        /* the entry is freed once the FSM is done with it. */
+        dEnt->release();
         break;
 
       case mna::dhcp::INFORM:
@@ -239,20 +237,98 @@ int32_t mna::dhcp::OnInform::receive(void* parent, const uint8_t* inPtr, uint32_
   return(0);
 }
 
-long mna::dhcp::dhcpEntry::startTimer(uint32_t delay, const void* txn)
+mna::dhcp::dhcpEntry::~dhcpEntry()
 {
-  long tid = get_start_timer()(delay, txn, false);
+  /* counted out by server::free_entry, a retired entry is destroyed once no reader holds it. */
+  delete m_cold;
+}
+
+const mna::dhcp::options_t& mna::dhcp::dhcpEntry::options() const
+{
+  return(m_parent->options());
+}
+
+long mna::dhcp::dhcpEntry::startTimer(uint32_t delay, timer_token_t token)
+{
+  long tid = m_parent->start_timer(delay, token);
   return(tid);
 }
 
 void mna::dhcp::dhcpEntry::stopTimer(long tid)
 {
-  get_stop_timer()(tid);
+  m_parent->stop_timer(tid);
+}
+
+void mna::dhcp::dhcpEntry::journal(uint8_t type)
+{
+  bool bound = (mna::lease_record_t::BIND == type);
+
+  if(!bound && !m_bound) {
+    /* an offer never made it to the journal, nothing to undo. */
+    return;
+  }
+
+  if(bound != m_bound) {
+    m_parent->count_bound(bound ? 1 : -1);
+  }
+
+  __atomic_store_n(&m_bound, bound, __ATOMIC_RELAXED);
+  set_expiry(bound ? static_cast<uint32_t>((mna::clock_ns() / 1000000000ULL) + get_lease_timer()) : 0);
+  m_parent->journal(*this, type);
+}
+
+void mna::dhcp::dhcpEntry::release()
+{
+  m_parent->release(this);
+}
+
+int32_t mna::dhcp::dhcpEntry::resetTimer(long tid, uint32_t delay)
+{
+  return(m_parent->reset_timer(tid, delay));
+}
+
+void mna::dhcp::dhcpEntry::update_cold(const options_t& opts)
+{
+  uint8_t hostLen = 0;
+  uint8_t idLen = 0;
+  const uint8_t* host = opts.get(mna::dhcp::HOST_NAME, hostLen);
+  const uint8_t* id = opts.get(mna::dhcp::CLIENT_IDENTIFIER, idLen);
+
+  lease_cold_t* cold = nullptr;
+
+  if(!host && !id) {
+    return;
+  }
+
+  if(m_cold && (!host || m_cold->m_hostName.compare(0, std::string::npos, reinterpret_cast<const char*>(host), hostLen) == 0) &&
+     (!id || m_cold->m_clientId.compare(0, std::string::npos, reinterpret_cast<const char*>(id), idLen) == 0)) {
+    /* a client sends the same values upon every request. */
+    return;
+  }
+
+  cold = m_cold ? new lease_cold_t(*m_cold) : new lease_cold_t();
+
+  if(host) {
+    cold->m_hostName.assign(reinterpret_cast<const char*>(host), hostLen);
+  }
+
+  if(id) {
+    cold->m_clientId.assign(reinterpret_cast<const char*>(id), idLen);
+  }
+
+  if(!m_cold) {
+    m_parent->count_cold(1);
+  } else {
+    m_parent->retire_cold(m_cold);
+  }
+
+  /* the copy is complete before a reader may find it. */
+  __atomic_store_n(&m_cold, cold, __ATOMIC_RELEASE);
 }
 
 int32_t mna::dhcp::dhcpEntry::tx(uint8_t* out, uint32_t outLen)
 {
-  return(0);
+  return(m_parent->tx(out, outLen));
 }
 
 /**
@@ -266,9 +342,18 @@ int32_t mna::dhcp::dhcpEntry::buildAndSendResponse(const uint8_t* in, uint32_t i
 {
   (void)inLen;
   uint32_t offset = 0;
-  uint8_t rsp[1024];
+  uint32_t capacity = 0;
+  /* The response is encoded in place in the buffer handed out by lower layer. */
+  uint8_t* rsp = m_parent->tx_buffer(capacity);
 
-  mna::dhcp::element_def_t elm;
+  if(!rsp || capacity < SIZE_RESPONSE) {
+    std::cout << "No buffer available for response " << std::endl;
+    return(-1);
+  }
+
+  const mna::dhcp::options_t& opts = options();
+  const uint8_t* params = nullptr;
+  uint8_t paramLen = 0;
   uint8_t cookie[] = {0x63, 0x82, 0x53, 0x63};
   mna::dhcp::dhcp_t *out = (mna::dhcp::dhcp_t* )rsp;
   mna::dhcp::dhcp_t *req = (mna::dhcp::dhcp_t* )in;
@@ -296,12 +381,8 @@ int32_t mna::dhcp::dhcpEntry::buildAndSendResponse(const uint8_t* in, uint32_t i
   std::memcpy((void *)&rsp[offset], cookie, sizeof(cookie));
   offset += sizeof(cookie);
 
-  element_def_UMap_t::const_iterator it;
-  it = m_elemDefUMap.find(mna::dhcp::MESSAGE_TYPE);
-
-  if(it != m_elemDefUMap.end()) {
-    elm = it->second;
-    switch(std::get<0>(elm.get_val())) {
+  if(opts.has(mna::dhcp::MESSAGE_TYPE)) {
+    switch(opts.message_type()) {
 
       case mna::dhcp::DISCOVER:
         rsp[offset++] = mna::dhcp::MESSAGE_TYPE;
@@ -332,14 +413,13 @@ int32_t mna::dhcp::dhcpEntry::buildAndSendResponse(const uint8_t* in, uint32_t i
   }
 
   /*Parameter list.*/
-  it = m_elemDefUMap.find(mna::dhcp::PARAMETER_REQUEST_LIST);
-  if(it != m_elemDefUMap.end()) {
+  params = opts.get(mna::dhcp::PARAMETER_REQUEST_LIST, paramLen);
+  if(params) {
 
     uint32_t idx = 0;
-    elm = it->second;
-    for(idx = 0; idx < elm.get_len(); idx++) {
+    for(idx = 0; idx < paramLen; idx++) {
 
-      switch(elm.get_val()[idx]) {
+      switch(params[idx]) {
 
         case mna::dhcp::SUBNET_MASK:
           rsp[offset++] = mna::dhcp::SUBNET_MASK;
@@ -365,7 +445,7 @@ int32_t mna::dhcp::dhcpEntry::buildAndSendResponse(const uint8_t* in, uint32_t i
         case mna::dhcp::DNS:
           rsp[offset++] = mna::dhcp::DNS;
           rsp[offset++] = 4;
-          *((uint32_t*)&rsp[offset]) = htonl(m_dnsIP);
+          *((uint32_t*)&rsp[offset]) = htonl(m_parent->get_dns_ip());
           offset += 4;
           break;
 
@@ -378,27 +458,27 @@ int32_t mna::dhcp::dhcpEntry::buildAndSendResponse(const uint8_t* in, uint32_t i
 
         case mna::dhcp::HOST_NAME:
           rsp[offset++] = mna::dhcp::HOST_NAME;
-          rsp[offset++] = m_hostName.length();
+          rsp[offset++] = m_parent->get_host_name().length();
           /*Host Machine Name to be updated.*/;
-          std::memcpy((void *)&rsp[offset], m_hostName.c_str(),
-                       m_hostName.length());
-          offset += m_hostName.length();
+          std::memcpy((void *)&rsp[offset], m_parent->get_host_name().c_str(),
+                       m_parent->get_host_name().length());
+          offset += m_parent->get_host_name().length();
           break;
 
         case mna::dhcp::DOMAIN_NAME:
           rsp[offset++] = mna::dhcp::DOMAIN_NAME;
-          rsp[offset++] = m_domainName.length();
+          rsp[offset++] = m_parent->get_domain_name().length();
           /*Host Machine Name to be updated.*/;
-          std::memcpy((void *)&rsp[offset], m_domainName.c_str(),
-                      m_domainName.length());
-          offset += m_domainName.length();
+          std::memcpy((void *)&rsp[offset], m_parent->get_domain_name().c_str(),
+                      m_parent->get_domain_name().length());
+          offset += m_parent->get_domain_name().length();
           break;
 
         case mna::dhcp::MTU:
           rsp[offset++] = mna::dhcp::MTU;
           rsp[offset++] = 2;
           /*Host Machine Name to be updated.*/;
-          *((uint16_t*)&rsp[offset]) = htons(m_mtu);
+          *((uint16_t*)&rsp[offset]) = htons(m_parent->get_mtu());
           offset += 2;
           break;
 
@@ -446,7 +526,7 @@ int32_t mna::dhcp::dhcpEntry::buildAndSendResponse(const uint8_t* in, uint32_t i
           rsp[offset++] = mna::dhcp::IP_LEASE_TIME;
           rsp[offset++] = 4;
           /*Host Machine Name to be updated.*/;
-          *((uint32_t*)&rsp[offset]) = htonl(m_lease);
+          *((uint32_t*)&rsp[offset]) = htonl(m_parent->get_lease());
           offset += 4;
           break;
 
@@ -462,7 +542,7 @@ int32_t mna::dhcp::dhcpEntry::buildAndSendResponse(const uint8_t* in, uint32_t i
           rsp[offset++] = mna::dhcp::SERVER_IDENTIFIER;
           rsp[offset++] = 4;
           /*Host Machine Name to be updated.*/;
-          *((uint32_t*)&rsp[offset]) = htonl(m_serverID);
+          *((uint32_t*)&rsp[offset]) = htonl(m_parent->get_server_id());
           offset += 4;
           break;
 
@@ -474,17 +554,17 @@ int32_t mna::dhcp::dhcpEntry::buildAndSendResponse(const uint8_t* in, uint32_t i
 
   rsp[offset++] = mna::dhcp::IP_LEASE_TIME;
   rsp[offset++] = 4;
-  *((uint32_t*)&rsp[offset]) = htonl(m_lease);
+  *((uint32_t*)&rsp[offset]) = htonl(m_parent->get_lease());
   offset += 4;
 
   rsp[offset++] = mna::dhcp::MTU;
   rsp[offset++] = 2;
-  *((uint32_t*)&rsp[offset]) = htons(m_mtu);
+  *((uint32_t*)&rsp[offset]) = htons(m_parent->get_mtu());
   offset += 2;
 
   rsp[offset++] = mna::dhcp::SERVER_IDENTIFIER;
   rsp[offset++] = 4;
-  *((uint32_t*)&rsp[offset]) = htonl(m_serverID);
+  *((uint32_t*)&rsp[offset]) = htonl(m_parent->get_server_id());
   offset += 4;
 
   rsp[offset++] = mna::dhcp::END;
@@ -493,66 +573,39 @@ int32_t mna::dhcp::dhcpEntry::buildAndSendResponse(const uint8_t* in, uint32_t i
 }
 
 /**
- * @brief This member function parses the DHCP OPTION followed by DHCP Header and stores
- *        them into unordered_map based on tag. tag will be the KEY and value
- *        is the instance of element_def_t.
+ * @brief This member function indexes the DHCP OPTION followed by DHCP Header by tag, the
+ *        value of every option stays where it is in the request.
  * @param pointer to the dhcp option
  * @param length of dhcp option data
- * @return upon sucess 0 else < 0.
+ * @return none
  * */
-int32_t mna::dhcp::dhcpEntry::parseOptions(const uint8_t* in, uint32_t inLen)
+void mna::dhcp::options_t::parse(const uint8_t* in, uint32_t inLen)
 {
   uint32_t offset = 0;
 
-  while(inLen > 0) {
+  m_base = in;
+  m_at.fill(0);
 
-    switch(in[offset]) {
+  while(offset < inLen && mna::dhcp::END != in[offset]) {
 
-      case mna::dhcp::END:
-        inLen = 0;
-        break;
-
-      default:
-        mna::dhcp::element_def_t elm;
-        uint8_t tag = in[offset];
-
-        element_def_UMap_t::const_iterator it;
-        it = m_elemDefUMap.find(tag);
-
-        if(it != m_elemDefUMap.end()) {
-
-          std::cout << "Option's entry found in the map " << std::endl;
-          /*Found in the Map , Update with new contents received now.*/
-          elm = it->second;
-          elm.set_tag(in[offset++]);
-          elm.set_len(in[offset++]);
-          std::memcpy(elm.m_val.data(), &in[offset], elm.get_len());
-          offset += elm.get_len();
-
-          /*Update the MAP now.*/
-          m_elemDefUMap[tag] = elm;
-
-        } else {
-
-          std::cout << "Option's entry not found in the map " << std::endl;
-          /*Not found in the MAP.*/
-          elm.set_tag(in[offset++]);
-          elm.set_len(in[offset++]);
-          std::memcpy(elm.m_val.data(), &in[offset], elm.get_len());
-          offset += elm.get_len();
-          /*Add it into MAP now.*/
-          m_elemDefUMap.insert(std::pair<uint8_t, element_def_t>(tag, elm));
+    if(mna::dhcp::PADD == in[offset]) {
+      ++offset;
+      continue;
+    }
 
-        }
+    if((offset + 2) > inLen || (offset + 2 + in[offset + 1]) > inLen) {
+      /* truncated option, what follows cannot be trusted. */
+      break;
     }
+
+    m_at[in[offset]] = static_cast<uint16_t>(offset + 1);
+    offset += 2 + in[offset + 1];
   }
-  return(0);
 }
 
 /**
- * @brief This member function gets dhcp packet and parses DHCP Option
- *        and stores them into unordered_map and then feed the request
- *        to FSM for further processing.
+ * @brief This member function gets dhcp packet whose DHCP Option are parsed by server
+ *        and feeds the request to FSM for further processing.
  * @param dhcp packet
  * @param length of dhcp packet
  * @return upon success 0 else < 0.
@@ -561,79 +614,331 @@ int32_t mna::dhcp::dhcpEntry::rx(const uint8_t* in, uint32_t inLen)
 {
 
   mna::dhcp::dhcp_t *req = (mna::dhcp::dhcp_t* )in;
-  size_t cookie_len = 4;
-  uint8_t *opt = (uint8_t *)&in[sizeof(mna::dhcp::dhcp_t) + cookie_len];
-
-  parseOptions(opt, (inLen - (sizeof(mna::dhcp::dhcp_t) + cookie_len)));
 
+  update_cold(options());
   m_xid = req->xid;
-  std::memcpy(m_chaddr.data(), req->chaddr, req->hlen);
+  std::memcpy(m_chaddr.data(), req->chaddr, m_chaddr.size());
 
   /** Feed to FSM now to process respective request. */
-  return(getState().rx(in, inLen));
+  return(m_fsm.rx(this, in, inLen));
 
 }
 
 int32_t mna::dhcp::server::rx(const uint8_t* in, uint32_t inLen)
 {
   std::cout << "1.server::rx received REQ " <<std::endl;
-  dhcp_entry_onMAC_t::const_iterator it;
   dhcpEntry* dEnt = nullptr;
+  uint32_t slot = mna::mac_index::NIL;
+  const uint8_t *clientMAC = nullptr;
+  uint64_t MAC = 0;
+  uint8_t type = 0;
+  size_t cookie_len = 4;
 
-  const uint8_t *clientMAC = ((dhcp_t *)in)->chaddr;
-  uint8_t len = ((dhcp_t *)in)->hlen;
+  /* a runt frame is dropped before any field of the header is read. */
+  if(inLen < (sizeof(dhcp_t) + cookie_len)) {
+    return(-1);
+  }
 
-  std::string MAC = std::string((const char *)clientMAC, len);
+  clientMAC = ((const dhcp_t *)in)->chaddr;
+  MAC = mna::mac_index::key_of(clientMAC);
+
+  /* options are indexed once, every state of the entry reads them from here. */
+  m_options.parse(&in[sizeof(dhcp_t) + cookie_len], (inLen - (sizeof(dhcp_t) + cookie_len)));
+  type = m_options.message_type();
+
+  if(mna::dhcp::RELEASE == type || mna::dhcp::DECLINE == type) {
+    /* the address given up is looked up, ciaddr of a RELEASE and requested address of a
+       DECLINE, and a client may give up only an address it holds itself. */
+    uint32_t clientIP = 0;
+    uint8_t len = 0;
+    const uint8_t* requested = m_options.get(mna::dhcp::REQUESTED_IP_ADDRESS, len);
+
+    if(mna::dhcp::RELEASE == type) {
+      clientIP = ntohl(((const dhcp_t *)in)->ciaddr);
+    } else if(requested && len == sizeof(clientIP)) {
+      std::memcpy(&clientIP, requested, sizeof(clientIP));
+      clientIP = ntohl(clientIP);
+    }
+
+    dEnt = find_by_ip(clientIP);
 
-  it = m_dhcpUmapOnMAC.find(MAC);
+    if(!dEnt || std::memcmp(dEnt->get_chaddr().data(), clientMAC, dEnt->get_chaddr().size())) {
+      std::cout << "Address given up is not held by client, request is dropped " << std::endl;
+      return(-1);
+    }
 
-  if(it != m_dhcpUmapOnMAC.end()) {
+  } else if((slot = m_dhcpIndexOnMAC.find(MAC)) != mna::mac_index::NIL) {
 
     std::cout << "2.dhcpEntry Instance is found " << std::endl;
     /* DHCP Client Entry is found. */
-    dEnt = it->second;
+    dEnt = m_entries.at(slot);
 
   } else {
 
+    /* only a DISCOVER or a REQUEST moves a new entry to a state whose timer frees it again,
+       an entry made for any other message would hold its address until restart. */
+    if(!m_options.has(mna::dhcp::MESSAGE_TYPE) ||
+       (mna::dhcp::DISCOVER != m_options.message_type() && mna::dhcp::REQUEST != m_options.message_type())) {
+      std::cout << "Request of unknown client is dropped " << std::endl;
+      return(-1);
+    }
+
+    /* New DHCP Client Request, an address is taken from the pool for it. */
+    uint32_t clientIP = m_pool.allocate(clientMAC);
+
+    if(!clientIP) {
+      std::cout << "Pool is exhausted, request is dropped " << std::endl;
+      return(-1);
+    }
+
     std::cout << "2.dhcpEntry instantiated " << std::endl;
-    /* New DHCP Client Request, create an entry for it. */
-    dEnt = new dhcpEntry(this, 123, m_routerIP, m_dnsIP, m_lease, m_mtu, m_serverID, m_domainName);
+    /* create an entry for it. */
+    if(!(dEnt = new_entry(clientIP))) {
+      std::cout << "Allocation of dhcpEntry failed, request is dropped " << std::endl;
+      m_pool.release(clientIP);
+      return(-1);
+    }
 
-    /*insert into unordered_map now.*/
-    bool ret = m_dhcpUmapOnMAC.insert(std::pair<std::string, dhcpEntry*>(MAC, dEnt)).second;
+    /* readers of other threads may find it by address as soon as it is indexed. */
+    dEnt->set_chaddr(clientMAC);
 
-    if(!ret) {
+    /*insert into the index now.*/
+    if(index(dEnt, MAC) < 0) {
       std::cout << "Insertion of dhcpEntry failed " << std::endl;
+      free_entry(dEnt->get_token().m_slot);
+      m_pool.release(clientIP);
+      return(-1);
     }
 
-    dEnt->set_start_timer(m_start_timer);
-    dEnt->set_stop_timer(m_stop_timer);
-    dEnt->set_reset_timer(m_reset_timer);
-
   }
 
   /* Feed to FSM now. */
   dEnt->rx(in, inLen);
+
+  if(m_released) {
+    /* freed only now that its FSM has returned, the entry was released from within it. */
+    dEnt = m_released;
+    m_released = nullptr;
+    /* a declined address is in use by a host unknown to server, it is kept out of the pool
+       until restart. */
+    drop(dEnt, mna::lease_record_t::RELEASE, mna::dhcp::DECLINE != type);
+  }
+
   return(0);
 
 }
 
+/**
+ * @brief This member function hands the encoded response to lower layer.
+ * @param pointer to dhcp response
+ * @param length of dhcp response
+ * @return upon success 0 else < 0.
+ * */
+int32_t mna::dhcp::server::tx(uint8_t* out, uint32_t outLen)
+{
+  if(!m_downstream) {
+    return(-1);
+  }
+
+  return(m_downstream(out, outLen));
+}
+
 long mna::dhcp::server::timedOut(const void* txn)
 {
   std::cout << "timedOut is invoked " << std::endl;
-  dhcp_entry_onMAC_t::const_iterator it;
-  const uint8_t *clientMAC = reinterpret_cast<const uint8_t *>(txn);
-  std::string MAC = std::string((const char *)clientMAC, 6);
-  it = m_dhcpUmapOnMAC.find(MAC);
+  mna::timer_token_t token = mna::timer_token_t::from_act(txn);
+  mna::dhcp::dhcpEntry *dEnt = resolve(token);
 
-  if(it != m_dhcpUmapOnMAC.end()) {
-    mna::dhcp::dhcpEntry *dEnt = it->second;
-    delete dEnt;
+  if(!dEnt) {
+    /* entry of this timer is gone and its slot may already serve another client. */
+    return(-1);
   }
 
+  drop(dEnt, mna::lease_record_t::EXPIRE, true);
   return(0);
 }
 
+void mna::dhcp::server::drop(dhcpEntry* dEnt, uint8_t type, bool toPool)
+{
+  /* the timer which fired is stale already, one still armed would fire for nothing. */
+  stop_timer(dEnt->get_tid());
+  dEnt->journal(type);
+  unindex(dEnt);
+
+  if(toPool) {
+    m_pool.release(dEnt->get_client_ip());
+  }
+
+  /* timers still armed for the slot resolve to nothing from now on. */
+  free_entry(dEnt->get_token().m_slot);
+}
+
+void mna::dhcp::server::journal(const dhcpEntry& dEnt, uint8_t type)
+{
+  if(m_restoring || !m_journal) {
+    return;
+  }
+
+  m_journal(type, dEnt.get_chaddr().data(), dEnt.get_client_ip(), dEnt.get_lease_timer());
+}
+
+int32_t mna::dhcp::server::restore(const uint8_t* chaddr, uint32_t ip, uint32_t remaining)
+{
+  dhcpEntry* dEnt = nullptr;
+  uint64_t MAC = mna::mac_index::key_of(chaddr);
+
+  if(m_dhcpIndexOnMAC.find(MAC) != mna::mac_index::NIL || m_pool.claim(chaddr, ip) < 0) {
+    return(-1);
+  }
+
+  if(!(dEnt = new_entry(ip))) {
+    m_pool.release(ip);
+    return(-1);
+  }
+
+  dEnt->set_chaddr(chaddr);
+
+  if(index(dEnt, MAC) < 0) {
+    free_entry(dEnt->get_token().m_slot);
+    m_pool.release(ip);
+    return(-1);
+  }
+
+  /* entering the bound state arms the lease timer, which is then cut to what is left. */
+  m_restoring = true;
+  dEnt->setState(OnRelease::instance());
+  m_restoring = false;
+  dEnt->resetTimer(dEnt->get_tid(), remaining);
+  dEnt->set_expiry(static_cast<uint32_t>((mna::clock_ns() / 1000000000ULL) + remaining));
+
+  return(0);
+}
+
+mna::dhcp::lease_stats_t mna::dhcp::server::stats() const
+{
+  lease_stats_t st;
+
+  st.m_leases = m_entries.size();
+  st.m_bound = m_bound_count;
+  st.m_cold = m_cold_count;
+  st.m_bytes = m_entries.stats().m_bytes + (st.m_cold * sizeof(lease_cold_t)) +
+               m_dhcpIndexOnMAC.bytes() + m_dhcpIndexOnIP.bytes() + m_pool.bytes();
+
+  return(st);
+}
+
+mna::dhcp::dhcpEntry* mna::dhcp::server::new_entry(uint32_t clientIP)
+{
+  mna::timer_token_t token;
+  dhcpEntry* dEnt = nullptr;
+
+  token.m_slot = m_entries.alloc(this, clientIP);
+
+  if(slab<dhcpEntry>::NIL == token.m_slot) {
+    return(nullptr);
+  }
+
+  token.m_gen = m_entries.gen(token.m_slot);
+  dEnt = m_entries.at(token.m_slot);
+  dEnt->set_token(token);
+  publish();
+
+  return(dEnt);
+}
+
+void mna::dhcp::server::free_entry(uint32_t slot)
+{
+  const dhcpEntry* dEnt = m_entries.at(slot);
+
+  /* counted out now rather than when a reader lets go of it. */
+  if(dEnt->get_cold()) {
+    --m_cold_count;
+  }
+
+  if(dEnt->is_bound()) {
+    --m_bound_count;
+  }
+
+  m_entries.retire(slot, m_limbo);
+  publish();
+}
+
+bool mna::dhcp::server::read_slot(uint32_t slot, lease_view_t& view) const
+{
+  uint32_t gen = m_entries.read_gen(slot);
+  const dhcpEntry* dEnt = nullptr;
+  const lease_cold_t* cold = nullptr;
+
+  if(!(gen & 1)) {
+    return(false);
+  }
+
+  dEnt = m_entries.at(slot);
+  view.m_ip = dEnt->get_client_ip();
+  view.m_expiry = dEnt->get_expiry();
+  view.m_chaddr = dEnt->get_chaddr();
+  view.m_bound = dEnt->is_bound();
+
+  if((cold = dEnt->get_cold())) {
+    view.m_hostName = cold->m_hostName;
+    view.m_clientId = cold->m_clientId;
+  } else {
+    view.m_hostName.clear();
+    view.m_clientId.clear();
+  }
+
+  /* the copy is taken before the generation is read again, a changed one means it is torn. */
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return(m_entries.read_gen(slot) == gen);
+}
+
+bool mna::dhcp::server::read_by_mac(const uint8_t* chaddr, lease_view_t& view) const
+{
+  epoch::guard guard;
+  uint32_t slot = mna::mac_index::NIL;
+
+  if(!guard || (slot = m_dhcpIndexOnMAC.find(mna::mac_index::key_of(chaddr))) == mna::mac_index::NIL) {
+    return(false);
+  }
+
+  /* the slot may have been handed to another client since it was looked up. */
+  return(read_slot(slot, view) && !std::memcmp(view.m_chaddr.data(), chaddr, view.m_chaddr.size()));
+}
+
+bool mna::dhcp::server::read_by_ip(uint32_t ip, lease_view_t& view) const
+{
+  epoch::guard guard;
+  uint32_t slot = mna::ip_index::NIL;
+
+  if(!guard || (slot = m_dhcpIndexOnIP.find(ip)) == mna::ip_index::NIL) {
+    return(false);
+  }
+
+  return(read_slot(slot, view) && view.m_ip == ip);
+}
+
+int32_t mna::dhcp::server::index(dhcpEntry* dEnt, uint64_t MAC)
+{
+  uint32_t slot = dEnt->get_token().m_slot;
+
+  if(m_dhcpIndexOnMAC.insert(MAC, slot) < 0) {
+    return(-1);
+  }
+
+  if(m_dhcpIndexOnIP.insert(dEnt->get_client_ip(), slot) < 0) {
+    m_dhcpIndexOnMAC.erase(MAC);
+    return(-1);
+  }
+
+  return(0);
+}
+
+void mna::dhcp::server::unindex(const dhcpEntry* dEnt)
+{
+  m_dhcpIndexOnMAC.erase(mna::mac_index::key_of(dEnt->get_chaddr().data()));
+  m_dhcpIndexOnIP.erase(dEnt->get_client_ip());
+}
+
 /**
  * @brief
  * @param
@@ -644,6 +949,10 @@ int32_t mna::eth::ether::rx(const uint8_t* in, uint32_t inLen)
 {
   mna::eth::ETH* pET = (mna::eth::ETH* )in;
 
+  if(inLen < sizeof(mna::eth::ETH)) {
+    return(-1);
+  }
+
   std::copy(std::begin(pET->src), std::end(pET->src), std::begin(m_src_mac));
   std::copy(std::begin(pET->dest), std::end(pET->dest), std::begin(m_dst_mac));
 
@@ -651,12 +960,39 @@ int32_t mna::eth::ether::rx(const uint8_t* in, uint32_t inLen)
   return(m_upstream(&in[sizeof(mna::eth::ETH)], (inLen - sizeof(mna::eth::ETH))));
 }
 
+/**
+ * @brief This member function prepends the ethernet header in front of payload and hands
+ *        the frame to middleware. The reply is sent to the MAC from which request came.
+ * @param pointer to payload, headroom for ethernet header must be available in front of it.
+ * @param length of payload
+ * @return upon success 0 else < 0.
+ * */
+int32_t mna::eth::ether::tx(uint8_t* out, uint32_t outLen)
+{
+  mna::eth::ETH* pET = (mna::eth::ETH* )(out - sizeof(mna::eth::ETH));
+
+  if(!m_downstream) {
+    return(-1);
+  }
+
+  std::copy(std::begin(m_src_mac), std::end(m_src_mac), std::begin(pET->dest));
+  std::copy(std::begin(m_intf_mac), std::end(m_intf_mac), std::begin(pET->src));
+  pET->proto = htons(mna::eth::IPv4);
+
+  return(m_downstream((uint8_t* )pET, (outLen + sizeof(mna::eth::ETH))));
+}
+
 int32_t mna::ipv4::ip::rx(const uint8_t* in, uint32_t inLen)
 {
   mna::ipv4::IP* pIP = (mna::ipv4::IP* )in;
 
   /*IP header length in 32 bit word. minimum value is (5 * 4) */
-  uint32_t len = pIP->len * 4;
+  uint32_t len = 0;
+
+  if(inLen < sizeof(mna::ipv4::IP) || (len = pIP->len * 4) < sizeof(mna::ipv4::IP) || inLen < len) {
+    return(-1);
+  }
+
   src_ip(pIP->src_ip);
   dst_ip(pIP->dest_ip);
 
@@ -664,6 +1000,37 @@ int32_t mna::ipv4::ip::rx(const uint8_t* in, uint32_t inLen)
   return(m_upstream(&in[len], (inLen - len)));
 }
 
+/**
+ * @brief This member function prepends the IP header in front of payload. A request from a
+ *        client which has no address yet is answered with limited broadcast.
+ * @param pointer to payload, headroom for IP header must be available in front of it.
+ * @param length of payload
+ * @return upon success 0 else < 0.
+ * */
+int32_t mna::ipv4::ip::tx(uint8_t* out, uint32_t outLen)
+{
+  mna::ipv4::IP* pIP = (mna::ipv4::IP* )(out - sizeof(mna::ipv4::IP));
+
+  if(!m_downstream) {
+    return(-1);
+  }
+
+  pIP->len = sizeof(mna::ipv4::IP) / 4;
+  pIP->ver = 4;
+  pIP->tos = 0;
+  pIP->tot_len = htons(outLen + sizeof(mna::ipv4::IP));
+  pIP->id = 0;
+  pIP->flags = 0;
+  pIP->ttl = 64;
+  pIP->proto = mna::ipv4::UDP;
+  pIP->chksum = 0;
+  pIP->src_ip = m_local_ip;
+  pIP->dest_ip = m_src_ip ? m_src_ip : 0xFFFFFFFF;
+  pIP->chksum = checksum((const uint16_t* )(out - sizeof(mna::ipv4::IP)), sizeof(mna::ipv4::IP));
+
+  return(m_downstream((uint8_t* )pIP, (outLen + sizeof(mna::ipv4::IP))));
+}
+
 uint16_t mna::ipv4::ip::checksum(const uint16_t* in, size_t inLen) const
 {
   uint32_t sum = 0;
@@ -695,6 +1062,11 @@ uint16_t mna::ipv4::ip::checksum(const uint16_t* in, size_t inLen) const
 int32_t mna::transport::udp::rx(const uint8_t* in, uint32_t inLen)
 {
   mna::transport::UDP* pUDP = (mna::transport::UDP* )in;
+
+  if(inLen < sizeof(mna::transport::UDP)) {
+    return(-1);
+  }
+
   src_port(pUDP->src_port);
   dst_port(pUDP->dest_port);
 
@@ -702,21 +1074,51 @@ int32_t mna::transport::udp::rx(const uint8_t* in, uint32_t inLen)
   return(m_upstream(&in[sizeof(mna::transport::UDP)], (inLen - sizeof(mna::transport::UDP))));
 }
 
+/**
+ * @brief This member function prepends the UDP header in front of payload, the ports of the
+ *        request are swapped so that reply goes back to the originator (client or relay).
+ * @param pointer to payload, headroom for UDP header must be available in front of it.
+ * @param length of payload
+ * @return upon success 0 else < 0.
+ * */
+int32_t mna::transport::udp::tx(uint8_t* out, uint32_t outLen)
+{
+  mna::transport::UDP* pUDP = (mna::transport::UDP* )(out - sizeof(mna::transport::UDP));
+
+  if(!m_downstream) {
+    return(-1);
+  }
+
+  pUDP->src_port = m_dst_port;
+  pUDP->dest_port = m_src_port;
+  pUDP->len = htons(outLen + sizeof(mna::transport::UDP));
+  /*checksum is optional for UDP over IPv4.*/
+  pUDP->chksum = 0;
+
+  return(m_downstream((uint8_t* )pUDP, (outLen + sizeof(mna::transport::UDP))));
+}
+
 uint16_t mna::transport::udp::build_pseudo(uint8_t* in) const
 {
   uint8_t* pseudoPtr = nullptr;
   size_t ipHdrLen = 0;
-  size_t tmpLen = 0;
+  size_t udpLen = 0;
   size_t offset = 0;
   uint16_t chksum = 0;
   mna::ipv4::IP* ip = (mna::ipv4::IP* )in;
 
   ipHdrLen = (ip->len * 4);
-  /*Removing IP Header size and adding UDP PSEUDO Header in size.*/
-  tmpLen = (ntohs(ip->tot_len) - ipHdrLen) + sizeof(mna::transport::PHDR);
-  pseudoPtr = new uint8_t[tmpLen];
+  udpLen = ntohs(ip->tot_len) - ipHdrLen;
+
+  /*UDP PSEUDO Header followed by UDP Header and Payload must fit in one pool buffer.*/
+  if((udpLen + sizeof(mna::transport::PHDR)) > mna::pkt_pool::BUFFER_SIZE) {
+    return(0);
+  }
 
-  std::memset((void *)pseudoPtr, 0, tmpLen);
+  /*A checksum of 0 means no checksum for UDP over IPv4.*/
+  if(!(pseudoPtr = mna::pkt_pool::instance().alloc())) {
+    return(0);
+  }
 
   /*pseudo Header for UDP - to compute checksum*/
   *((uint32_t *)&pseudoPtr[offset]) = ip->src_ip;
@@ -732,18 +1134,15 @@ uint16_t mna::transport::udp::build_pseudo(uint8_t* in) const
   pseudoPtr[offset] = mna::ipv4::UDP;
   offset += 1;
   /*length of UDP Header + Payload.*/
-  pseudoPtr[offset] = htons(ntohs(ip->tot_len) - ipHdrLen);
+  *((uint16_t *)&pseudoPtr[offset]) = htons(udpLen);
   offset += 2;
 
-  std::memcpy((void *)&pseudoPtr[offset],
-              (const void *)&ip[ipHdrLen],
-              (ntohs(ip->tot_len) - ipHdrLen));
-
-  offset += ntohs(ip->tot_len) - ipHdrLen;
+  std::memcpy((void *)&pseudoPtr[offset], (const void *)&in[ipHdrLen], udpLen);
+  offset += udpLen;
 
   chksum = checksum((uint16_t*)pseudoPtr, offset);
 
-  delete []pseudoPtr;
+  mna::pkt_pool::instance().free(pseudoPtr);
   return(chksum);
 }
 
@@ -0,0 +1,283 @@
+#ifndef __RING_CC__
+#define __RING_CC__
+
+#include <cerrno>
+#include <cstring>
+
+#include "ace/Log_Msg.h"
+#include "ace/OS_NS_sys_socket.h"
+#include "ace/OS_NS_sys_time.h"
+
+#include "ring.h"
+
+int32_t mna::rx_ring::setup(ACE_HANDLE handle, uint32_t blockSize, uint32_t blockCount,
+                            uint32_t frameSize, uint32_t timeoutMs)
+{
+  int32_t version = TPACKET_V3;
+  int32_t retStatus = -1;
+  struct tpacket_req3 req;
+
+  do {
+
+    if(!blockSize || !blockCount || !frameSize || (blockSize % frameSize)) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Invalid RX ring geometry block %u frame %u\n"),
+                 blockSize, frameSize));
+      break;
+    }
+
+    if(ACE_OS::setsockopt(handle, SOL_PACKET, PACKET_VERSION, (const char *)&version, sizeof(version)) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Setting TPACKET_V3 failed for handle %d\n"), handle));
+      break;
+    }
+
+    std::memset((void *)&req, 0, sizeof(req));
+    req.tp_block_size = blockSize;
+    req.tp_block_nr = blockCount;
+    req.tp_frame_size = frameSize;
+    req.tp_frame_nr = (blockSize / frameSize) * blockCount;
+    req.tp_retire_blk_tov = timeoutMs;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+
+    if(ACE_OS::setsockopt(handle, SOL_PACKET, PACKET_RX_RING, (const char *)&req, sizeof(req)) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l PACKET_RX_RING failed for handle %d\n"), handle));
+      break;
+    }
+
+    m_block_size = blockSize;
+    m_block_count = blockCount;
+    m_frame_size = frameSize;
+    retStatus = 0;
+
+  } while(0);
+
+  return(retStatus);
+}
+
+int32_t mna::rx_ring::release(ACE_HANDLE handle)
+{
+  struct tpacket_req3 req;
+
+  /* a ring of no block tears down the one in place. */
+  std::memset((void *)&req, 0, sizeof(req));
+  m_base = nullptr;
+  m_block_size = 0;
+  m_block_count = 0;
+  m_frame_size = 0;
+
+  if(ACE_OS::setsockopt(handle, SOL_PACKET, PACKET_RX_RING, (const char *)&req, sizeof(req)) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Releasing PACKET_RX_RING failed for handle %d\n"), handle));
+    return(-1);
+  }
+
+  return(0);
+}
+
+uint32_t mna::rx_ring::poll(frame_delegate_t upstream)
+{
+  uint32_t frames = 0;
+
+  if(!m_base) {
+    return(0);
+  }
+
+  ++m_stats.m_wakeups;
+
+  while(1) {
+
+    struct tpacket_block_desc* pbd =
+      reinterpret_cast<struct tpacket_block_desc*>(m_base + (static_cast<size_t>(m_current) * m_block_size));
+
+    if(!(__atomic_load_n(&pbd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+      /*Next block is still owned by kernel.*/
+      break;
+    }
+
+    uint32_t count = pbd->hdr.bh1.num_pkts;
+    uint8_t* ptr = reinterpret_cast<uint8_t*>(pbd) + pbd->hdr.bh1.offset_to_first_pkt;
+
+    for(uint32_t idx = 0; idx < count; ++idx) {
+      struct tpacket3_hdr* ppd = reinterpret_cast<struct tpacket3_hdr*>(ptr);
+
+      m_stamp = (static_cast<uint64_t>(ppd->tp_sec) * 1000000000ULL) + ppd->tp_nsec;
+      /*frame is handed upstream in place.*/
+      upstream(ptr + ppd->tp_mac, ppd->tp_snaplen);
+      ptr += ppd->tp_next_offset;
+    }
+
+    frames += count;
+    ++m_stats.m_blocks;
+
+    /*Hand the block back to kernel now.*/
+    __atomic_store_n(&pbd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    m_current = (m_current + 1) % m_block_count;
+  }
+
+  m_stats.m_frames += frames;
+  m_stats.m_last_frames = frames;
+
+  if(frames > m_stats.m_max_frames) {
+    m_stats.m_max_frames = frames;
+  }
+
+  return(frames);
+}
+
+int32_t mna::tx_ring::setup(ACE_HANDLE handle, uint32_t blockSize, uint32_t blockCount, uint32_t frameSize)
+{
+  int32_t version = TPACKET_V3;
+  int32_t current = 0;
+  int optLen = sizeof(current);
+  int32_t retStatus = -1;
+  struct tpacket_req3 req;
+
+  do {
+
+    if(!blockSize || !blockCount || (frameSize <= data_offset()) || (blockSize % frameSize)) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Invalid TX ring geometry block %u frame %u\n"),
+                 blockSize, frameSize));
+      break;
+    }
+
+    /*Version can not be changed once the receive ring is in place.*/
+    if((ACE_OS::getsockopt(handle, SOL_PACKET, PACKET_VERSION, (char *)&current, &optLen) < 0 || current != version) &&
+       ACE_OS::setsockopt(handle, SOL_PACKET, PACKET_VERSION, (const char *)&version, sizeof(version)) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Setting TPACKET_V3 failed for handle %d\n"), handle));
+      break;
+    }
+
+    std::memset((void *)&req, 0, sizeof(req));
+    req.tp_block_size = blockSize;
+    req.tp_block_nr = blockCount;
+    req.tp_frame_size = frameSize;
+    req.tp_frame_nr = (blockSize / frameSize) * blockCount;
+
+    if(ACE_OS::setsockopt(handle, SOL_PACKET, PACKET_TX_RING, (const char *)&req, sizeof(req)) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l PACKET_TX_RING failed for handle %d\n"), handle));
+      break;
+    }
+
+    m_frame_size = frameSize;
+    m_frame_count = req.tp_frame_nr;
+    m_window = ACE_OS::gettimeofday();
+    retStatus = 0;
+
+  } while(0);
+
+  return(retStatus);
+}
+
+int32_t mna::tx_ring::release(ACE_HANDLE handle)
+{
+  struct tpacket_req3 req;
+
+  std::memset((void *)&req, 0, sizeof(req));
+  m_base = nullptr;
+  m_frame_size = 0;
+  m_frame_count = 0;
+
+  if(ACE_OS::setsockopt(handle, SOL_PACKET, PACKET_TX_RING, (const char *)&req, sizeof(req)) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Releasing PACKET_TX_RING failed for handle %d\n"), handle));
+    return(-1);
+  }
+
+  return(0);
+}
+
+void mna::tx_ring::reclaim()
+{
+  while(m_tail != m_head) {
+    struct tpacket3_hdr* hdr = slot(m_tail);
+    uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+
+    if(TP_STATUS_SEND_REQUEST & status || TP_STATUS_SENDING & status) {
+      /*Still owned by kernel.*/
+      break;
+    }
+
+    if(TP_STATUS_WRONG_FORMAT & status) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l TX slot %u rejected by kernel\n"), m_tail % m_frame_count));
+      __atomic_store_n(&hdr->tp_status, TP_STATUS_AVAILABLE, __ATOMIC_RELEASE);
+    }
+
+    ++m_tail;
+  }
+
+  m_stats.m_in_flight = m_head - m_tail;
+}
+
+uint8_t* mna::tx_ring::acquire(uint32_t& capacity)
+{
+  if(!m_base) {
+    return(nullptr);
+  }
+
+  if((m_head - m_tail) >= m_frame_count) {
+    reclaim();
+
+    if((m_head - m_tail) >= m_frame_count) {
+      return(nullptr);
+    }
+  }
+
+  capacity = m_frame_size - data_offset();
+  return(reinterpret_cast<uint8_t*>(slot(m_head)) + data_offset());
+}
+
+int32_t mna::tx_ring::commit(const uint8_t* frame, uint32_t len)
+{
+  uint32_t capacity = 0;
+  uint8_t* data = acquire(capacity);
+
+  if(!data || len > capacity) {
+    ++m_stats.m_drops;
+    return(-1);
+  }
+
+  if(frame != data) {
+    /*Frame was not encoded in place, copy it into the slot now.*/
+    std::memcpy(data, frame, len);
+  }
+
+  struct tpacket3_hdr* hdr = slot(m_head);
+  hdr->tp_len = len;
+  hdr->tp_snaplen = len;
+  hdr->tp_next_offset = 0;
+  __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+  ++m_head;
+  ++m_pending;
+  ++m_stats.m_frames;
+  m_stats.m_in_flight = m_head - m_tail;
+
+  return(0);
+}
+
+uint32_t mna::tx_ring::flush(ACE_HANDLE handle)
+{
+  uint32_t flushed = m_pending;
+
+  if(m_pending) {
+
+    if(ACE_OS::send(handle, nullptr, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l TX ring kick failed for handle %d\n"), handle));
+    }
+
+    m_pending = 0;
+    ++m_stats.m_kicks;
+  }
+
+  reclaim();
+
+  ACE_Time_Value now = ACE_OS::gettimeofday();
+  ACE_Time_Value elapsed = now - m_window;
+
+  if(elapsed >= ACE_Time_Value(1)) {
+    m_stats.m_kicks_per_sec = ((m_stats.m_kicks - m_window_kicks) * 1000) / elapsed.msec();
+    m_window_kicks = m_stats.m_kicks;
+    m_window = now;
+  }
+
+  return(flushed);
+}
+
+#endif /*__RING_CC__*/
@@ -0,0 +1,50 @@
+#ifndef __SLAB_CC__
+#define __SLAB_CC__
+
+#include <sys/mman.h>
+
+#include "ace/Log_Msg.h"
+#include "ace/OS_NS_sys_mman.h"
+
+#include "slab.h"
+
+void* mna::slab_base::map(size_t& len, bool& hugepage)
+{
+  /* hugepage is 2MB on every platform of interest. */
+  const size_t HUGEPAGE = 2 * 1024 * 1024;
+  size_t regular = len;
+  void* base = MAP_FAILED;
+
+  if(hugepage) {
+    len = ((len + HUGEPAGE - 1) / HUGEPAGE) * HUGEPAGE;
+    base = ACE_OS::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, ACE_INVALID_HANDLE, 0);
+
+    if(MAP_FAILED == base) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l hugepages unavailable for slab of %Q bytes, using regular pages\n"), len));
+      len = regular;
+    }
+  }
+
+  hugepage = (MAP_FAILED != base);
+
+  if(MAP_FAILED == base) {
+    /* pages are touched as cells are handed out. */
+    base = ACE_OS::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, ACE_INVALID_HANDLE, 0);
+  }
+
+  if(MAP_FAILED == base) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l mmap of slab of %Q bytes failed\n"), len));
+    return(nullptr);
+  }
+
+  return(base);
+}
+
+void mna::slab_base::unmap(void* base, size_t len)
+{
+  ACE_OS::munmap(base, len);
+}
+
+#endif /*__SLAB_CC__*/
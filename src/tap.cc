@@ -0,0 +1,299 @@
+#ifndef __TAP_CC__
+#define __TAP_CC__
+
+#include <cstring>
+#include <new>
+
+#include "ace/Log_Msg.h"
+#include "ace/OS_NS_unistd.h"
+#include "ace/Time_Value.h"
+
+#include "tap.h"
+#include "pool.h"
+#include "latency.h"
+
+int32_t mna::tap_ring::setup(uint32_t slots, uint32_t snaplen, const std::array<uint8_t, 6>& mac)
+{
+  uint64_t count = 1;
+
+  while(count < slots) {
+    count <<= 1;
+  }
+
+  /* a whole frame is never larger than a packet pool buffer. */
+  m_snaplen = (snaplen && snaplen < mna::pkt_pool::BUFFER_SIZE) ? snaplen : static_cast<uint32_t>(mna::pkt_pool::BUFFER_SIZE);
+  m_slot_size = (sizeof(record_t) + m_snaplen + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+  m_slots.reset(new (std::nothrow) uint8_t[count * m_slot_size]);
+
+  if(!m_slots) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l allocation of %u tap slots failed\n"), count));
+    return(-1);
+  }
+
+  m_mac = mac;
+  m_trace_all = (std::array<uint8_t, 6>{{0, 0, 0, 0, 0, 0}} == mac);
+  m_mask = count - 1;
+  return(0);
+}
+
+bool mna::tap_ring::wanted(const uint8_t* frame, uint32_t len) const
+{
+  uint32_t l4 = 0;
+  uint32_t chaddr = 0;
+  uint16_t port = 0;
+
+  if(len < 14) {
+    return(false);
+  }
+
+  if(!std::memcmp(frame, m_mac.data(), m_mac.size()) || !std::memcmp(frame + 6, m_mac.data(), m_mac.size())) {
+    return(true);
+  }
+
+  /* replies to a client without an address are broadcast, client is known by BOOTP chaddr. */
+  if(len < 42 || frame[12] != 0x08 || frame[13] != 0x00 || frame[23] != 17) {
+    return(false);
+  }
+
+  l4 = 14 + ((frame[14] & 0x0F) * 4);
+
+  if((l4 + 8) > len) {
+    return(false);
+  }
+
+  port = (frame[l4 + 2] << 8) | frame[l4 + 3];
+
+  if(67 != port && 68 != port) {
+    return(false);
+  }
+
+  /* op, htype, hlen, hops, xid, secs, flags, ciaddr, yiaddr, siaddr and giaddr precede chaddr. */
+  chaddr = l4 + 8 + 28;
+  return((chaddr + m_mac.size()) <= len && !std::memcmp(frame + chaddr, m_mac.data(), m_mac.size()));
+}
+
+void mna::tap_ring::push(const uint8_t* frame, uint32_t len, pcapng_sink::dir_t dir, uint64_t stamp)
+{
+  uint64_t head = m_head.load(std::memory_order_relaxed);
+  record_t* rec = nullptr;
+
+  if(!m_trace_all && !wanted(frame, len)) {
+    return;
+  }
+
+  if((head - m_tail_cache) > m_mask) {
+    /* consumer position is read again only when the ring looks full. */
+    m_tail_cache = m_tail.load(std::memory_order_acquire);
+
+    if((head - m_tail_cache) > m_mask) {
+      m_drops.store(m_drops.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return;
+    }
+  }
+
+  rec = slot(head);
+  rec->m_stamp = stamp;
+  rec->m_len = len;
+  rec->m_caplen = static_cast<uint16_t>((len < m_snaplen) ? len : m_snaplen);
+  rec->m_dir = dir;
+  rec->m_rsvd = 0;
+  std::memcpy(reinterpret_cast<uint8_t*>(rec) + sizeof(record_t), frame, rec->m_caplen);
+
+  m_head.store(head + 1, std::memory_order_release);
+}
+
+const mna::tap_ring::record_t* mna::tap_ring::front()
+{
+  if(m_tail_local == m_head_cache) {
+    m_head_cache = m_head.load(std::memory_order_acquire);
+
+    if(m_tail_local == m_head_cache) {
+      return(nullptr);
+    }
+  }
+
+  return(slot(m_tail_local));
+}
+
+mna::capture_tap& mna::capture_tap::instance()
+{
+  static mna::capture_tap tap;
+  return(tap);
+}
+
+int32_t mna::capture_tap::setup(const std::string& prefix, uint32_t slots, uint32_t snaplen,
+                                uint32_t fileMB, uint32_t files, const std::array<uint8_t, 6>& mac)
+{
+  if(prefix.empty() || !slots) {
+    return(-1);
+  }
+
+  m_prefix = prefix;
+  m_slots = slots;
+  m_snaplen = snaplen;
+  m_file_bytes = static_cast<uint64_t>(fileMB ? fileMB : 1) * 1024 * 1024;
+  m_keep = files;
+  m_mac = mac;
+  return(0);
+}
+
+mna::tap_ring* mna::capture_tap::attach()
+{
+  uint32_t idx = m_count.load(std::memory_order_relaxed);
+
+  if(m_prefix.empty() || idx >= MAX_RINGS) {
+    return(nullptr);
+  }
+
+  if(m_rings[idx].setup(m_slots, m_snaplen, m_mac) < 0) {
+    return(nullptr);
+  }
+
+  /* ring is set up before writer thread gets to see it. */
+  m_count.store(idx + 1, std::memory_order_release);
+  return(&m_rings[idx]);
+}
+
+int mna::capture_tap::open(void* args)
+{
+  (void)args;
+
+  if(m_prefix.empty() || m_running) {
+    return(-1);
+  }
+
+  m_done.store(false);
+
+  if(activate(THR_NEW_LWP | THR_JOINABLE | THR_INHERIT_SCHED) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l writer thread of capture tap is not spawned\n")));
+    return(-1);
+  }
+
+  m_running = true;
+  return(0);
+}
+
+int mna::capture_tap::svc(void)
+{
+  if(rotate() < 0) {
+    return(-1);
+  }
+
+  while(!m_done.load(std::memory_order_acquire)) {
+
+    if(!drain()) {
+      /* nothing pending, what is buffered reaches the file before going idle. */
+      m_sink.flush();
+      ACE_OS::sleep(ACE_Time_Value(0, 1000));
+    }
+
+    if(m_sink.bytes() >= m_file_bytes) {
+      rotate();
+    }
+  }
+
+  while(drain()) {
+    ;
+  }
+
+  close_file();
+  return(0);
+}
+
+void mna::capture_tap::stop()
+{
+  if(!m_running) {
+    return;
+  }
+
+  m_done.store(true, std::memory_order_release);
+  wait();
+  m_running = false;
+}
+
+mna::tap_stats_t mna::capture_tap::stats() const
+{
+  tap_stats_t st;
+  uint32_t count = m_count.load(std::memory_order_acquire);
+
+  st.m_records = m_records.load(std::memory_order_relaxed);
+  st.m_drops = 0;
+  st.m_files = m_seq.load(std::memory_order_relaxed);
+
+  for(uint32_t idx = 0; idx < count; ++idx) {
+    st.m_drops += m_rings[idx].drops();
+  }
+
+  return(st);
+}
+
+uint32_t mna::capture_tap::drain()
+{
+  uint32_t count = m_count.load(std::memory_order_acquire);
+  uint32_t written = 0;
+
+  if(!m_sink.is_open()) {
+    return(0);
+  }
+
+  for(uint32_t idx = 0; idx < count; ++idx) {
+    tap_ring& ring = m_rings[idx];
+    const tap_ring::record_t* rec = nullptr;
+    uint32_t budget = DRAIN_BUDGET;
+
+    /* one interface per ring, described in every file before its first record. */
+    while(m_sink.interfaces() <= idx) {
+      m_sink.add_interface("tap" + std::to_string(m_sink.interfaces()), m_snaplen);
+    }
+
+    while(budget && (rec = ring.front())) {
+      m_sink.write(idx, reinterpret_cast<const uint8_t*>(rec) + sizeof(*rec), rec->m_caplen, rec->m_len,
+                   rec->m_stamp, static_cast<pcapng_sink::dir_t>(rec->m_dir));
+      ring.pop();
+      --budget;
+      ++written;
+    }
+
+    ring.commit();
+  }
+
+  m_records.fetch_add(written, std::memory_order_relaxed);
+  return(written);
+}
+
+int32_t mna::capture_tap::rotate()
+{
+  uint32_t seq = m_seq.load(std::memory_order_relaxed);
+  std::string path = m_prefix + "." + std::to_string(seq) + ".pcapng";
+
+  close_file();
+
+  if(m_keep && seq >= m_keep) {
+    ACE_OS::unlink((m_prefix + "." + std::to_string(seq - m_keep) + ".pcapng").c_str());
+  }
+
+  if(m_sink.open(path) < 0) {
+    return(-1);
+  }
+
+  m_seq.store(seq + 1, std::memory_order_relaxed);
+  return(0);
+}
+
+void mna::capture_tap::close_file()
+{
+  uint64_t now = mna::clock_ns();
+
+  if(!m_sink.is_open()) {
+    return;
+  }
+
+  /* drops are cumulative since the tap was started. */
+  for(uint32_t idx = 0; idx < m_sink.interfaces(); ++idx) {
+    m_sink.statistics(idx, now, m_rings[idx].drops());
+  }
+
+  m_sink.close();
+}
+
+#endif /*__TAP_CC__*/
@@ -0,0 +1,339 @@
+#ifndef __WHEEL_CC__
+#define __WHEEL_CC__
+
+#include "ace/Log_Msg.h"
+
+#include "wheel.h"
+
+int32_t mna::timing_wheel::setup(uint32_t timers, uint32_t tickMs)
+{
+  m_tick_ms = tickMs ? tickMs : 1;
+  m_free = NIL;
+  m_heads.fill(NIL);
+  m_nodes.clear();
+  m_intervals.clear();
+
+  if(timers >= HEAD) {
+    return(-1);
+  }
+
+  m_nodes.reserve(timers);
+
+  /* free list is built back to front so that low indices are handed out first. */
+  for(uint32_t idx = 0; idx < timers; ++idx) {
+    node_t node;
+    node.m_act = nullptr;
+    node.m_expiry = 0;
+    node.m_periodic = 0;
+    node.m_gen = 1;
+    node.m_next = NIL;
+    node.m_prev = NIL;
+    m_nodes.push_back(node);
+  }
+
+  for(uint32_t idx = timers; idx > 0; --idx) {
+    m_nodes[idx - 1].m_next = m_free;
+    m_free = idx - 1;
+  }
+
+  m_now = now_ms() / m_tick_ms;
+  return(0);
+}
+
+uint32_t mna::timing_wheel::alloc()
+{
+  uint32_t idx = m_free;
+
+  if(NIL == idx) {
+    /* pool is grown rather than failing, nodes are addressed by index so none moves. */
+    size_t count = m_nodes.size();
+    size_t grow = count ? count : static_cast<size_t>(SLOTS);
+
+    /* indices from HEAD on are taken by the tag of the first node of a list. */
+    if((count + grow) >= HEAD) {
+      return(NIL);
+    }
+
+    node_t node;
+    node.m_act = nullptr;
+    node.m_expiry = 0;
+    node.m_periodic = 0;
+    node.m_gen = 1;
+    node.m_next = NIL;
+    node.m_prev = NIL;
+    m_nodes.resize(count + grow, node);
+
+    for(size_t pos = count + grow; pos > count; --pos) {
+      m_nodes[pos - 1].m_next = m_free;
+      m_free = static_cast<uint32_t>(pos - 1);
+    }
+
+    ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l timing wheel grown to %u timers\n"), count + grow));
+    idx = m_free;
+  }
+
+  m_free = m_nodes[idx].m_next;
+  return(idx);
+}
+
+void mna::timing_wheel::release(uint32_t idx)
+{
+  node_t& node = m_nodes[idx];
+
+  if(node.m_periodic) {
+    m_intervals.erase(idx);
+    node.m_periodic = 0;
+  }
+
+  node.m_act = nullptr;
+  node.m_prev = NIL;
+  /* every id handed out for this node so far is stale from now on. */
+  node.m_gen = (node.m_gen == 0xFFFF) ? 1 : (node.m_gen + 1);
+  node.m_next = m_free;
+  m_free = idx;
+}
+
+uint32_t mna::timing_wheel::lookup(long id) const
+{
+  uint32_t idx = static_cast<uint32_t>(id & 0xFFFFFFFFL);
+  uint16_t gen = static_cast<uint16_t>((id >> 32) & 0xFFFF);
+
+  if(id < 0 || idx >= m_nodes.size() || m_nodes[idx].m_gen != gen ||
+     NIL == m_nodes[idx].m_prev) {
+    return(NIL);
+  }
+
+  return(idx);
+}
+
+void mna::timing_wheel::link(uint32_t idx)
+{
+  node_t& node = m_nodes[idx];
+  uint64_t expiry = node.m_expiry;
+  uint64_t delta = 0;
+  uint32_t list = 0;
+
+  /* due on current tick only while cascading, it lands in the slot expired right after. */
+  delta = expiry - m_now;
+
+  if(delta >= (1ULL << (LEVELS * SLOT_BITS))) {
+    /* beyond the span of the wheel, parked in the top level and moved down from there. */
+    expiry = m_now + (1ULL << (LEVELS * SLOT_BITS)) - 1;
+    delta = expiry - m_now;
+  }
+
+  for(uint32_t level = 0; level < LEVELS; ++level) {
+    if(delta < (1ULL << ((level + 1) * SLOT_BITS)) || (LEVELS - 1) == level) {
+      list = (level * SLOTS) + ((expiry >> (level * SLOT_BITS)) & SLOT_MASK);
+      break;
+    }
+  }
+
+  node.m_prev = HEAD | list;
+  node.m_next = m_heads[list];
+
+  if(NIL != node.m_next) {
+    m_nodes[node.m_next].m_prev = idx;
+  }
+
+  m_heads[list] = idx;
+}
+
+void mna::timing_wheel::unlink(uint32_t idx)
+{
+  node_t& node = m_nodes[idx];
+
+  if(node.m_prev & HEAD) {
+    m_heads[node.m_prev & ~HEAD] = node.m_next;
+  } else {
+    m_nodes[node.m_prev].m_next = node.m_next;
+  }
+
+  if(NIL != node.m_next) {
+    m_nodes[node.m_next].m_prev = node.m_prev;
+  }
+
+  node.m_next = NIL;
+  node.m_prev = NIL;
+}
+
+long mna::timing_wheel::schedule(const void* act, uint64_t delayMs, uint64_t intervalMs)
+{
+  uint32_t idx = alloc();
+
+  if(NIL == idx) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l timing wheel is out of timers\n")));
+    return(-1);
+  }
+
+  node_t& node = m_nodes[idx];
+  node.m_act = act;
+  /* slot of current tick is being expired, earliest is next tick. */
+  node.m_expiry = m_now + (delayMs ? ticks(delayMs) : 1);
+
+  if(intervalMs) {
+    /* the node is fresh from the pool, none of its periods is left in the index. */
+    m_intervals.insert(idx, static_cast<uint32_t>(ticks(intervalMs)));
+    node.m_periodic = 1;
+  }
+
+  link(idx);
+
+  ++m_stats.m_pending;
+  ++m_stats.m_scheduled;
+  return((static_cast<long>(node.m_gen) << 32) | idx);
+}
+
+int32_t mna::timing_wheel::cancel(long id)
+{
+  uint32_t idx = lookup(id);
+
+  if(NIL == idx) {
+    return(-1);
+  }
+
+  /* a node due by now is in the firing list, any other one is due past m_now. */
+  if(m_nodes[idx].m_expiry <= m_now) {
+    --m_stats.m_backlog;
+  }
+
+  unlink(idx);
+  release(idx);
+
+  --m_stats.m_pending;
+  ++m_stats.m_cancelled;
+  return(0);
+}
+
+int32_t mna::timing_wheel::rearm(long id, uint64_t delayMs)
+{
+  uint32_t idx = lookup(id);
+
+  if(NIL == idx) {
+    return(-1);
+  }
+
+  /* a node due by now is in the firing list, any other one is due past m_now. */
+  if(m_nodes[idx].m_expiry <= m_now) {
+    --m_stats.m_backlog;
+  }
+
+  unlink(idx);
+  m_nodes[idx].m_expiry = m_now + (delayMs ? ticks(delayMs) : 1);
+  link(idx);
+  return(0);
+}
+
+void mna::timing_wheel::cascade(uint32_t list)
+{
+  uint32_t idx = m_heads[list];
+
+  m_heads[list] = NIL;
+
+  while(NIL != idx) {
+    uint32_t next = m_nodes[idx].m_next;
+    link(idx);
+    ++m_stats.m_cascaded;
+    idx = next;
+  }
+}
+
+uint32_t mna::timing_wheel::fire(expiry_delegate_t& dispatch, uint32_t maxTimers, uint64_t deadline)
+{
+  uint32_t fired = 0;
+
+  for(uint32_t idx = m_heads[FIRING]; NIL != idx; idx = m_heads[FIRING]) {
+
+    if((maxTimers && fired >= maxTimers) ||
+       /* clock is read once every 64 timers only. */
+       (deadline && !(fired & 0x3F) && fired && now_ns() >= deadline)) {
+      break;
+    }
+
+    node_t& node = m_nodes[idx];
+    const void* act = node.m_act;
+
+    unlink(idx);
+    --m_stats.m_backlog;
+
+    if(node.m_periodic) {
+      node.m_expiry = m_now + m_intervals.find(idx);
+      link(idx);
+    } else {
+      release(idx);
+      --m_stats.m_pending;
+    }
+
+    ++m_stats.m_expired;
+    ++fired;
+
+    if(dispatch) {
+      dispatch(act);
+    }
+  }
+
+  return(fired);
+}
+
+uint32_t mna::timing_wheel::advance(uint64_t nowMs, expiry_delegate_t dispatch, uint32_t maxTimers, uint64_t maxNs)
+{
+  uint64_t target = nowMs / m_tick_ms;
+  uint64_t deadline = maxNs ? (now_ns() + maxNs) : 0;
+  uint32_t fired = 0;
+
+  /* backlog of previous call is due since m_now and goes out first. */
+  fired += fire(dispatch, maxTimers, deadline);
+
+  while(!m_stats.m_backlog && m_now < target) {
+
+    if(!m_stats.m_pending) {
+      /* nothing armed, no tick needs to be walked. */
+      m_now = target;
+      break;
+    }
+
+    ++m_now;
+
+    /* upper levels first, a timer may move down more than one level on the same tick. */
+    for(uint32_t level = LEVELS - 1; level > 0; --level) {
+      if(!(m_now & ((1ULL << (level * SLOT_BITS)) - 1))) {
+        cascade((level * SLOTS) + ((m_now >> (level * SLOT_BITS)) & SLOT_MASK));
+      }
+    }
+
+    /* slot is detached first, delegate may arm or cancel timers while it is walked. */
+    m_heads[FIRING] = m_heads[m_now & SLOT_MASK];
+    m_heads[m_now & SLOT_MASK] = NIL;
+
+    if(NIL != m_heads[FIRING]) {
+      m_nodes[m_heads[FIRING]].m_prev = HEAD | FIRING;
+    }
+
+    for(uint32_t idx = m_heads[FIRING]; NIL != idx; idx = m_nodes[idx].m_next) {
+      ++m_stats.m_backlog;
+    }
+
+    fired += fire(dispatch, maxTimers ? (maxTimers - fired) : 0, deadline);
+
+    if(maxTimers && fired >= maxTimers) {
+      break;
+    }
+
+    if(deadline && now_ns() >= deadline) {
+      break;
+    }
+  }
+
+  if(m_stats.m_backlog || m_now < target) {
+    /* timers due on tick m_now are still waiting to be dispatched. */
+    ++m_stats.m_throttled;
+    m_stats.m_lag_ms = (nowMs > (m_now * m_tick_ms)) ? (nowMs - (m_now * m_tick_ms)) : 0;
+    m_stats.m_max_lag_ms = (m_stats.m_lag_ms > m_stats.m_max_lag_ms) ? m_stats.m_lag_ms : m_stats.m_max_lag_ms;
+  } else {
+    m_stats.m_lag_ms = 0;
+  }
+
+  return(fired);
+}
+
+#endif /*__WHEEL_CC__*/
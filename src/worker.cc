@@ -0,0 +1,36 @@
+#ifndef __WORKER_CC__
+#define __WORKER_CC__
+
+#include "ace/OS_NS_Thread.h"
+
+#include "worker.h"
+
+int mna::worker::open(void* args)
+{
+  (void)args;
+
+  if(!m_reactor || !m_mw || !m_loop) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l worker %u is not instantiated\n"), m_id));
+    return(-1);
+  }
+
+  return(activate(THR_NEW_LWP | THR_JOINABLE | THR_INHERIT_SCHED));
+}
+
+int mna::worker::svc(void)
+{
+  ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l worker %u is started\n"), m_id));
+
+  /* Reactor is driven by this thread from now on. */
+  m_loop->run();
+
+  ACE_DEBUG((LM_DEBUG, ACE_TEXT("%D %M %N:%l worker %u is stopped\n"), m_id));
+  return(0);
+}
+
+void mna::worker::stop()
+{
+  m_loop->stop();
+}
+
+#endif /*__WORKER_CC__*/
@@ -0,0 +1,494 @@
+#ifndef __XDP_CC__
+#define __XDP_CC__
+
+#include <atomic>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/if_link.h>
+
+#include "ace/Log_Msg.h"
+#include "ace/OS_NS_sys_mman.h"
+#include "ace/OS_NS_sys_socket.h"
+#include "ace/OS_NS_unistd.h"
+
+#include "xdp.h"
+#include "protocol.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+namespace {
+
+  /* Index of rings and frames is shared with kernel, producer publishes with release. */
+  inline uint32_t load_acquire(const uint32_t* ptr)
+  {
+    return(__atomic_load_n(ptr, __ATOMIC_ACQUIRE));
+  }
+
+  inline void store_release(uint32_t* ptr, uint32_t value)
+  {
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+  }
+
+  inline int32_t bpf(int32_t cmd, union bpf_attr& attr)
+  {
+    return(static_cast<int32_t>(::syscall(__NR_bpf, cmd, &attr, sizeof(attr))));
+  }
+
+  inline struct bpf_insn insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm)
+  {
+    struct bpf_insn in;
+
+    in.code = code;
+    in.dst_reg = dst;
+    in.src_reg = src;
+    in.off = off;
+    in.imm = imm;
+    return(in);
+  }
+
+}
+
+int32_t mna::xdp::map_ring(ring_t& ring, uint64_t pgoff, const struct xdp_ring_offset& off,
+                           uint32_t count, size_t descSize)
+{
+  size_t len = off.desc + (count * descSize);
+  void* base = ACE_OS::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_handle, pgoff);
+
+  if(MAP_FAILED == base) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l mmap of XDP ring at 0x%X failed for handle %d\n"), pgoff, m_handle));
+    return(-1);
+  }
+
+  uint8_t* ptr = reinterpret_cast<uint8_t*>(base);
+  ring.m_producer = reinterpret_cast<uint32_t*>(ptr + off.producer);
+  ring.m_consumer = reinterpret_cast<uint32_t*>(ptr + off.consumer);
+  ring.m_flags = reinterpret_cast<uint32_t*>(ptr + off.flags);
+  ring.m_desc = ptr + off.desc;
+  ring.m_mask = count - 1;
+  ring.m_map = base;
+  ring.m_map_len = len;
+
+  return(0);
+}
+
+void mna::xdp::unmap_ring(ring_t& ring)
+{
+  if(ring.m_map) {
+    ACE_OS::munmap(ring.m_map, ring.m_map_len);
+  }
+
+  std::memset(&ring, 0, sizeof(ring));
+}
+
+/**
+ * @brief This member function loads the redirect program, written in eBPF instructions so that
+ *        no toolchain is needed to build it. ARP frames and IPv4 frames to UDP port 67 are
+ *        redirected to the socket bound to the receiving queue, every other frame and any frame
+ *        arriving on a queue without socket is passed to the kernel stack.
+ * */
+int32_t mna::xdp::load_program(int32_t ifindex, uint32_t queue)
+{
+  const int16_t PASS = 34;
+  const int16_t REDIRECT = 28;
+  const uint32_t ETH_LEN = sizeof(mna::eth::ETH);
+  char license[] = "GPL";
+  char log[4096];
+  union bpf_attr attr;
+  uint32_t key = queue;
+  uint32_t value = static_cast<uint32_t>(m_handle);
+
+  /* offset of jump instruction at pc to target. */
+  auto to = [](int16_t target, int16_t pc) -> int16_t { return(target - (pc + 1)); };
+
+  /* socket is looked up by rx_queue_index, one entry per queue. */
+  std::memset(&attr, 0, sizeof(attr));
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof(uint32_t);
+  attr.value_size = sizeof(uint32_t);
+  attr.max_entries = (queue < 64) ? 64 : (queue + 1);
+
+  if((m_map_fd = bpf(BPF_MAP_CREATE, attr)) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Creation of XSKMAP failed errno %d\n"), errno));
+    return(-1);
+  }
+
+  struct bpf_insn prog[] = {
+    /* 0: r6 = ctx, r2 = data, r3 = data_end */
+    insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+    insn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data), 0),
+    insn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end), 0),
+    /* 3: ethernet header must be present */
+    insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+    insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, ETH_LEN),
+    insn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, to(PASS, 5), 0),
+    /* 6: ethertype, loaded in host byte order of little endian cpu */
+    insn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, 12, 0),
+    insn(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_5, 0, to(REDIRECT, 7), htons(mna::eth::ARP)),
+    insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, to(PASS, 8), htons(mna::eth::IPv4)),
+    /* 9: fixed part of IP header must be present */
+    insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+    insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, ETH_LEN + sizeof(mna::ipv4::IP)),
+    insn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, to(PASS, 11), 0),
+    /* 12: IP protocol */
+    insn(BPF_LDX | BPF_B | BPF_MEM, BPF_REG_5, BPF_REG_2, ETH_LEN + 9, 0),
+    insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, to(PASS, 13), mna::ipv4::UDP),
+    /* 14: fragment offset must be zero for the udp header to be present */
+    insn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, ETH_LEN + 6, 0),
+    insn(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, htons(0x1FFF)),
+    insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, to(PASS, 16), 0),
+    /* 17: r4 = udp header */
+    insn(BPF_LDX | BPF_B | BPF_MEM, BPF_REG_5, BPF_REG_2, ETH_LEN, 0),
+    insn(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, 0x0F),
+    insn(BPF_ALU64 | BPF_LSH | BPF_K, BPF_REG_5, 0, 0, 2),
+    insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+    insn(BPF_ALU64 | BPF_ADD | BPF_X, BPF_REG_4, BPF_REG_5, 0, 0),
+    insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, ETH_LEN),
+    insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_7, BPF_REG_4, 0, 0),
+    insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_7, 0, 0, sizeof(mna::transport::UDP)),
+    insn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_7, BPF_REG_3, to(PASS, 25), 0),
+    /* 26: destination port */
+    insn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_4, 2, 0),
+    insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, to(PASS, 27), htons(mna::transport::BOOTPS)),
+    /* 28: bpf_redirect_map(map, rx_queue_index, XDP_PASS) */
+    insn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index), 0),
+    insn(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, m_map_fd),
+    insn(0, 0, 0, 0, 0),
+    insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS),
+    insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+    insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    /* 34: pass */
+    insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS),
+    insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+  };
+
+  std::memset(&attr, 0, sizeof(attr));
+  log[0] = '\0';
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.expected_attach_type = BPF_XDP;
+  attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+  attr.insns = reinterpret_cast<uint64_t>(prog);
+  attr.license = reinterpret_cast<uint64_t>(license);
+
+  if((m_prog_fd = bpf(BPF_PROG_LOAD, attr)) < 0) {
+    int32_t err = errno;
+    /* load again with verifier log, the log is too long to be collected on success. */
+    attr.log_level = 1;
+    attr.log_size = sizeof(log);
+    attr.log_buf = reinterpret_cast<uint64_t>(log);
+    bpf(BPF_PROG_LOAD, attr);
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Loading of XDP program failed errno %d\n%s\n"), err, log));
+    return(-1);
+  }
+
+  /* Generic mode works on every driver including veth, link is detached upon close. */
+  std::memset(&attr, 0, sizeof(attr));
+  attr.link_create.prog_fd = m_prog_fd;
+  attr.link_create.target_ifindex = ifindex;
+  attr.link_create.attach_type = BPF_XDP;
+  attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+
+  if((m_link_fd = bpf(BPF_LINK_CREATE, attr)) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Attaching XDP program to ifindex %d failed errno %d\n"), ifindex, errno));
+    return(-1);
+  }
+
+  std::memset(&attr, 0, sizeof(attr));
+  attr.map_fd = m_map_fd;
+  attr.key = reinterpret_cast<uint64_t>(&key);
+  attr.value = reinterpret_cast<uint64_t>(&value);
+  attr.flags = BPF_ANY;
+
+  if(bpf(BPF_MAP_UPDATE_ELEM, attr) < 0) {
+    ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Insertion of handle %d into XSKMAP failed errno %d\n"), m_handle, errno));
+    return(-1);
+  }
+
+  return(0);
+}
+
+int32_t mna::xdp::open(int32_t ifindex, uint32_t queue, uint32_t frames, uint32_t frameSize)
+{
+  int32_t retStatus = -1;
+  uint32_t half = frames / 2;
+  struct xdp_umem_reg reg;
+  struct xdp_mmap_offsets off;
+  struct sockaddr_xdp sxdp;
+  socklen_t len = sizeof(off);
+
+  do {
+
+    /* every ring is sized to half of the frames, power of two is expected by kernel. */
+    if(ifindex <= 0 || half < 2 || (half & (half - 1)) || frameSize < 2048 || (frameSize & (frameSize - 1))) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Invalid UMEM geometry frames %u frame size %u\n"), frames, frameSize));
+      break;
+    }
+
+    std::memset(&m_fill, 0, sizeof(m_fill));
+    std::memset(&m_comp, 0, sizeof(m_comp));
+    std::memset(&m_rx, 0, sizeof(m_rx));
+    std::memset(&m_tx, 0, sizeof(m_tx));
+
+    if((m_handle = ACE_OS::socket(AF_XDP, SOCK_RAW, 0)) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Creation of AF_XDP socket failed errno %d\n"), errno));
+      break;
+    }
+
+    m_frame_size = frameSize;
+    m_umem_len = static_cast<size_t>(frames) * frameSize;
+    void* umem = ACE_OS::mmap(nullptr, m_umem_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+
+    if(MAP_FAILED == umem) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l mmap of UMEM of %u bytes failed\n"), m_umem_len));
+      m_umem_len = 0;
+      break;
+    }
+
+    m_umem = reinterpret_cast<uint8_t*>(umem);
+
+    std::memset(&reg, 0, sizeof(reg));
+    reg.addr = reinterpret_cast<uint64_t>(m_umem);
+    reg.len = m_umem_len;
+    reg.chunk_size = frameSize;
+    reg.headroom = 0;
+
+    if(ACE_OS::setsockopt(m_handle, SOL_XDP, XDP_UMEM_REG, (const char *)&reg, sizeof(reg)) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l XDP_UMEM_REG failed for handle %d\n"), m_handle));
+      break;
+    }
+
+    if(ACE_OS::setsockopt(m_handle, SOL_XDP, XDP_UMEM_FILL_RING, (const char *)&half, sizeof(half)) < 0 ||
+       ACE_OS::setsockopt(m_handle, SOL_XDP, XDP_UMEM_COMPLETION_RING, (const char *)&half, sizeof(half)) < 0 ||
+       ACE_OS::setsockopt(m_handle, SOL_XDP, XDP_RX_RING, (const char *)&half, sizeof(half)) < 0 ||
+       ACE_OS::setsockopt(m_handle, SOL_XDP, XDP_TX_RING, (const char *)&half, sizeof(half)) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l Sizing of XDP rings to %u failed for handle %d\n"), half, m_handle));
+      break;
+    }
+
+    if(::getsockopt(m_handle, SOL_XDP, XDP_MMAP_OFFSETS, &off, &len) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l XDP_MMAP_OFFSETS failed for handle %d\n"), m_handle));
+      break;
+    }
+
+    if(map_ring(m_fill, XDP_UMEM_PGOFF_FILL_RING, off.fr, half, sizeof(uint64_t)) < 0 ||
+       map_ring(m_comp, XDP_UMEM_PGOFF_COMPLETION_RING, off.cr, half, sizeof(uint64_t)) < 0 ||
+       map_ring(m_rx, XDP_PGOFF_RX_RING, off.rx, half, sizeof(struct xdp_desc)) < 0 ||
+       map_ring(m_tx, XDP_PGOFF_TX_RING, off.tx, half, sizeof(struct xdp_desc)) < 0) {
+      break;
+    }
+
+    /* first half of UMEM is handed to kernel for receive, second half is kept for transmit. */
+    uint64_t* fill = reinterpret_cast<uint64_t*>(m_fill.m_desc);
+    for(uint32_t idx = 0; idx < half; ++idx) {
+      fill[idx] = static_cast<uint64_t>(idx) * frameSize;
+    }
+    store_release(m_fill.m_producer, half);
+
+    m_tx_free.clear();
+    m_tx_free.reserve(half);
+    for(uint32_t idx = frames; idx > half; --idx) {
+      m_tx_free.push_back(static_cast<uint64_t>(idx - 1) * frameSize);
+    }
+
+    m_tx_prod = *m_tx.m_producer;
+    m_tx_pending = 0;
+
+    std::memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = ifindex;
+    sxdp.sxdp_queue_id = queue;
+    sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+
+    if(ACE_OS::bind(m_handle, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l bind of AF_XDP socket to queue %u failed errno %d\n"), queue, errno));
+      break;
+    }
+
+    if(load_program(ifindex, queue) < 0) {
+      break;
+    }
+
+    retStatus = 0;
+
+  } while(0);
+
+  if(retStatus < 0) {
+    close();
+  }
+
+  return(retStatus);
+}
+
+void mna::xdp::close()
+{
+  /* closing the link detaches the program from interface. */
+  if(m_link_fd >= 0) {
+    ACE_OS::close(m_link_fd);
+    m_link_fd = -1;
+  }
+
+  if(m_prog_fd >= 0) {
+    ACE_OS::close(m_prog_fd);
+    m_prog_fd = -1;
+  }
+
+  if(m_map_fd >= 0) {
+    ACE_OS::close(m_map_fd);
+    m_map_fd = -1;
+  }
+
+  if(m_handle >= 0) {
+    unmap_ring(m_fill);
+    unmap_ring(m_comp);
+    unmap_ring(m_rx);
+    unmap_ring(m_tx);
+    ACE_OS::close(m_handle);
+    m_handle = -1;
+  }
+
+  if(m_umem) {
+    ACE_OS::munmap(m_umem, m_umem_len);
+    m_umem = nullptr;
+    m_umem_len = 0;
+  }
+
+  m_tx_free.clear();
+}
+
+uint32_t mna::xdp::poll(frame_delegate_t upstream)
+{
+  uint32_t cons = *m_rx.m_consumer;
+  uint32_t count = load_acquire(m_rx.m_producer) - cons;
+  uint32_t fillProd = *m_fill.m_producer;
+  const struct xdp_desc* desc = reinterpret_cast<const struct xdp_desc*>(m_rx.m_desc);
+  uint64_t* fill = reinterpret_cast<uint64_t*>(m_fill.m_desc);
+
+  for(uint32_t idx = 0; idx < count; ++idx) {
+    const struct xdp_desc& d = desc[(cons + idx) & m_rx.m_mask];
+    upstream(m_umem + d.addr, d.len);
+    /* frame goes back to kernel, the fill ring has room for every receive frame. */
+    fill[(fillProd + idx) & m_fill.m_mask] = d.addr & ~static_cast<uint64_t>(m_frame_size - 1);
+  }
+
+  if(count) {
+    store_release(m_rx.m_consumer, cons + count);
+    store_release(m_fill.m_producer, fillProd + count);
+    m_stats.m_rx_frames += count;
+  }
+
+  /* kernel waits for a wakeup once it has found the fill ring empty. */
+  if(__atomic_load_n(m_fill.m_flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP) {
+    ::recvfrom(m_handle, nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+  }
+
+  return(count);
+}
+
+void mna::xdp::reclaim()
+{
+  uint32_t cons = *m_comp.m_consumer;
+  uint32_t count = load_acquire(m_comp.m_producer) - cons;
+  const uint64_t* comp = reinterpret_cast<const uint64_t*>(m_comp.m_desc);
+
+  for(uint32_t idx = 0; idx < count; ++idx) {
+    m_tx_free.push_back(comp[(cons + idx) & m_comp.m_mask]);
+  }
+
+  if(count) {
+    store_release(m_comp.m_consumer, cons + count);
+  }
+}
+
+uint8_t* mna::xdp::acquire(uint32_t& capacity)
+{
+  if(m_tx_free.empty()) {
+    reclaim();
+  }
+
+  if(m_tx_free.empty() || (m_tx_prod - load_acquire(m_tx.m_consumer)) > m_tx.m_mask) {
+    return(nullptr);
+  }
+
+  capacity = m_frame_size;
+  return(m_umem + m_tx_free.back());
+}
+
+int32_t mna::xdp::commit(const uint8_t* frame, uint32_t len)
+{
+  uint32_t capacity = 0;
+  uint8_t* buf = acquire(capacity);
+
+  if(!buf || len > capacity) {
+    ++m_stats.m_tx_drops;
+    return(-1);
+  }
+
+  /* a frame encoded in any other buffer is copied into the free frame on top. */
+  if(frame != buf) {
+    std::memcpy(buf, frame, len);
+  }
+
+  struct xdp_desc* desc = reinterpret_cast<struct xdp_desc*>(m_tx.m_desc);
+  struct xdp_desc& d = desc[m_tx_prod & m_tx.m_mask];
+  d.addr = m_tx_free.back();
+  d.len = len;
+  d.options = 0;
+
+  m_tx_free.pop_back();
+  ++m_tx_prod;
+  ++m_tx_pending;
+
+  return(0);
+}
+
+uint32_t mna::xdp::flush()
+{
+  uint32_t published = m_tx_pending;
+
+  if(published) {
+    store_release(m_tx.m_producer, m_tx_prod);
+    m_stats.m_tx_frames += published;
+    m_tx_pending = 0;
+  }
+
+  /* copy mode transmits from sendto context only, kick whenever descriptors are outstanding. */
+  if((published || (load_acquire(m_tx.m_consumer) != m_tx_prod)) &&
+     (__atomic_load_n(m_tx.m_flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)) {
+
+    if(::sendto(m_handle, nullptr, 0, MSG_DONTWAIT, nullptr, 0) < 0 &&
+       EAGAIN != errno && EBUSY != errno && ENOBUFS != errno) {
+      ACE_ERROR((LM_ERROR, ACE_TEXT("%D %M %N:%l sendto kick failed for handle %d\n"), m_handle));
+    }
+
+    ++m_stats.m_kicks;
+  }
+
+  reclaim();
+  return(published);
+}
+
+const mna::xdp_stats_t& mna::xdp::stats()
+{
+  struct xdp_statistics st;
+  socklen_t len = sizeof(st);
+
+  if(m_handle >= 0 && !::getsockopt(m_handle, SOL_XDP, XDP_STATISTICS, &st, &len)) {
+    /* kernel keeps running totals for the lifetime of socket. */
+    m_stats.m_rx_dropped = st.rx_dropped + st.rx_ring_full;
+    if(len >= sizeof(st)) {
+      m_stats.m_fill_empty = st.rx_fill_ring_empty_descs;
+    }
+  }
+
+  return(m_stats);
+}
+
+#endif /*__XDP_CC__*/